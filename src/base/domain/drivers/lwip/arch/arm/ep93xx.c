@@ -226,6 +226,7 @@ struct ep93xx_priv
 
 	struct net_device	*dev;
 	//struct napi_struct	napi;
+	bool			rx_polling;	// RX int is disabled, we are polling
 
 	struct net_device_stats	stats;
 
@@ -250,13 +251,15 @@ static struct net_device_stats *ep93xx_get_stats(struct net_device *dev)
 }
 #endif
 
-static void ep93xx_rx(void)
+/* Take up to budget frames from the receive ring.
+   Returns the number taken. */
+static int ep93xx_rx(int budget)
 {
 	struct ep93xx_priv * ep = &theEp;
 	int processed;
 
 	processed = 0;
-	while (1) {
+	while (processed < budget) {
 		int entry = ep->rx_pointer;
 		struct ep93xx_rstat * rstat = ep->descs->rstat + entry;
 
@@ -290,8 +293,10 @@ static void ep93xx_rx(void)
 			DEBUG(errors) kdprintf(KR_OSTREAM,
 			  "rstat0 & RSTAT0_RWE\n");
 			ep->stats.rx_errors++;
-			if (rstat0 & RSTAT0_OE)
+			if (rstat0 & RSTAT0_OE) {
 				ep->stats.rx_fifo_errors++;
+				ethInputStats.overruns++;
+			}
 			if (rstat0 & RSTAT0_FE)
 				ep->stats.rx_frame_errors++;
 			if (rstat0 & (RSTAT0_RUNT | RSTAT0_EDATA))
@@ -340,6 +345,7 @@ err:
 		wrw(ep, REG_RXDENQ, processed);
 		wrw(ep, REG_RXSTSENQ, processed);
 	}
+	return processed;
 }
 
 static int ep93xx_have_more_rx(struct ep93xx_priv *ep)
@@ -348,12 +354,15 @@ static int ep93xx_have_more_rx(struct ep93xx_priv *ep)
 	return !!((rstat->rstat0 & RSTAT0_RFP) && (rstat->rstat1 & RSTAT1_RFP));
 }
 
-static void ep93xx_poll(void)
+/* One pass over the receive ring, in the main thread.
+   Returns nonzero if we are still polling (see ethRxBudget). */
+static int ep93xx_poll(void)
 {
 	struct ep93xx_priv * ep = &theEp;
 
-poll_some_more:
+	ethInputStats.polls++;
 #if 0 // CapROS
+poll_some_more:
 	rx = ep93xx_rx(dev, rx, budget);
 	if (rx < budget) {
 		int more = 0;
@@ -374,15 +383,18 @@ poll_some_more:
 
 	return rx;
 #else
-	ep93xx_rx();
-
-	wrl(ep, REG_INTEN, REG_INTEN_TX | REG_INTEN_RX);	// enable RX int
-	if (ep93xx_have_more_rx(ep)) {
-		wrl(ep, REG_INTEN, REG_INTEN_TX);	// disable RX int
-		wrl(ep, REG_INTSTSP, REG_INTSTS_RX);	// clear RX int
-
-		goto poll_some_more;
+	if (ep93xx_rx(ethRxBudget) < ethRxBudget) {
+		wrl(ep, REG_INTEN, REG_INTEN_TX | REG_INTEN_RX);	// enable RX int
+		if (! ep93xx_have_more_rx(ep)) {
+			ep->rx_polling = false;
+			return 0;
+		}
+		// A frame arrived before RX int was enabled.
 	}
+	wrl(ep, REG_INTEN, REG_INTEN_TX);	// disable RX int
+	wrl(ep, REG_INTSTSP, REG_INTSTS_RX);	// clear RX int
+	ep->rx_polling = true;
+	return 1;
 #endif // CapROS
 }
 
@@ -470,6 +482,7 @@ ep93xx_do_irq(u32 status)
 {
 	DEBUG(tx) printk("ep93xx_do_irq: status=%#x\n", status);
 
+	ethInputStats.interrupts++;
 	if (status & REG_INTSTS_RX)
 		ep93xx_poll();
 
@@ -479,6 +492,15 @@ ep93xx_do_irq(u32 status)
 	return IRQ_HANDLED;
 }
 
+static uint32_t
+ep93xx_do_poll(u32 unused)
+{
+	/* Our interrupt thread is busy polling, so check for
+	   completed transmissions here. */
+	ep93xx_tx_complete();
+	return ep93xx_poll();
+}
+
 static irqreturn_t ep93xx_irq(int irq, void *dev_id)
 {
 	struct ep93xx_priv * ep = &theEp;
@@ -506,9 +528,17 @@ static irqreturn_t ep93xx_irq(int irq, void *dev_id)
 	/* For concurrency control, do interrupt work in the main thread. */
 	/* An alternative design would be to use a semaphore. */
 	uint32_t ret;
+	uint32_t more;
 	capros_IPInt_processInterrupt(KR_DeviceEntry,
 				(uint32_t)&ep93xx_do_irq, status, &ret);
 
+	/* While RX int is disabled, poll. Each pass is a separate call,
+	   so the main thread can serve other requests in between. */
+	more = ep->rx_polling;
+	while (more)
+		capros_IPInt_processInterrupt(KR_DeviceEntry,
+				(uint32_t)&ep93xx_do_poll, 0, &more);
+
 	return ret;
 #endif // CapROS
 }
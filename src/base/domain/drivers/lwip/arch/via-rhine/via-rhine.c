@@ -428,6 +428,7 @@ struct rhine_private {
 	long pioaddr;
 	struct net_device *dev;
 	struct napi_struct napi;
+	bool rx_polling;	/* Rx interrupts are disabled, we are polling */
 	struct net_device_stats stats;
 	spinlock_t lock;
 
@@ -1464,29 +1465,106 @@ low_level_output(struct netif *netif, struct pbuf *p)
 }
 
 static uint32_t rhine_do_interrupt(uint32_t dev_instance);
+static uint32_t rhine_do_poll(uint32_t dev_instance);
 
 /* The interrupt handler does all of the Rx thread work and cleans up
    after the Tx thread. */
 static irqreturn_t rhine_interrupt(int irq, void *dev_instance)
 {
+  struct rhine_private *rp = netdev_priv((struct net_device *)dev_instance);
   /* For concurrency control, do interrupt work in the main thread. */
   uint32_t ret;
+  uint32_t more;
   capros_IPInt_processInterrupt(KR_DeviceEntry,
                 (uint32_t)&rhine_do_interrupt, (uint32_t)dev_instance, &ret);
+  /* While Rx interrupts are disabled, poll (see ethRxBudget).
+  Each pass is a separate call, so the main thread can serve
+  other requests in between. */
+  more = rp->rx_polling;
+  while (more)
+    capros_IPInt_processInterrupt(KR_DeviceEntry,
+                (uint32_t)&rhine_do_poll, (uint32_t)dev_instance, &more);
   return ret;
 }
 
+static int rhine_service(struct net_device *dev);
+
+/* The Rx interrupt sources, which are masked while we poll. */
+#define IntrRxSources (IntrRxDone | IntrRxErr | IntrRxDropped | IntrRxWakeUp \
+		       | IntrRxEmpty | IntrRxNoBuf | IntrRxOverflow)
+
+/* One pass over the Rx ring, in the main thread.
+   Returns nonzero if we are still polling. */
+static uint32_t
+rhine_rx_pass(struct net_device *dev)
+{
+	struct rhine_private *rp = netdev_priv(dev);
+	void __iomem *ioaddr = rp->base;
+	u32 intr_status = get_intr_status(dev) & IntrRxSources;
+
+	/* rhine_service leaves the Rx sources to us while we poll.
+	   Acknowledge them before draining the ring, so a packet that
+	   arrives afterwards raises them again. */
+	if (intr_status) {
+		iowrite16(intr_status, ioaddr + IntrStatus);
+		IOSYNC;
+		if (intr_status & (IntrRxOverflow | IntrRxNoBuf))
+			ethInputStats.overruns++;
+	}
+
+	ethInputStats.polls++;
+	/* If the pass doesn't use its whole budget,
+	   rhine_napipoll enables Rx interrupts. */
+	if (rhine_napipoll(&rp->napi, ethRxBudget) < ethRxBudget)
+		rp->rx_polling = false;
+	return rp->rx_polling;
+}
+
 static uint32_t
 rhine_do_interrupt(uint32_t dev_instance)
 {
 	struct net_device *dev = (void *)dev_instance;
+	struct rhine_private *rp = netdev_priv(dev);
+	int handled;
+
+	ethInputStats.interrupts++;
+	handled = rhine_service(dev);
+	if (rp->rx_polling)
+		rhine_rx_pass(dev);
+	return IRQ_RETVAL(handled);
+}
+
+static uint32_t
+rhine_do_poll(uint32_t dev_instance)
+{
+	struct net_device *dev = (void *)dev_instance;
+
+	/* Our interrupt thread is busy polling, so handle any other
+	   events here. */
+	rhine_service(dev);
+	return rhine_rx_pass(dev);
+}
+
+/* Acknowledge and handle the current interrupt sources.
+   Rx work is left for rhine_rx_pass. While we are polling, the Rx
+   sources are masked and left for rhine_rx_pass to acknowledge;
+   otherwise incoming packets would keep us in this loop until
+   max_interrupt_work ran out. */
+static int
+rhine_service(struct net_device *dev)
+{
 	struct rhine_private *rp = netdev_priv(dev);
 	void __iomem *ioaddr = rp->base;
 	u32 intr_status;
 	int boguscnt = max_interrupt_work;
 	int handled = 0;
 
-	while ((intr_status = get_intr_status(dev))) {
+	for (;;) {
+		intr_status = get_intr_status(dev);
+		if (rp->rx_polling)
+			intr_status &= ~IntrRxSources;
+		if (! intr_status)
+			break;
 		handled = 1;
 
 		/* Acknowledge all of the current interrupt sources ASAP. */
@@ -1509,10 +1587,13 @@ rhine_do_interrupt(uint32_t dev_instance)
 #if 0 // CapROS
 			napi_schedule(&rp->napi);
 #else
-			(void) rhine_napipoll(&rp->napi, 63000);
+			rp->rx_polling = true;
 #endif // CapROS
 		}
 
+		if (intr_status & (IntrRxOverflow | IntrRxNoBuf))
+			ethInputStats.overruns++;
+
 		if (intr_status & (IntrTxErrSummary | IntrTxDone)) {
 			if (intr_status & IntrTxErrSummary) {
 				/* Avoid scavenging before Tx engine turned off */
@@ -1543,7 +1624,7 @@ rhine_do_interrupt(uint32_t dev_instance)
 	if (debug > 3)
 		printk(KERN_DEBUG "%s: exiting interrupt, status=%8.8x.\n",
 		       dev->name, ioread16(ioaddr + IntrStatus));
-	return IRQ_RETVAL(handled);
+	return handled;
 }
 
 /* This routine is logically part of the interrupt handler, but isolated
@@ -32,6 +32,9 @@ Approved for public release, distribution unlimited. */
 #include <disk/NPODescr.h>
 #include <idl/capros/SpaceBank.h>
 #include <idl/capros/Node.h>
+#include <idl/capros/Page.h>
+#include <idl/capros/GPT.h>
+#include <idl/capros/Memory.h>
 #include <idl/capros/SuperNode.h>
 #include <idl/capros/Forwarder.h>
 #include <idl/capros/Process.h>
@@ -40,6 +43,7 @@ Approved for public release, distribution unlimited. */
 #include <idl/capros/IPInt.h>
 #include <idl/capros/NPLink.h>
 #include <domain/assert.h>
+#include <domain/CMTEMaps.h>
 #include <eros/machine/cap-instr.h>
 
 #include <lwip/stats.h>
@@ -156,6 +160,10 @@ enum TCPSk_state {
 
 #define maxRecvQPBufs 64
 
+// poll_tcp is called every pollTicks ticks of the TCP slow timer.
+#define pollTicks 4
+#define pollIntervalMs (pollTicks * TCP_SLOW_INTERVAL)
+
 struct TCPSocket {
 #ifdef MALLOC_DEBUG
   void * poison0;
@@ -176,6 +184,21 @@ struct TCPSocket {
   unsigned int sendLen;   // if sending == true, the amount of data to send
   u8_t sendPush;	// TCP_WRITE_FLAG_MORE or 0 to push
 
+  /* The send segment, if any, is mapped at page segMapOfs of the maps area.
+  Its GPT is in the keystore at sco_sendSeg. segData is NULL if there is none. */
+  const unsigned char * segData;
+  unsigned int segSize;		// in bytes
+  long segMapOfs;
+  unsigned int segPages;
+  /* If sendNoCopy, the data being sent is in the send segment.
+  It is not copied, so we must not return to the sender until
+  it has been acknowledged. */
+  bool sendNoCopy;
+  u32_t bytesWritten;	// bytes given to tcp_write, modulo 2**32
+  u32_t bytesAcked;	// bytes reported by sent_tcp, modulo 2**32
+  u32_t sendSegEnd;	// if sendNoCopy, bytesWritten after the last data
+  err_t sendErr;	// if sendNoCopy, the error to report when acknowledged
+
   /* recvQ is a circular buffer of pbufs of data received.
    * recvQIn is where the next pbuf will be put.
    * recvQOut is where the next pbuf to be removed is.
@@ -184,6 +207,10 @@ struct TCPSocket {
   struct pbuf * * recvQOut;
   unsigned int recvQNum;
   unsigned int receiverMaxLen;
+  /* If rcvTimeoutPolls is nonzero, a receive that has waited that many
+  calls of poll_tcp is returned with Timeout. */
+  unsigned int rcvTimeoutPolls;
+  unsigned int rcvIdlePolls;	// poll_tcp calls since the receive began
   /* The receiving process can read as little as one byte at a time,
    * so we must keep track of how much of the first pbuf chain has been read.
    * curRecvPbuf points to the same pbuf as recvQOut, or to a pbuf
@@ -298,40 +325,113 @@ DeliverDataNow(struct TCPSocket * sock, unsigned int maxLen)
   return false;
 }
 
-static void
-ConsumePbuf(struct TCPSocket * sock)
+// Remove the first pbuf chain from the queue and return it.
+static struct pbuf *
+DequeuePbuf(struct TCPSocket * sock)
 {
   assert(sock->recvQNum);
   --sock->recvQNum;
-  pbuf_free(* sock->recvQOut);
+  struct pbuf * p = * sock->recvQOut;
 #ifndef NDEBUG
   * sock->recvQOut = NULL;	// for safety
   sock->curRecvPbuf = NULL;
 #endif
   if (++sock->recvQOut >= &sock->recvQ[maxRecvQPBufs])
     sock->recvQOut = &sock->recvQ[0];	// wrap around
+  return p;
+}
+
+static void
+ConsumePbuf(struct TCPSocket * sock)
+{
+  pbuf_free(DequeuePbuf(sock));
+}
+
+/* When received data are delivered directly from a pbuf,
+ * the pbuf chain is removed from the queue before the data are sent.
+ * heldPbuf is such a chain. It is freed by ReleaseHeldPbuf
+ * after the data are sent. */
+static struct pbuf * heldPbuf = NULL;
+
+static void
+ReleaseHeldPbuf(void)
+{
+  if (heldPbuf) {
+    pbuf_free(heldPbuf);
+    heldPbuf = NULL;
+  }
+}
+
+/* len bytes of curRecvPbuf, which had remaining bytes not yet delivered,
+ * have been delivered. Advance to the next data.
+ * If hold is true, a chain that is used up goes to heldPbuf
+ * instead of being freed. */
+static void
+AdvanceRecvPbuf(struct TCPSocket * sock, unsigned int len,
+  unsigned int remaining, bool hold)
+{
+  // Did we use up this pbuf?
+  if (len < remaining) {	// we didn't
+    sock->curRecvBytesProcessed += len;
+  } else {
+    sock->curRecvBytesProcessed = 0;
+    struct pbuf * p = sock->curRecvPbuf->next;
+    if (p) {	// there is another pbuf in this chain
+		// note we might have to check tot_len instead of NULL
+      sock->curRecvPbuf = p;
+    } else {	// finished this chain
+      if (hold) {
+        assert(! heldPbuf);
+        heldPbuf = DequeuePbuf(sock);
+      } else
+        ConsumePbuf(sock);
+      if (sock->recvQNum)
+        sock->curRecvPbuf = * sock->recvQOut;
+    }
+  }
 }
 
 uint8_t recvFlags;
-/* Sets recvFlags and returns the number of bytes to send to client. */
+const uint8_t * recvData;
+/* Sets recvFlags and recvData and returns the number of bytes
+ * to send to client.
+ * If all the data to send are in one pbuf, recvData points into the pbuf
+ * and we avoid copying the data. In that case the caller must call
+ * ReleaseHeldPbuf after sending the data.
+ * Otherwise the data are gathered into sndBuf. */
 static unsigned int
 GatherRecvData(struct TCPSocket * sock, unsigned int maxLen)
 {
   recvFlags = 0;
+  recvData = (uint8_t *)&sndBuf[0];
   if (! sock->recvQNum)
     return 0;		// No data. Delivering final RemoteClosed.
 
+  struct pbuf * p = sock->curRecvPbuf;
+  unsigned int remaining = p->len - sock->curRecvBytesProcessed;
+		// bytes remaining to be processed in this pbuf
+  unsigned int len;
+  if (remaining >= maxLen
+      || (! p->next && sock->recvQNum == 1) ) {
+    // All the data we will deliver are in this pbuf.
+    if (p->flags & PBUF_FLAG_PUSH)
+      recvFlags |= capros_TCPSocket_flagPush;
+    len = remaining < maxLen ? remaining : maxLen;
+    recvData = (uint8_t *)p->payload + sock->curRecvBytesProcessed;
+    AdvanceRecvPbuf(sock, len, remaining, true);
+    tcp_recved(sock->pcb, len);	// let the sender send more
+    return len;
+  }
+
   uint8_t * outp = (uint8_t *)&sndBuf[0];
 
   while (1) {
     assert(sock->recvQNum);
-    struct pbuf * p = sock->curRecvPbuf;
+    p = sock->curRecvPbuf;
     if (p->flags & PBUF_FLAG_PUSH)
       recvFlags |= capros_TCPSocket_flagPush;
     // FIXME deal with Urgent flag, when lwip implements it
-    unsigned int remaining = p->len - sock->curRecvBytesProcessed;
-		// bytes remaining to be processed in this pbuf
-    unsigned int len;
+    remaining = p->len - sock->curRecvBytesProcessed;
     if (remaining > maxLen)	// min of remaining and maxLen
       len = maxLen;
     else
@@ -339,29 +439,17 @@ GatherRecvData(struct TCPSocket * sock, unsigned int maxLen)
 
     uint8_t * payload = (uint8_t *)p->payload;
     payload += sock->curRecvBytesProcessed;
-    // FIXME: eliminate this copy if it's large
     memcpy(outp, payload, len);
     outp += len;
     maxLen -= len;
 
-    // Did we use up this pbuf?
-    if (len < remaining) {	// we didn't
-      sock->curRecvBytesProcessed += len;
+    AdvanceRecvPbuf(sock, len, remaining, false);
+    if (len < remaining) {
       assert(maxLen == 0);
       break;
-    } else {
-      sock->curRecvBytesProcessed = 0;
-      p = p->next;
-      if (p) {	// there is another pbuf in this chain
-		// note we might have to check tot_len instead of NULL
-        sock->curRecvPbuf = p;
-      } else {	// finished this chain
-        ConsumePbuf(sock);
-        if (sock->recvQNum == 0)
-          break;	// no more buffers
-        sock->curRecvPbuf = * sock->recvQOut;
-      }
     }
+    if (sock->recvQNum == 0)
+      break;	// no more buffers
   }
   unsigned int totalLen = outp - (uint8_t *)&sndBuf[0];	// num of bytes copied
   assert(totalLen);
@@ -392,9 +480,10 @@ ReturnToReceiver(struct TCPSocket * sock, unsigned int bytesReceived,
     .snd_key2 = KR_VOID,
     .snd_rsmkey = KR_VOID,
     .snd_len = bytesReceived,
-    .snd_data = sndBuf
+    .snd_data = recvData
   };
   PSEND(&Msg);	// prompt send
+  ReleaseHeldPbuf();
   sock->receiving = false;
   DEBUG(rx) kprintf(KR_OSTREAM, "lwip woke rcvr, rc=%#x, flgs=%#x\n",
                     rc, flags);
@@ -445,7 +534,7 @@ CheckFullyClosed(struct TCPSocket * sock)
        ignore any calls to err_tcp etc.: */
     tcp_err(sock->pcb, NULL);
     tcp_sent(sock->pcb, NULL);
-    tcp_poll(sock->pcb, NULL, 4);
+    tcp_poll(sock->pcb, NULL, pollTicks);
 #ifdef MALLOC_DEBUG
     // We don't expect any calls to recv_tcp, but this will catch:
     tcp_arg(sock->pcb, POISON4);
@@ -521,10 +610,16 @@ TCPReceive(Message * msg)
                          sock, sock->TCPSk_state);
       CheckFullyClosed(sock);
     } else {
-      msg->snd_data = sndBuf;
+      msg->snd_data = recvData;
       msg->snd_len = bytesReceived;
       msg->snd_w1 = bytesReceived;
       msg->snd_w2 = recvFlags;
+      if (heldPbuf) {
+        // Reply now, so we can free the pbuf that has the data.
+        SEND(msg);
+        msg->snd_invKey = KR_VOID;
+        ReleaseHeldPbuf();
+      }
     }
   } else {
     result_t result;
@@ -536,10 +631,27 @@ TCPReceive(Message * msg)
     msg->snd_invKey = KR_VOID;
 
     sock->receiverMaxLen = maxLen;
+    sock->rcvIdlePolls = 0;
     sock->receiving = true;
   }
 }
 
+static void
+TCPSetReceiveTimeout(Message * msg)
+{
+  struct TCPSocket * sock = (struct TCPSocket *)msg->rcv_w3;
+	// word from forwarder
+  ValidateSock(sock);
+
+  uint32_t seconds = msg->rcv_w1;
+  if (seconds > 0xffffffffUL / 1000) {
+    msg->snd_code = RC_capros_key_RequestError;
+    return;
+  }
+  sock->rcvTimeoutPolls = (seconds * 1000 + pollIntervalMs - 1)
+                          / pollIntervalMs;
+}
+
 /*************************** TCP Writing ******************************/
 
 /* The receive buffer size must be big enough for both a UDP message and
@@ -599,6 +711,18 @@ sendFinished(struct TCPSocket * sock, err_t err)
   };
   PSEND(&Msg);	// prompt send
   sock->sending = false;
+  sock->sendNoCopy = false;
+}
+
+// If all the data from the send segment has been acknowledged,
+// return to the sender.
+static void
+CheckSegmentAcked(struct TCPSocket * sock)
+{
+  assert(sock->sendNoCopy);
+  if (sock->sendLen == 0
+      && (int32_t)(sock->bytesAcked - sock->sendSegEnd) >= 0)
+    sendFinished(sock, sock->sendErr);
 }
 
 static void
@@ -621,12 +745,25 @@ do_sendmore(struct TCPSocket * sock)
 
   /* Unfortunately, there is no easy way to find out when sent data has been
      acknowledged, and its space can be reused. Buffering would be complex.
-     Thus we copy the data by specifying TCP_WRITE_FLAG_COPY. */
-  err = tcp_write(sock->pcb, sock->sendData, len, push | TCP_WRITE_FLAG_COPY);
+     Thus we copy the data by specifying TCP_WRITE_FLAG_COPY.
+     The exception is data from the send segment. The sender waits
+     until that data is acknowledged, so lwip can refer to it in place. */
+  if (! sock->sendNoCopy)
+    push |= TCP_WRITE_FLAG_COPY;
+  err = tcp_write(sock->pcb, sock->sendData, len, push);
   switch (err) {
   default:
     kdprintf(KR_OSTREAM, "tcp_write err %d!\n", err);
-    sendFinished(sock, err);
+    if (sock->sendNoCopy) {
+      /* lwip still refers to the part of the segment already written.
+      Send no more, but don't return to the sender (who could then
+      unregister the segment) until that part has been acknowledged. */
+      sock->sendLen = 0;
+      sock->sendSegEnd = sock->bytesWritten;
+      sock->sendErr = err;
+      CheckSegmentAcked(sock);
+    } else
+      sendFinished(sock, err);
     break;
 
   case ERR_MEM:
@@ -643,9 +780,14 @@ do_sendmore(struct TCPSocket * sock)
     if (err != ERR_OK)
       DEBUG(errors) kdprintf(KR_OSTREAM, "tcp_output returned %d.\n", err);
 
+    sock->bytesWritten += len;
     sock->sendData += len;
-    if ((sock->sendLen -= len) == 0)
-      sendFinished(sock, err);
+    if ((sock->sendLen -= len) == 0) {
+      if (sock->sendNoCopy)
+        CheckSegmentAcked(sock);	// generally not yet
+      else
+        sendFinished(sock, err);
+    }
   }
 }
 
@@ -683,6 +825,7 @@ TCPSend(Message * msg)
 
   sock->sendData = curRcvBuf;
   sock->sendLen = totalLen;
+  sock->sendNoCopy = false;
   bool push = flags & (capros_TCPSocket_flagPush
                        | capros_TCPSocket_flagUrgent);	// urgent implies push
   sock->sendPush = push ? 0 : TCP_WRITE_FLAG_MORE;
@@ -703,6 +846,192 @@ TCPSend(Message * msg)
   do_sendmore(sock);
 }
 
+/* Send segments come from our own bank. So that clients cannot exhaust it,
+the segments of all sockets together may have at most maxSendSegPages pages. */
+#define maxSendSegPages 256
+static unsigned int sendSegPagesInUse = 0;
+
+/* Free the send segment's GPT, which is in KR_TEMP0,
+and its first nPages pages. */
+static void
+FreeSendSegmentSpace(unsigned int nPages)
+{
+  result_t result;
+  unsigned int i;
+
+  for (i = 0; i < nPages; i++) {
+    result = capros_GPT_getSlot(KR_TEMP0, i, KR_TEMP1);
+    assert(result == RC_OK);
+    result = capros_SpaceBank_free1(KR_BANK, KR_TEMP1);
+    assert(result == RC_OK);
+  }
+  result = capros_SpaceBank_free1(KR_BANK, KR_TEMP0);
+  assert(result == RC_OK);
+}
+
+static void
+UnmapSendSegment(struct TCPSocket * sock)
+{
+  result_t result;
+
+  if (sock->segData) {
+    maps_liberate(sock->segMapOfs, sock->segPages);
+    const capros_Node_extAddr_t slot = (capros_Node_extAddr_t)sock;
+    result = capros_Node_swapSlotExtended(KR_KEYSTORE, slot+sco_sendSeg,
+                                          KR_VOID, KR_TEMP0);
+    assert(result == RC_OK);
+    FreeSendSegmentSpace(sock->segPages);
+    sendSegPagesInUse -= sock->segPages;
+    sock->segData = NULL;
+  }
+}
+
+/* The segment is allocated from our own bank, not supplied by the client,
+so the client cannot rescind its pages while lwip refers to them. */
+static void
+TCPRegisterSendSegment(Message * msg)
+{
+  result_t result;
+
+  struct TCPSocket * sock = (struct TCPSocket *)msg->rcv_w3;
+	// word from forwarder
+  ValidateSock(sock);
+
+  if (sock->sending && sock->sendNoCopy) {
+    msg->snd_code = RC_capros_TCPSocket_Already;
+    return;
+  }
+
+  uint32_t size = msg->rcv_w1;
+  if (size == 0 || size > capros_TCPSocket_maxSegmentSize) {
+    msg->snd_code = RC_capros_key_RequestError;
+    return;
+  }
+  unsigned int nPages = (size + EROS_PAGE_SIZE - 1) >> EROS_PAGE_LGSIZE;
+
+  UnmapSendSegment(sock);
+
+  if (nPages > maxSendSegPages - sendSegPagesInUse)
+    goto noMem;
+  long pgOffset = maps_reserve(nPages);
+  if (pgOffset < 0)
+    goto noMem;
+
+  result = capros_SpaceBank_alloc1(KR_BANK, capros_Range_otGPT, KR_TEMP0);
+  if (result != RC_OK)
+    goto noMem1;
+  result = capros_GPT_setL2v(KR_TEMP0, EROS_PAGE_LGSIZE);
+  assert(result == RC_OK);
+
+  unsigned int i;
+  for (i = 0; i < nPages; i++) {
+    result = capros_SpaceBank_alloc1(KR_BANK, capros_Range_otPage, KR_TEMP1);
+    if (result != RC_OK)
+      goto noMem2;
+    result = capros_GPT_setSlot(KR_TEMP0, i, KR_TEMP1);
+    assert(result == RC_OK);
+    result = capros_Memory_reduce(KR_TEMP1, capros_Memory_readOnly, KR_TEMP1);
+    assert(result == RC_OK);
+    result = maps_mapPage(pgOffset + i, KR_TEMP1);
+    if (result != RC_OK) {
+      i++;	// free this page too
+      goto noMem2;
+    }
+  }
+
+  const capros_Node_extAddr_t slot = (capros_Node_extAddr_t)sock;
+  result = capros_Node_swapSlotExtended(KR_KEYSTORE, slot+sco_sendSeg,
+                                        KR_TEMP0, KR_VOID);
+  assert(result == RC_OK);
+
+  sock->segMapOfs = pgOffset;
+  sock->segPages = nPages;
+  sock->segSize = size;
+  sock->segData = maps_pgOffsetToAddr(pgOffset);
+  sendSegPagesInUse += nPages;
+
+  // Give the client an opaque key, so it can fill the pages
+  // but not change the slots.
+  result = capros_Memory_reduce(KR_TEMP0, capros_Memory_opaque, KR_TEMP0);
+  assert(result == RC_OK);
+  msg->snd_key0 = KR_TEMP0;	// override default of KR_VOID
+  return;
+
+noMem2:
+  FreeSendSegmentSpace(i);
+noMem1:
+  maps_liberate(pgOffset, nPages);
+noMem:
+  msg->snd_code = RC_capros_TCPSocket_NoMem;
+}
+
+static void
+TCPUnregisterSendSegment(Message * msg)
+{
+  struct TCPSocket * sock = (struct TCPSocket *)msg->rcv_w3;
+	// word from forwarder
+  ValidateSock(sock);
+
+  if (sock->sending && sock->sendNoCopy) {
+    msg->snd_code = RC_capros_TCPSocket_Already;
+    return;
+  }
+  UnmapSendSegment(sock);
+}
+
+// Write TCP data from the send segment.
+static void
+TCPSendSegment(Message * msg)
+{
+  result_t result;
+
+  struct TCPSocket * sock = (struct TCPSocket *)msg->rcv_w3;
+	// word from forwarder
+  ValidateSock(sock);
+
+  // w3 has the word from the forwarder, so the stub packs flags with offset.
+  uint8_t flags = msg->rcv_w1;
+  uint32_t offset = msg->rcv_w1 >> 8;
+  uint32_t len = msg->rcv_w2;
+  if (! sock->segData
+      || offset > sock->segSize || len > sock->segSize - offset
+      || (flags & ~(capros_TCPSocket_flagPush | capros_TCPSocket_flagUrgent))) {
+    msg->snd_code = RC_capros_key_RequestError;
+    return;
+  }
+
+  //// Urgent flag is not implemented yet:
+  assert(!(flags & capros_TCPSocket_flagUrgent));
+
+  if (sock->sending || sock->TCPSk_state == TCPSk_state_Closed
+      || sock->TCPSk_state == TCPSk_state_Closing) {
+    msg->snd_code = RC_capros_TCPSocket_Already;
+    return;
+  }
+
+  if (len == 0)
+    return;	// nothing to do
+
+  sock->sendData = sock->segData + offset;
+  sock->sendLen = len;
+  bool push = flags & (capros_TCPSocket_flagPush
+                       | capros_TCPSocket_flagUrgent);	// urgent implies push
+  sock->sendPush = push ? 0 : TCP_WRITE_FLAG_MORE;
+  sock->sendNoCopy = true;
+  sock->sendSegEnd = sock->bytesWritten + len;
+  sock->sendErr = ERR_OK;
+  sock->sending = true;
+
+  // Save the caller:
+  const capros_Node_extAddr_t slot = (capros_Node_extAddr_t)sock;
+  result = capros_Node_swapSlotExtended(KR_KEYSTORE, slot+sco_sender,
+                                        KR_RETURN, KR_VOID);
+  assert(result == RC_OK);
+  msg->snd_invKey = KR_VOID;
+
+  do_sendmore(sock);
+}
+
 // The caller is responsible for deallocating the tcp_pcb
 static void
 DestroyTCPConnection(struct TCPSocket * sock)
@@ -713,6 +1042,9 @@ DestroyTCPConnection(struct TCPSocket * sock)
   assert(! sock->receiving);
   assert(! sock->sending);
 
+  // Free the send segment while its keystore slot is still allocated.
+  UnmapSendSegment(sock);
+
   // Free the associated forwarder.
   const capros_Node_extAddr_t slot = (capros_Node_extAddr_t)sock;
   result = capros_Node_getSlotExtended(KR_KEYSTORE, slot+sco_forwarder,
@@ -754,6 +1086,9 @@ TryClose(struct TCPSocket * sock)
   err_t err = tcp_close(sock->pcb);
   if (err == ERR_OK) {
     sock->TCPSk_state = TCPSk_state_Closed;
+    /* No more can be sent. Any segment data sent has been acknowledged,
+    so we can free the segment now rather than when fully closed. */
+    UnmapSendSegment(sock);
     return true;
   } else
     return false;
@@ -796,6 +1131,12 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
   struct TCPSocket * sock = arg;
   ValidateSock(sock);
 
+  if (sock->receiving && sock->rcvTimeoutPolls
+      && ++sock->rcvIdlePolls >= sock->rcvTimeoutPolls) {
+    DEBUG(rx) kprintf(KR_OSTREAM, "sock=%#x receive timed out\n", sock);
+    ReturnToReceiver(sock, 0, RC_capros_TCPSocket_Timeout);
+  }
+
   if (sock->sending) {
     if (sock->TCPSk_state == TCPSk_state_Closing) {
       DEBUG(mem) kprintf(KR_OSTREAM, "%s:%d: retry close\n",
@@ -808,10 +1149,13 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
         sendFinished(sock, ERR_OK);
         CheckFullyClosed(sock);
       }
-    } else {
+    } else if (sock->sendLen) {
       DEBUG(mem) kprintf(KR_OSTREAM, "%s:%d: retry send, len=%d avail=%d\n",
                    __FILE__, __LINE__, sock->sendLen, tcp_sndbuf(sock->pcb));
       do_sendmore(sock);
+    } else {
+      // All the data is written. Wait for it to be acknowledged.
+      CheckSegmentAcked(sock);
     }
   }
   return ERR_OK;
@@ -820,6 +1164,8 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
 static err_t
 sent_tcp(void *arg, struct tcp_pcb *pcb, u16_t len)
 {
+  struct TCPSocket * sock = arg;
+  sock->bytesAcked += len;
   return poll_tcp(arg, pcb);
 }
 
@@ -1001,7 +1347,12 @@ CreateSocket(void)
   sock->sendBuf = buf;
   sock->TCPSk_state = TCPSk_state_None;
   sock->sending = false;
+  sock->sendNoCopy = false;
+  sock->segData = NULL;
+  sock->bytesWritten = 0;
+  sock->bytesAcked = 0;
   sock->receiving = false;
+  sock->rcvTimeoutPolls = 0;
   sock->remoteCloseDelivered = false;
   sock->TCPSk_remoteState = 0;
   sock->recvQIn = sock->recvQOut = &sock->recvQ[0];
@@ -1027,7 +1378,7 @@ SocketInit(struct TCPSocket * sock, struct tcp_pcb * pcb)
   tcp_arg(pcb, sock);
   tcp_recv(pcb, &recv_tcp);
   tcp_sent(pcb, &sent_tcp);
-  tcp_poll(pcb, &poll_tcp, 4);
+  tcp_poll(pcb, &poll_tcp, pollTicks);
   tcp_err(pcb, &err_tcp);
 }
 
@@ -1429,6 +1780,11 @@ cap_main(void)
       case OC_capros_NPIP_createUDPPort:
         UDPCreate(&Msg);
         break;
+
+      case OC_capros_NPIP_getInputStatistics:
+        Msg.snd_data = &ethInputStats;
+        Msg.snd_len = sizeof(ethInputStats);
+        break;
       }
       break;
 
@@ -1508,6 +1864,22 @@ cap_main(void)
       case 1:	// OC_capros_TCPSocket_send
         TCPSend(&Msg);
         break;
+
+      case OC_capros_TCPSocket_registerSendSegment:
+        TCPRegisterSendSegment(&Msg);
+        break;
+
+      case OC_capros_TCPSocket_unregisterSendSegment:
+        TCPUnregisterSendSegment(&Msg);
+        break;
+
+      case 2:	// OC_capros_TCPSocket_sendSegment
+        TCPSendSegment(&Msg);
+        break;
+
+      case OC_capros_TCPSocket_setReceiveTimeout:
+        TCPSetReceiveTimeout(&Msg);
+        break;
       }
       break;
 
@@ -1538,6 +1910,14 @@ cap_main(void)
       case 1:	// OC_capros_UDPPort_send
         UDPSend(&Msg);
         break;
+
+      case 2:	// OC_capros_UDPPort_receiveBatch
+        UDPReceiveBatch(&Msg);
+        break;
+
+      case 3:	// OC_capros_UDPPort_sendBatch
+        UDPSendBatch(&Msg);
+        break;
       }
       break;
 
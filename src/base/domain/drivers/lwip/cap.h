@@ -32,7 +32,8 @@ Approved for public release, distribution unlimited. */
 // cannot be done simultaneously.
 #define sco_sender 1	// a resume capability to the sending process
 #define sco_receiver 2	// a resume capability to the receiving process
-#define sco_numSlots 3
+#define sco_sendSeg 3	// the GPT of the registered send segment
+#define sco_numSlots 4
 
 /* Each UDP port has the following capability variables in the keystore: */
 #define udp_forwarder 0	// a non-opaque capability to the forwarder for
@@ -62,6 +63,7 @@ Approved for public release, distribution unlimited. */
 #ifndef __ASSEMBLER__
 
 #include <ipv4/lwip/ip_addr.h>
+#include <idl/capros/NPIP.h>
 
 struct Message;
 
@@ -79,8 +81,17 @@ void UDPCreate(struct Message * msg);
 void UDPDestroy(struct Message * msg);
 void UDPReceive(struct Message * msg);
 void UDPSend(struct Message * msg);
+void UDPReceiveBatch(struct Message * msg);
+void UDPSendBatch(struct Message * msg);
 
 // From ethInput.h:
+/* A driver takes at most ethRxBudget frames from its receive ring
+   in one pass. If a pass uses its whole budget, the driver leaves
+   receive interrupts disabled and its interrupt thread asks the main
+   thread for another pass, NAPI-style. Other requests are served
+   between passes. */
+#define ethRxBudget 32
+extern capros_NPIP_InputStatistics ethInputStats;
 void printPacket(uint8_t * data, unsigned int pktLength,
   unsigned int maxBytesToPrint);
 void ethInput(void * data, unsigned int length);
@@ -22,6 +22,7 @@ Research Projects Agency under Contract No. W31P4Q-07-C-0070.
 Approved for public release, distribution unlimited. */
 
 #include <linuxk/lsync.h>
+#include <string.h>
 #include <eros/Invoke.h>
 #include <idl/capros/SpaceBank.h>
 #include <idl/capros/Node.h>
@@ -47,7 +48,8 @@ Approved for public release, distribution unlimited. */
 
 #define DEBUG(x) if (dbg_##x & dbg_flags)
 
-#define maxRecvQPBufs 5
+/* Enough to let receiveBatch return a useful number of small datagrams. */
+#define maxRecvQPBufs 32
 
 struct recvQItem {
   struct pbuf * pbuf;
@@ -58,6 +60,8 @@ struct recvQItem {
 struct UDPPort {
   struct udp_pcb * pcb;
   bool receiving;
+  bool receivingBatch;	// if receiving, the receiver called receiveBatch
+  unsigned int receiverMaxLen;	// if receivingBatch, its maxBytesToReceive
 
   struct pbuf sendPbuf;
 
@@ -101,6 +105,56 @@ rqi_ReturnToReceiver(struct recvQItem * rqi, cap_t receiver)
   pbuf_free(p);
 }
 
+static inline unsigned int
+BatchRecordLength(unsigned int dataLen)
+{
+  return (sizeof(capros_UDPPort_batchHeader) + dataLen + 3) & ~3;
+}
+
+uint32_t batchBuf[capros_UDPPort_maxBatchLength / sizeof(uint32_t)];
+
+/* Return to receiver as many queued datagrams as fit in maxLen,
+as records in batchBuf. maxLen must be a multiple of 4.
+There must be at least one datagram queued. */
+static void
+ReturnBatchToReceiver(struct UDPPort * sock, unsigned int maxLen,
+  cap_t receiver)
+{
+  uint8_t * outp = (uint8_t *)batchBuf;
+  unsigned int count = 0;
+
+  assert(sock->recvQNum);
+  do {
+    struct recvQItem * rqi = sock->recvQOut;
+    struct pbuf * p = rqi->pbuf;
+    unsigned int space = maxLen - (outp - (uint8_t *)batchBuf);
+    unsigned int dataLen = p->len;
+    if (BatchRecordLength(dataLen) > space) {
+      if (count)
+        break;	// leave it for the next receive
+      // It doesn't fit by itself. Truncate it.
+      dataLen = space - sizeof(capros_UDPPort_batchHeader);
+    }
+    capros_UDPPort_batchHeader * hdr = (capros_UDPPort_batchHeader *)outp;
+    hdr->ipaddr = rqi->ipAddr;
+    hdr->port = rqi->port;
+    hdr->length = dataLen;
+    memcpy(outp + sizeof(capros_UDPPort_batchHeader), p->payload, dataLen);
+    outp += BatchRecordLength(dataLen);
+    count++;
+
+    pbuf_free(p);
+    if (++sock->recvQOut >= &sock->recvQ[maxRecvQPBufs])
+      sock->recvQOut = &sock->recvQ[0];	// wrap around
+    --sock->recvQNum;
+  } while (sock->recvQNum);
+
+  DEBUG(rx) kprintf(KR_OSTREAM, "UDP returning batch of %d\n", count);
+  // w1 has the number of datagrams.
+  ReturnToReceiver(receiver, batchBuf, outp - (uint8_t *)batchBuf,
+                   RC_OK, count, 0);
+}
+
 // recv_udp is called when a datagram is received from the network.
 void
 recv_udp(void * arg, struct udp_pcb * pcb,
@@ -124,7 +178,7 @@ kdprintf(KR_OSTREAM, "recv_udp: queue full, discarding datagram!\n");////
   rqi->port = port;
 
   // Wake any receiver.
-  if (sock->receiving) {
+  if (sock->receiving && ! sock->receivingBatch) {
     result_t result;
 
     // Can only be receiving if the buffer was empty:
@@ -142,6 +196,17 @@ kdprintf(KR_OSTREAM, "recv_udp: queue full, discarding datagram!\n");////
     if (++sock->recvQIn >= &sock->recvQ[maxRecvQPBufs])
       sock->recvQIn = &sock->recvQ[0];	// wrap around
     sock->recvQNum++;
+
+    if (sock->receiving) {	// a batch receiver
+      result_t result;
+      const capros_Node_extAddr_t slot = (capros_Node_extAddr_t)sock;
+      result = capros_Node_getSlotExtended(KR_KEYSTORE,
+                                           slot+udp_receiver, KR_TEMP0);
+      assert(result == RC_OK);
+      sock->receiving = false;
+
+      ReturnBatchToReceiver(sock, sock->receiverMaxLen, KR_TEMP0);
+    }
   }
 }
 
@@ -216,6 +281,7 @@ UDPCreate(Message * msg)
   udp_recv(pcb, &recv_udp, sock);	// specify callback
   sock->pcb = pcb;
   sock->receiving = false;
+  sock->receivingBatch = false;
   sock->recvQIn = sock->recvQOut = &sock->recvQ[0];
   sock->recvQNum = 0;
   // Initialize constant fields in the pbuf:
@@ -305,6 +371,7 @@ UDPReceive(Message * msg)
     assert(result == RC_OK);
 
     sock->receiving = true;
+    sock->receivingBatch = false;
   } else {			// deliver data
     DEBUG(rx) kprintf(KR_OSTREAM, "UDPReceive: got data\n");
     /* Rather than send the message to the caller by RETURNing to KR_RETURN,
@@ -320,15 +387,49 @@ UDPReceive(Message * msg)
 }
 
 void
-UDPSend(Message * msg)
+UDPReceiveBatch(Message * msg)
 {
-  err_t err;
+  result_t result;
   struct UDPPort * sock = (struct UDPPort *)msg->rcv_w3;
 	// word from forwarder
 
-  uint32_t ipAddr = msg->rcv_w1;	// host format
-  unsigned int portNum = msg->rcv_w2;
-  uint32_t len = LWIP_MIN(msg->rcv_limit, msg->rcv_sent);
+  uint32_t maxLen = msg->rcv_w1;
+  if (maxLen > capros_UDPPort_maxBatchLength
+      || maxLen < BatchRecordLength(1)) {
+    msg->snd_code = RC_capros_key_RequestError;
+    return;
+  }
+  maxLen &= ~3;		// records are a multiple of 4 bytes
+
+  if (sock->receiving) {
+    msg->snd_code = RC_capros_UDPPort_Already;
+    return;
+  }
+
+  if (sock->recvQNum == 0) {	// there is no data now
+    DEBUG(rx) kprintf(KR_OSTREAM, "UDPReceiveBatch: waiting\n");
+    // Save the caller:
+    const capros_Node_extAddr_t slot = (capros_Node_extAddr_t)sock;
+    result = capros_Node_swapSlotExtended(KR_KEYSTORE, slot+udp_receiver,
+                                          KR_RETURN, KR_VOID);
+    assert(result == RC_OK);
+
+    sock->receiving = true;
+    sock->receivingBatch = true;
+    sock->receiverMaxLen = maxLen;
+  } else {			// deliver data
+    // PSEND to KR_RETURN as in UDPReceive, to free the pbufs after use.
+    ReturnBatchToReceiver(sock, maxLen, KR_RETURN);
+  }
+  msg->snd_invKey = KR_VOID;
+}
+
+// ipAddr is in host format.
+static result_t
+SendDatagram(struct UDPPort * sock, uint32_t ipAddr, unsigned int portNum,
+  void * data, unsigned int len)
+{
+  err_t err;
 
   struct ip_addr ipa = {
     .addr = htonl(ipAddr)
@@ -340,19 +441,17 @@ UDPSend(Message * msg)
     assert(false);
 
   case ERR_USE:
-    msg->snd_code = RC_capros_UDPPort_NoPort;
-    return;
+    return RC_capros_UDPPort_NoPort;
 
   case ERR_RTE:
-    msg->snd_code = RC_capros_UDPPort_NoRoute;
-    return;
+    return RC_capros_UDPPort_NoRoute;
 
   case ERR_OK:
     break;
   }
 
   struct pbuf * p = &sock->sendPbuf;
-  p->payload = msg->rcv_data;
+  p->payload = data;
   p->len = p->tot_len = len;
 
   err = udp_send(sock->pcb, p);
@@ -363,4 +462,51 @@ UDPSend(Message * msg)
   case ERR_OK:
     break;
   }
+  return RC_OK;
+}
+
+void
+UDPSend(Message * msg)
+{
+  struct UDPPort * sock = (struct UDPPort *)msg->rcv_w3;
+	// word from forwarder
+
+  uint32_t ipAddr = msg->rcv_w1;	// host format
+  unsigned int portNum = msg->rcv_w2;
+  uint32_t len = LWIP_MIN(msg->rcv_limit, msg->rcv_sent);
+
+  msg->snd_code = SendDatagram(sock, ipAddr, portNum, msg->rcv_data, len);
+}
+
+void
+UDPSendBatch(Message * msg)
+{
+  result_t result;
+  struct UDPPort * sock = (struct UDPPort *)msg->rcv_w3;
+	// word from forwarder
+
+  uint32_t len = LWIP_MIN(msg->rcv_limit, msg->rcv_sent);
+  uint8_t * rec = msg->rcv_data;
+  uint8_t * end = rec + len;
+  unsigned int count = 0;
+
+  while (rec < end) {
+    capros_UDPPort_batchHeader * hdr = (capros_UDPPort_batchHeader *)rec;
+    if (end - rec < sizeof(capros_UDPPort_batchHeader)
+        || hdr->length > end - rec - sizeof(capros_UDPPort_batchHeader)) {
+      msg->snd_code = RC_capros_key_RequestError;
+      break;
+    }
+    result = SendDatagram(sock, hdr->ipaddr, hdr->port,
+                          rec + sizeof(capros_UDPPort_batchHeader),
+                          hdr->length);
+    if (result != RC_OK) {
+      msg->snd_code = result;
+      break;
+    }
+    count++;
+    rec += BatchRecordLength(hdr->length);
+  }
+  DEBUG(tx) kprintf(KR_OSTREAM, "UDP sent batch of %d\n", count);
+  msg->snd_w1 = count;
 }
@@ -28,6 +28,7 @@ Approved for public release, distribution unlimited. */
 #include <ipv4/lwip/ip.h>
 
 #include <domain/assert.h>
+#include "cap.h"
 
 #define dbg_errors 0x01
 #define dbg_rx     0x02
@@ -40,6 +41,8 @@ Approved for public release, distribution unlimited. */
 
 extern struct netif * gNetif;
 
+capros_NPIP_InputStatistics ethInputStats;	// zero
+
 void
 printPacket(uint8_t * data, unsigned int pktLength,
   unsigned int maxBytesToPrint)
@@ -65,6 +68,8 @@ ethInput(void * data, unsigned int length)
 {
   uint8_t * b = data;
 
+  ethInputStats.frames++;
+
   DEBUG(rx) {
     printk("Eth rcvd: ");
 #if 1	// show input data
@@ -124,6 +129,7 @@ ethInput(void * data, unsigned int length)
       LINK_STATS_INC(link.recv);
     } else {
     	DEBUG(errors) kdprintf(KR_OSTREAM, "Can't alloc pbuf!\n");
+    	ethInputStats.drops++;
     	LINK_STATS_INC(link.memerr);
     	LINK_STATS_INC(link.drop);
     }
@@ -3385,10 +3385,12 @@ tg3_reset_hw(struct tg3 *tp)
     capros_Sleep_sleep(KR_SLEEP,.10);
   }
 
-  tw32(HOSTCC_RXCOL_TICKS, 0);
-  tw32(HOSTCC_RXMAX_FRAMES, 1);
-  tw32(HOSTCC_RXCOAL_TICK_INT, 0);
-  tw32(HOSTCC_RXCOAL_MAXF_INT, 1);
+  /* Coalesce rx interrupts: interrupt after DEFAULT_RXMAX_FRAMES frames
+   * or DEFAULT_RXCOL_TICKS usec, rather than for every frame. */
+  tw32(HOSTCC_RXCOL_TICKS, DEFAULT_RXCOL_TICKS);
+  tw32(HOSTCC_RXMAX_FRAMES, DEFAULT_RXMAX_FRAMES);
+  tw32(HOSTCC_RXCOAL_TICK_INT, DEFAULT_RXCOAL_TICK_INT);
+  tw32(HOSTCC_RXCOAL_MAXF_INT, DEFAULT_RXCOAL_MAXF_INT);
   tw32(HOSTCC_TXCOL_TICKS, LOW_TXCOL_TICKS);
   tw32(HOSTCC_TXMAX_FRAMES, LOW_RXMAX_FRAMES);
   tw32(HOSTCC_TXCOAL_TICK_INT, 0);
@@ -3870,12 +3872,17 @@ unsigned int tg3_has_work(struct tg3 *tp)
   return work_exists;
 }
 
+/* The most passes over the rings in one interrupt. While there is
+ * work, the chip doesn't interrupt us, so under load we poll. */
+#define TG3_MAX_POLL_PASSES 8
+
 static void 
 tg3_interrupt(struct tg3 *tp)
 {
   struct tg3_hw_status *sblk = tp->hw_status;
+  int passes = 0;
 
-  /*DEBUG_ALTIMA*/ kprintf(KR_OSTREAM,"tg3_interrupt %d ",sblk->status);
+  DEBUG_ALTIMA kprintf(KR_OSTREAM,"tg3_interrupt %d ",sblk->status);
   if (sblk->status & SD_STATUS_UPDATED) {
     /* writing any value to intr-mbox-0 clears PCI INTA# and
      * chip-internal interrupt pending events.
@@ -3889,7 +3896,8 @@ tg3_interrupt(struct tg3 *tp)
     tr32(MAILBOX_INTERRUPT_0 + TG3_64BIT_REG_LOW);
     sblk->status &= ~SD_STATUS_UPDATED;
 
-    tg3_has_work(tp);
+    while (tg3_has_work(tp) && ++passes < TG3_MAX_POLL_PASSES)
+      ;
         
     tg3_enable_ints(tp);
   } else {
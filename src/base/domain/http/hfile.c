@@ -21,19 +21,44 @@
 Research Projects Agency under Contract No. W31P4Q-07-C-0070.
 Approved for public release, distribution unlimited. */
 
-#include "http.h"
-
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef SELF_TEST
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+typedef int bool;
+#define false 0
+#define true 1
+#endif
+
+#include "http.h"
+
 #ifndef SELF_TEST
 
 #include <eros/target.h>
 #include <idl/capros/key.h>
+#include <idl/capros/GPT.h>
 
 #endif // SELF_TEST
 
+/* A file being sent is mapped a window at a time, and the window
+   is written straight into TLS records without copying the data
+   through a buffer.
+   The window is a slot of the maps GPT (see CMMEMaps.h) which the maps
+   allocator doesn't use; it is a background window onto the map of the
+   file (see File.getMap). */
+#define FileWindowLgSize 17	// the span of a slot of KR_MAPS_GPT
+#define FileWindowSize (1ul << FileWindowLgSize)
+#ifndef SELF_TEST
+#define FileWindowSlot (capros_GPT_backgroundSlot - 1)
+#define FileWindowAddr \
+  ((const char *)(LK_MAPS_BASE + FileWindowSlot * FileWindowSize))
+#endif
+
 /**
  * destroyFile - Destroy the file created for writing.
  */
@@ -120,6 +145,120 @@ readFile(void *buf, int len) {
 #endif
 }
 
+/**
+ * mapFile - Get the map of the open file, and make it the background
+ *           of the file window.
+ *
+ * @param[out] size is the number of bytes that can be mapped.
+ *
+ * @return is 1 if the file is mapped, 0 if it can't be mapped.
+ */
+static int
+mapFile(uint64_t * size) {
+#ifdef SELF_TEST
+  struct stat sb;
+
+  if (fstat(theFile, &sb) < 0)
+    return 0;
+  *size = sb.st_size;
+  return 1;
+#else
+  result_t rc;
+
+  rc = capros_File_getMap(KR_FILE, size, KR_FILEMAP);
+  DEBUG(file) DBGPRINT(DBGTARGET, "HTTP: Get file map rc=%#x size=%llu\n",
+		       rc, *size);
+  if (rc != RC_OK)
+    return 0;	// this kind of File may not have a map
+  rc = capros_GPT_setBackground(KR_MAPS_GPT, KR_FILEMAP);
+  assert(rc == RC_OK);
+  return 1;
+#endif
+}
+
+/**
+ * unmapFile - Undo mapFile.
+ */
+static void
+unmapFile(void) {
+#ifndef SELF_TEST
+  capros_GPT_setSlot(KR_MAPS_GPT, FileWindowSlot, KR_VOID);
+  capros_GPT_clearBackground(KR_MAPS_GPT);
+  capros_GPT_setSlot(KR_MAPS_GPT, capros_GPT_backgroundSlot, KR_VOID);
+#endif
+}
+
+/**
+ * sendMapped - Send the open file from its map.
+ *
+ * @param[in] rs is the ReaderState for the connection.
+ * @param[in] isUsingChunked is nonzero to send the data as chunks.
+ *            Otherwise the data sent must be exactly getFileLen() bytes.
+ *
+ * @return is 1 if the file was sent, 0 if there was a write error,
+ *         or -1 if the file can't be mapped; in that case nothing
+ *         has been sent.
+ */
+static int
+sendMapped(ReaderState * rs, int isUsingChunked) {
+  uint64_t size;
+  uint64_t at;
+  char cl[19];
+
+  if (! mapFile(&size))
+    return -1;
+#ifndef SELF_TEST
+  if (! isUsingChunked) {
+    // We have already sent theFileSize as the Content-Length.
+    if (size < theFileSize) {
+      unmapFile();
+      return -1;
+    }
+    size = theFileSize;
+  }
+#endif
+
+  for (at = 0; at < size; at += FileWindowSize) {
+    int len = size - at < FileWindowSize ? size - at : FileWindowSize;
+    int ok;
+#ifdef SELF_TEST
+    const char * window = mmap(NULL, len, PROT_READ, MAP_SHARED, theFile, at);
+    if (MAP_FAILED == window) {
+      if (0 == at)
+        return -1;
+      return 0;		// we can't finish the response
+    }
+#else
+    const char * window = FileWindowAddr;
+    result_t rc = capros_GPT_setWindow(KR_MAPS_GPT, FileWindowSlot,
+                    capros_GPT_windowBaseSlot, capros_Memory_readOnly, at);
+    assert(rc == RC_OK);
+#endif
+
+    DEBUG(file) DBGPRINT(DBGTARGET, "HTTP: Send mapped file at %llu len %d\n",
+                         (unsigned long long)at, len);
+    if (isUsingChunked) {
+      sprintf(cl, "%x\r\n", len);
+      ok = writeString(rs, cl)
+           && writeSSL(rs, (void *)window, len)
+           && writeString(rs, "\r\n");
+    } else {
+      ok = writeSSL(rs, (void *)window, len);
+    }
+#ifdef SELF_TEST
+    munmap((void *)window, len);
+#endif
+    if (! ok) {
+      unmapFile();
+      return 0;
+    }
+  }
+  unmapFile();
+  if (isUsingChunked)
+    return writeString(rs, "0\r\n");	// the last chunk
+  return 1;
+}
+
 /**
  * writeFile - Write the open file.
  *
@@ -187,14 +326,21 @@ handleFile(ReaderState * rs,
       writeString(rs, "\r\n");	// end of headers
       if (Method_GET == methodIndex) { /* GET, not HEAD - send message-body */
         /*  Actually send the file */
+        int sent = sendMapped(rs, isUsingChunked);
+        if (sent < 0) {		// can't map it, so read it
+          if (isUsingChunked)
+            sent = sendChunked(rs, &readFile);
+          else
+            sent = sendUnchunked(rs, &readFile);
+        }
         if (isUsingChunked) {
-          // Send chunked data, no trailers, and terminating CRLF
-          if (! sendChunked(rs, &readFile)
+          // No trailers, and terminating CRLF
+          if (! sent
               || ! writeString(rs, "\r\n") ) {        // write error
             return 0; /* Kill the connection */
           }
         } else {
-          if (! sendUnchunked(rs, &readFile)) {        	// write error
+          if (! sent) {        	// write error
             return 0; /* Kill the connection */
           }
         }
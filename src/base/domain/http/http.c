@@ -45,6 +45,7 @@ typedef int bool;
 #include <idl/capros/RTC.h>
 #include <idl/capros/IndexedKeyStore.h>
 #include <idl/capros/FileServer.h>
+#include <idl/capros/NetListener.h>
 #include <domain/CMME.h>
 #include <domain/CMMEMaps.h>
 
@@ -62,6 +63,7 @@ typedef int bool;
 #include <sys/stat.h>
 #include <sys/uio.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -133,8 +135,21 @@ char *defaultPageData =
 "</html>\n"
 ;
 
+/* A connection is kept open for further requests until the client asks
+   us to close it, it is idle for KeepAliveTimeout seconds,
+   or it has made MaxRequestsPerConnection requests. */
+#define KeepAliveTimeout 15
+#define MaxRequestsPerConnection 100
+/* A pooled handler serves this many connections, then goes away. */
+#define MaxConnectionsPerHandler 1000
+static int requestsServed = 0;
+/* closeAfterResponse is nonzero if the connection will be closed after
+   the current response. writeStatusLine tells the client so. */
+static int closeAfterResponse = 1;
+
 /* Internal routine prototypes */
 static uint32_t connection(void);
+static SSL_CTX * getContext(void);
 static int setUpContext(SSL_CTX *ctx);
 static void print_SSL_error_queue(void);
 static void push_ssl_data(BIO *network_bio);
@@ -167,6 +182,112 @@ static void scanToken(ReadPtrs *rp, char *sepStr);
 
 TREENODE * rqHdrTree = TREE_NIL; // A rbtree with the request headers and values
 
+/* The headers that we or common clients use are also found through
+   knownHeaders, indexed by a perfect hash of the name,
+   so looking them up doesn't need the tree. */
+enum {
+  KH_Host, KH_UserAgent, KH_Accept, KH_AcceptLanguage, KH_AcceptEncoding,
+  KH_AcceptCharset, KH_KeepAlive, KH_Connection, KH_CacheControl, KH_Expect,
+  KH_ContentEncoding, KH_ContentLength, KH_ContentType, KH_TransferEncoding,
+  KH_Referer, KH_Cookie,
+  numKnownHeaders
+};
+static const char * const knownHeaderNames[numKnownHeaders] = {
+  [KH_Host] = "Host",
+  [KH_UserAgent] = "User-Agent",
+  [KH_Accept] = "Accept",
+  [KH_AcceptLanguage] = "Accept-Language",
+  [KH_AcceptEncoding] = "Accept-Encoding",
+  [KH_AcceptCharset] = "Accept-Charset",
+  [KH_KeepAlive] = "Keep-Alive",
+  [KH_Connection] = "Connection",
+  [KH_CacheControl] = "Cache-Control",
+  [KH_Expect] = "Expect",
+  [KH_ContentEncoding] = "Content-Encoding",
+  [KH_ContentLength] = "Content-Length",
+  [KH_ContentType] = "Content-Type",
+  [KH_TransferEncoding] = "Transfer-Encoding",
+  [KH_Referer] = "Referer",
+  [KH_Cookie] = "Cookie"
+};
+/* The node of each known header in the request, or TREE_NIL. */
+static TREENODE * knownHeaders[numKnownHeaders];
+
+/* The hash below has no collisions for knownHeaderNames.
+   initKnownHeaders checks that; if you add a name and it fails,
+   adjust the hash. */
+#define knownHeaderHashSize 32
+static signed char knownHeaderHash[knownHeaderHashSize];
+static unsigned char knownHeaderLength[numKnownHeaders];
+static bool knownHeaderHashBuilt = false;
+
+static inline unsigned int
+foldCase(unsigned char c)
+{
+  return c + (((unsigned int)(c - 'A') < 26) << 5);
+}
+
+/* Scanning the input a word at a time.
+   These test all the bytes of a word at once; they may report
+   false positives in bytes above a true one, so a hit must be
+   confirmed a byte at a time. */
+typedef unsigned long word_t;
+#define ONES ((word_t)-1 / 0xff)	// 0x01 in each byte
+#define HIGHS (ONES * 0x80)
+#define HasZeroByte(v) (((v) - ONES) & ~(v) & HIGHS)
+// n must be <= 0x80:
+#define HasLessThan(v, n) (((v) - ONES * (n)) & ~(v) & HIGHS)
+// n must be < 0x80:
+#define HasMoreThan(v, n) ((((v) + ONES * (0x7f - (n))) | (v)) & HIGHS)
+
+static inline word_t
+loadWord(const char * p)
+{
+  word_t v;
+  memcpy(&v, p, sizeof(v));	// p may be unaligned
+  return v;
+}
+
+static unsigned int
+hashHeaderName(const char * name, int len)
+{
+  return (len + foldCase(name[0]) + 3 * foldCase(name[len-1])
+          + foldCase(name[len/2])) % knownHeaderHashSize;
+}
+
+/* Prepare knownHeaders for a new request. */
+static void
+initKnownHeaders(void)
+{
+  int i;
+
+  if (! knownHeaderHashBuilt) {
+    memset(knownHeaderHash, -1, sizeof(knownHeaderHash));
+    for (i = 0; i < numKnownHeaders; i++) {
+      int len = strlen(knownHeaderNames[i]);
+      unsigned int h = hashHeaderName(knownHeaderNames[i], len);
+      assert(knownHeaderHash[h] < 0);	// no collisions
+      knownHeaderHash[h] = i;
+      knownHeaderLength[i] = len;
+    }
+    knownHeaderHashBuilt = true;
+  }
+  for (i = 0; i < numKnownHeaders; i++)
+    knownHeaders[i] = TREE_NIL;
+}
+
+/* Returns the KH_ index of the header name, or -1 if it isn't known. */
+static int
+knownHeaderIndex(const char * name, int len)
+{
+  if (len <= 0) return -1;
+  int i = knownHeaderHash[hashHeaderName(name, len)];
+  if (i >= 0 && knownHeaderLength[i] == len
+      && ! memcmpci(name, knownHeaderNames[i], len))
+    return i;
+  return -1;
+}
+
 int tree_compare(TREENODE *a, TREENODE *b) {
   return tree_compare_key(a, b->key);
 }
@@ -202,37 +323,10 @@ free_tree(TREENODE *tree) {
 
 
 #ifndef SELF_TEST
-int
-cmme_main(void)
+/* Close the connection in KR_SOCKET without losing data we sent. */
+static void
+closeConnection(void)
 {
-  result_t rc;
-  Message msg;
-
-  capros_Node_getSlot(KR_CONSTIT, capros_HTTP_KC_OStream, KR_OSTREAM); // for debug
-
-  DEBUG(init) DBGPRINT(DBGTARGET, "HTTP: Starting.\n");
-
-  rc = maps_init();
-  assert(rc == RC_OK);	// TODO handle
-  mapReservation = maps_reserve_locked(1);
-
-  capros_Node_getSlot(KR_CONSTIT, capros_HTTP_KC_RTC, KR_RTC); 
-
-  msg.snd_invKey = KR_RETURN;
-  msg.snd_key0 = KR_VOID;
-  msg.snd_key1 = KR_VOID;
-  msg.snd_key2 = KR_VOID;
-  msg.snd_rsmkey = KR_VOID;
-  msg.snd_len = 0;
-  msg.snd_code = RC_OK;
-  msg.snd_w1 = 0;
-  msg.snd_w2 = 0;
-  msg.snd_w3 = 0;
-
-  SEND(&msg);
-
-  connection();
-
   DEBUG(init) DBGPRINT(DBGTARGET, "HTTP: Closing socket. Last sock err = %#x\n",
                        sockRcvLastError);
 
@@ -265,13 +359,77 @@ cmme_main(void)
     }
     break;
   }
+}
+
+int
+cmme_main(void)
+{
+  result_t rc;
+  Message msg;
+
+  capros_Node_getSlot(KR_CONSTIT, capros_HTTP_KC_OStream, KR_OSTREAM); // for debug
+
+  DEBUG(init) DBGPRINT(DBGTARGET, "HTTP: Starting.\n");
+
+  rc = maps_init();
+  assert(rc == RC_OK);	// TODO handle
+  mapReservation = maps_reserve_locked(1);
+
+  capros_Node_getSlot(KR_CONSTIT, capros_HTTP_KC_RTC, KR_RTC); 
+
+  msg.snd_invKey = KR_RETURN;
+  msg.snd_key0 = KR_VOID;
+  msg.snd_key1 = KR_VOID;
+  msg.snd_key2 = KR_VOID;
+  msg.snd_rsmkey = KR_VOID;
+  msg.snd_len = 0;
+  msg.snd_code = RC_OK;
+  msg.snd_w1 = 0;
+  msg.snd_w2 = 0;
+  msg.snd_w3 = 0;
+
+  uint32_t keyType;
+  if (capros_key_getType(KR_ARG(0), &keyType) == RC_capros_key_Void) {
+    /* We were built for a NetListener's pool.
+       See NetListener.idl for the protocol. */
+    int connectionsServed = 0;
+
+    msg.rcv_key0 = KR_ARG(0);
+    msg.rcv_key1 = KR_POOL;
+    msg.rcv_key2 = KR_VOID;
+    msg.rcv_rsmkey = KR_VOID;
+    msg.rcv_limit = 0;
+    while (1) {
+      capros_Process_makeStartKey(KR_SELF, 0, KR_TEMP0);
+      msg.snd_key0 = KR_TEMP0;
+      RETURN(&msg);	// wait for a connection
+      if (msg.rcv_code != capros_NetListener_serveOrderCode)
+        break;		// dismissed, or the NetListener is gone
+
+      sockRcvLastError = RC_OK;
+      connection();
+      closeConnection();
+
+      // Don't let any leaks accumulate forever.
+      if (++connectionsServed >= MaxConnectionsPerHandler)
+        break;
+      msg.snd_invKey = KR_POOL;	// rejoin the pool
+    }
+  } else {
+    SEND(&msg);
+
+    connection();
+    closeConnection();
+  }
 
   maps_fini();
   return 0;
 #else
+/* Serve the number of connections given as the argument, default 1. */
 int
-main(void)
+main(int argc, char **argv)
 {
+    int connections = argc > 1 ? atoi(argv[1]) : 1;
     int fd = open("privkey.pem", O_RDONLY, 0);
     struct stat sb; 
     struct sockaddr_in inad;
@@ -308,17 +466,19 @@ main(void)
       printf("Error on listen, rc=%d, errno=%d %s\n", rc, errno, strerror(errno));
       return 1;
     }
-    memset((char *)&inad,0,sizeof(inad));
-    adrlen = sizeof(inad);
-    sock = accept(listen_socket, (struct sockaddr *)&inad, &adrlen);
-    if (sock < 0) {
-      printf("Error on accept, rc=%d, errno=%d %s\n", sock, errno, strerror(errno));
-      return 1;
-    }
-    printf("Connection accepted\n");
+    while (connections-- > 0) {
+      memset((char *)&inad,0,sizeof(inad));
+      adrlen = sizeof(inad);
+      sock = accept(listen_socket, (struct sockaddr *)&inad, &adrlen);
+      if (sock < 0) {
+        printf("Error on accept, rc=%d, errno=%d %s\n", sock, errno, strerror(errno));
+        return 1;
+      }
+      DEBUG(init) printf("Connection accepted\n");
 
-    connection();
-  close(sock);
+      connection();
+      close(sock);
+    }
   return 0;
 #endif
 }
@@ -337,23 +497,19 @@ connection(void)
   /* Copy the TCPSocket key */
 #ifndef SELF_TEST
   capros_Process_getKeyReg(KR_SELF, KR_ARG(0), KR_SOCKET);
+  /* Don't let an idle persistent connection hold this process forever. */
+  (void)capros_TCPSocket_setReceiveTimeout(KR_SOCKET, KeepAliveTimeout);
+#else
+  {
+    struct timeval tv = {KeepAliveTimeout, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
 #endif
 
   DEBUG(init) DBGPRINT(DBGTARGET, "HTTP: received connection\n");
 
-  /* Initialize the SSL library */
-  SSL_load_error_strings();       /* readable error messages */
-  SSL_library_init();             /* initialize library */
-  
-  sslContext = SSL_CTX_new(SSLv23_server_method());
+  sslContext = getContext();
   if (sslContext == NULL) {
-    DBGPRINT(DBGTARGET, "HTTP: Failed to SSL_CTX_new()\n");
-    print_SSL_error_queue();
-    return 0;
-  }
-
-  /* Initialize the context with the server private key and certificate */
-  if (!setUpContext(sslContext)) {
     return 0;
   }
   ssl = SSL_new(sslContext);
@@ -409,12 +565,22 @@ connection(void)
   }
 
   readInit(ssl, network_bio, &rs);
+  requestsServed = 0;
 
   while (process_http(ssl, network_bio, &rs)) { /* Process html until error */
-    push_ssl_data(network_bio);
+    /* If the client has pipelined another request, answer it before
+       pushing, so the responses go out together. */
+    if (rs.current == rs.last && !SSL_pending(ssl))
+      push_ssl_data(network_bio);
   }
+  /* Send close_notify. Besides being polite, this keeps the session
+     in the cache; SSL_free discards sessions that were not shut down. */
+  (void)SSL_shutdown(ssl);
   push_ssl_data(network_bio);   /* Push out last messages */
 
+  DEBUG(sslinit) DBGPRINT(DBGTARGET, "HTTP: session %s\n",
+                          SSL_session_reused(ssl) ? "resumed" : "new");
+
   /* Termination logic */
   SSL_free(ssl);		/* implicitly frees internal_bio */
   BIO_free(network_bio);        /* We have to free the network_bio */
@@ -424,6 +590,148 @@ connection(void)
 }
 
 
+/* The SSL context, with the parsed key and certificate and the
+   session cache, is built once and used for every connection this
+   process serves. */
+static SSL_CTX * theContext = NULL;
+
+/* Sessions are cached for resumption. */
+#define SessionCacheSize 128
+#define SessionTimeout (60*60)	// seconds
+static const unsigned char sessionIdContext[] = "CapROS HTTP";
+
+/**
+ * getContext - Return the SSL context, building it on first use.
+ *
+ * @return is the context, or NULL if it could not be built.
+ */
+static SSL_CTX *
+getContext(void)
+{
+  SSL_CTX *ctx;
+
+  if (theContext) return theContext;
+
+  /* Initialize the SSL library */
+  SSL_load_error_strings();       /* readable error messages */
+  SSL_library_init();             /* initialize library */
+  
+  ctx = SSL_CTX_new(SSLv23_server_method());
+  if (ctx == NULL) {
+    DBGPRINT(DBGTARGET, "HTTP: Failed to SSL_CTX_new()\n");
+    print_SSL_error_queue();
+    return NULL;
+  }
+
+  /* Initialize the context with the server private key and certificate */
+  if (!setUpContext(ctx)) {
+    SSL_CTX_free(ctx);
+    return NULL;
+  }
+  theContext = ctx;
+  return ctx;
+}
+
+#ifndef SELF_TEST
+/* Each handler process has its own SSL context and session cache,
+   and the NetListener may give a client's next connection to any
+   handler in its pool.  So that the client can resume its session
+   wherever it lands, sessions are also kept in a file shared by all the
+   handlers built from this constructor: the KC_SessionCache constituent,
+   if it is not void.  The file is a table of sharedSession entries
+   indexed by a hash of the session id.  nfile serves one request at a
+   time, so an entry is always read or written whole.  OpenSSL itself
+   rejects a session from the file that has expired. */
+#define SharedSessionSlots 256
+struct sharedSession {
+  uint32_t idLen;		/* 0 if the entry is empty */
+  unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  uint32_t derLen;		/* length of der */
+  unsigned char der[1024 - 8 - SSL_MAX_SSL_SESSION_ID_LENGTH];
+};
+
+static capros_File_fileLocation
+sharedSessionLoc(const unsigned char * id, unsigned int idLen)
+{
+  uint32_t h = 0;
+
+  while (idLen--)
+    h = h * 31 + *id++;
+  return (capros_File_fileLocation)(h % SharedSessionSlots)
+         * sizeof(struct sharedSession);
+}
+
+/* Called by OpenSSL when it has added a new session to our cache.
+   Returns 0 because we keep no reference to sess. */
+static int
+newSharedSession(SSL * ssl, SSL_SESSION * sess)
+{
+  struct sharedSession e;
+  unsigned char * p = e.der;
+  uint32_t len;
+  int derLen = i2d_SSL_SESSION(sess, NULL);
+
+  if (derLen <= 0 || (unsigned int)derLen > sizeof(e.der))
+    return 0;		// too big to share; it is only in our cache
+  e.idLen = sess->session_id_length;
+  memcpy(e.id, sess->session_id, e.idLen);
+  e.derLen = i2d_SSL_SESSION(sess, &p);
+  (void)capros_File_write(KR_SESSIONS, sharedSessionLoc(e.id, e.idLen),
+                          offsetof(struct sharedSession, der) + e.derLen,
+                          (unsigned char *)&e, &len);
+  OPENSSL_cleanse(&e, sizeof(e));
+  return 0;
+}
+
+/* Called by OpenSSL when a client asks to resume a session
+   that is not in our cache. */
+static SSL_SESSION *
+getSharedSession(SSL * ssl, unsigned char * id, int idLen, int * copy)
+{
+  struct sharedSession e;
+  const unsigned char * p = e.der;
+  uint32_t len;
+  SSL_SESSION * sess = NULL;
+  result_t rc;
+
+  *copy = 0;		// we keep no reference to what we return
+  rc = capros_File_read(KR_SESSIONS, sharedSessionLoc(id, idLen),
+                        sizeof(e), (unsigned char *)&e, &len);
+  if (rc == RC_OK && len >= offsetof(struct sharedSession, der)
+      && e.idLen == idLen && memcmp(e.id, id, idLen) == 0
+      && e.derLen <= len - offsetof(struct sharedSession, der)) {
+    sess = d2i_SSL_SESSION(NULL, &p, e.derLen);
+    DEBUG(sslinit) DBGPRINT(DBGTARGET, "HTTP: session from shared cache\n");
+  }
+  OPENSSL_cleanse(&e, sizeof(e));
+  return sess;
+}
+
+/* Called by OpenSSL when it removes a session from our cache,
+   including when it has expired or failed.  Remove it from the
+   shared cache too, if it is still there. */
+static void
+removeSharedSession(SSL_CTX * ctx, SSL_SESSION * sess)
+{
+  struct sharedSession e;
+  capros_File_fileLocation at
+    = sharedSessionLoc(sess->session_id, sess->session_id_length);
+  uint32_t len;
+  result_t rc;
+
+  rc = capros_File_read(KR_SESSIONS, at,
+                        offsetof(struct sharedSession, derLen),
+                        (unsigned char *)&e, &len);
+  if (rc == RC_OK && len == offsetof(struct sharedSession, derLen)
+      && e.idLen == sess->session_id_length
+      && memcmp(e.id, sess->session_id, e.idLen) == 0) {
+    e.idLen = 0;
+    (void)capros_File_write(KR_SESSIONS, at, sizeof(e.idLen),
+                            (unsigned char *)&e, &len);
+  }
+}
+#endif
+
 /**
  * setUpContext - Put the server private key and certificate into the context
  *                and perform other setup operations.
@@ -487,6 +795,32 @@ setUpContext(SSL_CTX *ctx) {
     print_SSL_error_queue();
     return 0;
   }
+
+  /* Let returning clients resume their session
+     instead of doing a full RSA handshake. */
+  SSL_CTX_set_session_id_context(ctx, sessionIdContext,
+                                 sizeof(sessionIdContext) - 1);
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(ctx, SessionCacheSize);
+  SSL_CTX_set_timeout(ctx, SessionTimeout);
+#ifndef SELF_TEST
+  {
+    uint32_t keyType;
+
+    capros_Node_getSlotExtended(KR_CONSTIT, capros_HTTP_KC_SessionCache,
+                                KR_SESSIONS);
+    if (capros_key_getType(KR_SESSIONS, &keyType) != RC_capros_key_Void) {
+      SSL_CTX_sess_set_new_cb(ctx, newSharedSession);
+      SSL_CTX_sess_set_get_cb(ctx, getSharedSession);
+      SSL_CTX_sess_set_remove_cb(ctx, removeSharedSession);
+    }
+  }
+#endif
+#ifdef SSL_OP_NO_TICKET
+  /* Resume from the caches only.  OpenSSL's own ticket keys would
+     live, unrotated, as long as the process. */
+  SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+#endif
   return 1;
 }
 
@@ -621,13 +955,18 @@ freeStorage(void) {
   rqHdrTree = TREE_NIL;
 }
 
+/* The body data to send are read into this buffer.
+   It holds one full TLS record, so each read is sent as a single record.
+   It is too big for our small stack. */
+static char sendBuf[SSL3_RT_MAX_PLAIN_LENGTH];
+
 int
 sendUnchunked(ReaderState * rs, int (*readProc)(void *, int))
 {
-  char buf[2048];
+  char * buf = sendBuf;
   int len;
 
-  while ((len = (*readProc)(buf, sizeof(buf))) > 0) {
+  while ((len = (*readProc)(buf, sizeof(sendBuf))) > 0) {
     if (!writeSSL(rs, buf, len))
       return false;
   }
@@ -637,12 +976,12 @@ sendUnchunked(ReaderState * rs, int (*readProc)(void *, int))
 bool	// returns true iff successful, false if write error
 sendChunked(ReaderState * rs, int (*readProc)(void *, int))
 {
-  char buf[2048];
+  char * buf = sendBuf;
   int len;
   char cl[19];
 
   while (1) {
-    len = (*readProc)(buf, sizeof(buf));
+    len = (*readProc)(buf, sizeof(sendBuf));
     if (len < 0)
       return false;
     sprintf(cl, "%x\r\n", len);
@@ -743,8 +1082,13 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
   unsigned long long contentLength = 0;
   int expect100 = 0;
   
-  /* TODO skip leading blank lines */
-  if (!readToken(rs, &rp, " \n")) return 0;
+  /* Until we have parsed the Connection header, any error closes
+     the connection. */
+  closeAfterResponse = 1;
+
+  /* Skip leading blank lines, such as a CRLF after a previous
+     request's body. */
+  if (!readToken(rs, &rp, " \r\n")) return 0;
   if (*rp.last != ' ' && *rp.last != '\t') {
     DEBUG(errors) DBGPRINT(DBGTARGET, "HTTP: bad request format\n");
     writeStatusLine(rs, 400);  /* Return Bad Request */
@@ -904,9 +1248,13 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
   readSkipDelim(rs, &rp);
 
   tree_init();   /* Initialize the dummy RB tree node */
+  initKnownHeaders();
 
   /* Process the message headers */
   while (1) {
+    int kh = -1;	// index of the header in knownHeaders, if known
+
+    existing = TREE_NIL;
     if (!readToken(rs, &rp, ":\n")) {
       freeStorage();
       return 0;
@@ -973,7 +1321,11 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
     memcpy(value, rp.first, valuelen);
     value[valuelen] = 0;
 
-    if (TREE_NIL == existing) existing = tree_find(rqHdrTree, headerName);
+    if (TREE_NIL == existing) {
+      kh = knownHeaderIndex(headerName, namelen);
+      existing = kh >= 0 ? knownHeaders[kh]
+                         : tree_find(rqHdrTree, headerName);
+    }
     if (TREE_NIL == existing ) {
       /* Insert the result into the RB tree */
       node = malloc(sizeof(TREENODE));
@@ -986,6 +1338,8 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
       headerName = NULL;       /* Don't free active entry */
       node->value = value;
       rqHdrTree = tree_insert(rqHdrTree, node);
+      if (kh >= 0)
+        knownHeaders[kh] = node;
     } else {
       /* Append the data to the existing entry */
       char *newValue = malloc(strlen(existing->value)+strlen(value)+1);
@@ -995,6 +1349,7 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
       existing->value = newValue;
       free(value);
       free(headerName);
+      headerName = NULL;
     }
      /* clean out to next CRLF */
     if (!readToken(rs, &rp, "\n")) { 
@@ -1016,7 +1371,7 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
   // We must handle Connection: close, and close the connection after 
   // our response.
   {
-    TREENODE *node = tree_find(rqHdrTree, "Connection");
+    TREENODE *node = knownHeaders[KH_Connection];
     ReadPtrs p;
     
     if (TREE_NIL != node) {
@@ -1034,6 +1389,8 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
       }
     }
   }
+  closeAfterResponse = mustClose
+                       || ++requestsServed >= MaxRequestsPerConnection;
 
   /* "Date" */
   // Only valid for POST and PUT, and then optional. It is for cache 
@@ -1095,7 +1452,7 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
   /* "Expect" */
   // We need to send a interum response of 100 if we get 100-continue
   {
-    TREENODE *node = tree_find(rqHdrTree, "Expect");
+    TREENODE *node = knownHeaders[KH_Expect];
     ReadPtrs p;
     
     if (TREE_NIL != node) {
@@ -1109,6 +1466,7 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
 	if (i == 0) {
 	  expect100 = 1;
 	} else {
+	  closeAfterResponse = 1;
 	  writeStatusLine(rs, 417);
 	  writeSSL(rs, "\r\n", 2);
 	  freeStorage();
@@ -1190,11 +1548,12 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
   // We need this header for upload length
   {  
     int len;
-    TREENODE *node = tree_find(rqHdrTree, "Content-length");
+    TREENODE *node = knownHeaders[KH_ContentLength];
     
     if (TREE_NIL != node) {
       len = strlen(node->value);
       if (len > 15 || len == 0) {
+	closeAfterResponse = 1;
 	writeStatusLine(rs, 413);   /* Say the entity is too large */
 	writeMessage(rs, "File too long for upload", methodIndex==1);
 	freeStorage();
@@ -1237,10 +1596,13 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
   
   /* "Keep-Alive" */
   // This header is triggered by "Connection: keep-alive" from Firefox.
+  // HTTP/1.1 connections are persistent anyway, so we ignore its
+  // parameters and use our own limits.
 
 
   /* Check that length of path and query is in range */
   if (capros_HTTPResource_maxLengthOfPathAndQuery < strlen(pathandquery)) {
+    closeAfterResponse = 1;
     writeStatusLine(rs, 400);
     writeMessage(rs, "Path + Query too long.", methodIndex==1);
     freeStorage();
@@ -1258,6 +1620,7 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
     if (!lookUpSwissNumber(swissNumber, methodIndex, 
 			   pathLength, pathandquery)) {
       /* Swiss number not found or other error */
+      closeAfterResponse = 1;
       writeStatusLine(rs, 404);
       writeMessage(rs, "File not found on server.", methodIndex==1);
       freeStorage();
@@ -1285,6 +1648,8 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
       break;
 
     case  capros_HTTPResource_RHType_MethodNotAllowed:
+      if (contentLength)	// we won't read the entity, so can't continue
+        closeAfterResponse = 1;
       writeStatusLine(rs, 405); 
       writeMessage(rs, "Method Not Allowed", methodIndex==1);
       freeStorage();
@@ -1324,6 +1689,7 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
       break;
     default:
       DEBUG(errors) DBGPRINT(DBGTARGET, "HTTP: bad request (no query)\n");
+      closeAfterResponse = 1;
       writeStatusLine(rs, 400);  /* Return Bad Request */
       writeMessage(rs, "URI query field missing.", methodIndex==1);
       return 0;                /* Must get back in sync with client */ 
@@ -1332,7 +1698,7 @@ process_http(SSL *ssl, BIO *network_bio, ReaderState *rs) {
 
   /* Push any queued data to the network */
   freeStorage();
-  if (mustClose) return 0;
+  if (closeAfterResponse) return 0;
   return 1;
   
   /* Required support for http 1/1
@@ -1398,6 +1764,14 @@ readToken(ReaderState *rs, ReadPtrs *rp, char *sepStr) {
 
   /* Check the token for invalid characters (assume separators are valid)*/
   for (cp=rp->first; cp<rp->last; cp++) {
+    /* Skip a word at a time while every byte is printable. */
+    while (cp + sizeof(word_t) <= rp->last) {
+      word_t v = loadWord(cp);
+      if (HasLessThan(v, 0x20) | HasMoreThan(v, 0x7e))
+        break;
+      cp += sizeof(word_t);
+    }
+    if (cp >= rp->last) break;
     unsigned char c = *cp;
     if (!(c <= 0x7e && c>= 0x20) && (c!=0x0a && c!=0x0d)) { 
       writeStatusLine(rs, 200);
@@ -1478,13 +1852,19 @@ compareToken(ReadPtrs *rp, const char *list[], int ci) {
  */
 int
 memcmpci(const char *a, const char *b, int len) {
-  int i;
-  static const char tt[] = "abcdefghijklmnopqrstuvwxyz";
-  for (i=0; i<len; i++) {
+  int i = 0;
+
+  /* Bytes that are identical compare equal regardless of case,
+     so skip over equal words. */
+  while (i + (int)sizeof(word_t) <= len
+         && loadWord(a+i) == loadWord(b+i))
+    i += sizeof(word_t);
+  for (; i<len; i++) {
     char aa = a[i];
     char bb = b[i];
-    if (aa>='A' && aa<='Z') aa = tt[aa-'A'];
-    if (bb>='A' && bb<='Z') bb = tt[bb-'A'];
+    if (aa == bb) continue;
+    aa = foldCase(aa);
+    bb = foldCase(bb);
     if (aa<bb) return -1;
     if (aa>bb) return 1;
   }
@@ -1511,11 +1891,39 @@ memcmpci(const char *a, const char *b, int len) {
  */ 
 static char *
 findSeparator(ReadPtrs *rp, char *sepStr) {
-  char *c;
+  unsigned char isSep[256/8] = {1};	// NUL ends sepStr, so it matches too
+  word_t sepWords[3];
+  int nSeps = 0;
+  const unsigned char *s;
+  char *c = rp->first;
+
+  for (s = (const unsigned char *)sepStr; *s; s++) {
+    isSep[*s >> 3] |= 1 << (*s & 7);
+    if (nSeps < 3) sepWords[nSeps] = ONES * *s;
+    nSeps++;
+  }
+#define IsSep(ch) (isSep[(unsigned char)(ch) >> 3] & (1 << ((ch) & 7)))
 
-  for (c=rp->first; c<rp->last; c++) {
-    if (strchr(sepStr, *c)) return c;
+  if (nSeps <= 3) {
+    /* Few separators (the usual case): test a word at a time. */
+    while (c < rp->last && ((unsigned long)c & (sizeof(word_t)-1))) {
+      if (IsSep(*c)) return c;
+      c++;
+    }
+    while (c + sizeof(word_t) <= rp->last) {
+      word_t v = loadWord(c);
+      word_t hit = HasZeroByte(v);
+      int i;
+      for (i = 0; i < nSeps; i++)
+        hit |= HasZeroByte(v ^ sepWords[i]);
+      if (hit) break;	// the separator is in this word
+      c += sizeof(word_t);
+    }
   }
+  for (; c<rp->last; c++) {
+    if (IsSep(*c)) return c;
+  }
+#undef IsSep
   return NULL;
 }
 
@@ -1774,6 +2182,10 @@ writeStatusLine(ReaderState *rs, int statusCode) {
   }
   sprintf(str, "HTTP/1.1 %d %s\r\n", statusCode, reason);
   if (!writeSSL(rs, str, strlen(str))) return 0;
+  // An interim response doesn't end the exchange.
+  if (closeAfterResponse && statusCode >= 200) {
+    if (!writeString(rs, "Connection: close\r\n")) return 0;
+  }
   return 1;
 }
 
@@ -49,6 +49,9 @@ Approved for public release, distribution unlimited. */
 #define KR_DIRECTORY  KR_CMME(2) /* The IndexedKeyStore aka file directory */
 #define KR_FILESERVER KR_CMME(3) /* The file creator object */
 #define KR_FILE       KR_CMME(4) /* The "file" key */
+#define KR_POOL       KR_CMME(5) /* The NetListener pool key, if pooled */
+#define KR_FILEMAP    KR_CMME(6) /* The map of the file in KR_FILE */
+#define KR_SESSIONS   KR_CMME(7) /* The shared session cache file, or void */
 
 #endif // SELF_TEST
 
@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2009, 2011, Strawberry Development Group.
+ *
+ * This file is part of the CapROS Operating System.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/* This material is based upon work supported by the US Defense Advanced
+Research Projects Agency under Contract No. W31P4Q-07-C-0070.
+Approved for public release, distribution unlimited. */
+
+/* httpbench - Measure the performance of the http domain on a Unix host.
+
+   This is built only in SELF_TEST mode, by ./benchbuild; see README.
+
+   httpbench micro [iterations]
+     times the request parsing routines of http.c.
+
+   httpbench load host port clients requests [path]
+     runs clients processes, each making requests HTTPS requests
+     over persistent connections to the server at host:port,
+     and reports requests per second and latency percentiles.
+     path defaults to "/".
+ */
+
+#ifndef SELF_TEST
+#error httpbench is built only in SELF_TEST mode.
+#endif
+
+/* Include the server itself, so we can call its static routines. */
+#define main selfTestMain
+#include "http.c"
+#undef main
+
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+static double
+nowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*************************** Microbenchmarks ******************************/
+
+static const char sampleRequest[] =
+  "GET /index.html?x=1&s=abcdefghijklmnop HTTP/1.1\r\n"
+  "Host: localhost:5001\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0) Firefox/10.0\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+  "Accept-Language: en-us,en;q=0.5\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Accept-Charset: ISO-8859-1,utf-8;q=0.7,*;q=0.7\r\n"
+  "Connection: keep-alive\r\n"
+  "Cache-Control: max-age=0\r\n"
+  "\r\n";
+
+static const char * sampleHeaders[] = {
+  "Host", "User-Agent", "Accept", "Accept-Language", "Accept-Encoding",
+  "Accept-Charset", "Connection", "Cache-Control", NULL };
+
+static void
+report(const char * name, double startNs, long iterations)
+{
+  printf("%-24s %10.1f ns/op\n", name, (nowNs() - startNs) / iterations);
+}
+
+/* Keep the compiler from optimizing away results. */
+volatile long sink;
+
+static void
+benchReadToken(long iterations)
+{
+  ReaderState rs;
+  ReadPtrs rp;
+  int len = strlen(sampleRequest);
+  long i;
+  double start = nowNs();
+
+  for (i = 0; i < iterations; i++) {
+    /* The whole request is in the buffer, so readToken never reads. */
+    readInit(NULL, NULL, &rs);
+    memcpy(rs.buf, sampleRequest, len);
+    rs.last = len;
+    rp.first = rp.last = rs.buf;
+    while (1) {
+      if (!readToken(&rs, &rp, "\n")) {
+        printf("readToken failed\n");
+        exit(1);
+      }
+      if (rp.last - rp.first == 1)	// the CR of the blank line
+        break;
+      readSkipDelim(&rs, &rp);
+    }
+    sink += rs.current;
+  }
+  report("readToken (request)", start, iterations);
+}
+
+static void
+benchFindSeparator(long iterations)
+{
+  const char * line = strstr(sampleRequest, "Accept:");
+  char * eol = strchr(line, '\n');
+  ReadPtrs rp = {(char *)line + 7, eol + 1};	// value through LF
+  long i;
+  double start = nowNs();
+
+  for (i = 0; i < iterations; i++) {
+    sink += findSeparator(&rp, "\r\n") - rp.first;
+  }
+  report("findSeparator (line)", start, iterations);
+}
+
+static void
+benchCompareToken(long iterations)
+{
+  static char methods[] = "GET HEAD POST DELETE CONNECT";
+  ReadPtrs tokens[5];
+  char * p = methods;
+  int t;
+  long i;
+
+  for (t = 0; t < 5; t++) {
+    tokens[t].first = p;
+    while (*p && *p != ' ') p++;
+    tokens[t].last = p;
+    p++;
+  }
+  double start = nowNs();
+  for (i = 0; i < iterations; i++) {
+    sink += compareToken(&tokens[i % 5], methodList, 0);
+  }
+  report("compareToken (method)", start, iterations);
+}
+
+static void
+benchMemcmpci(long iterations)
+{
+  long i;
+  double start = nowNs();
+
+  for (i = 0; i < iterations; i++) {
+    sink += memcmpci("Content-Length", "content-length", 14);
+  }
+  report("memcmpci (14 bytes)", start, iterations);
+}
+
+static void
+benchHeaderTree(long iterations)
+{
+  const char ** h;
+  long i;
+
+  tree_init();
+  for (h = sampleHeaders; *h; h++) {
+    TREENODE * node = malloc(sizeof(TREENODE));
+    node->left = node->right = node->parent = TREE_NIL;
+    node->color = TREE_BLACK;
+    node->key = strdup(*h);
+    node->value = strdup("value");
+    rqHdrTree = tree_insert(rqHdrTree, node);
+  }
+  /* These are the lookups process_http does for each request. */
+  static char * lookups[] = {"Connection", "Expect", "Content-length"};
+  double start = nowNs();
+  for (i = 0; i < iterations; i++) {
+    sink += (long)tree_find(rqHdrTree, lookups[i % 3]);
+  }
+  report("tree_find (header)", start, iterations);
+  rqHdrTree = free_tree(rqHdrTree);
+}
+
+static int
+micro(long iterations)
+{
+  benchReadToken(iterations / 10);
+  benchFindSeparator(iterations);
+  benchCompareToken(iterations);
+  benchMemcmpci(iterations);
+  benchHeaderTree(iterations);
+  return 0;
+}
+
+/*************************** Load driver ******************************/
+
+/* One client connection, with a buffered reader over SSL. */
+typedef struct {
+  int fd;
+  SSL * ssl;
+  int open;
+  int pos, have;
+  char buf[16384];
+} Client;
+
+static int
+clientFill(Client * c)
+{
+  if (c->pos < c->have) return 1;
+  int rc = SSL_read(c->ssl, c->buf, sizeof(c->buf));
+  if (rc <= 0) return 0;
+  c->pos = 0;
+  c->have = rc;
+  return 1;
+}
+
+/* Read a line, without its CRLF, into line. Returns 0 on error. */
+static int
+clientReadLine(Client * c, char * line, int max)
+{
+  int n = 0;
+  while (1) {
+    if (!clientFill(c)) return 0;
+    char ch = c->buf[c->pos++];
+    if (ch == '\n') break;
+    if (ch != '\r' && n < max - 1) line[n++] = ch;
+  }
+  line[n] = 0;
+  return 1;
+}
+
+static int
+clientSkip(Client * c, unsigned long len)
+{
+  while (len) {
+    if (!clientFill(c)) return 0;
+    unsigned long avail = c->have - c->pos;
+    if (avail > len) avail = len;
+    c->pos += avail;
+    len -= avail;
+  }
+  return 1;
+}
+
+/* Close the connection, saving its session in *session for resumption.
+   With TLS 1.3 the session ticket arrives after the handshake,
+   so we wait until now to get it. */
+static void
+clientClose(Client * c, SSL_SESSION ** session)
+{
+  if (c->ssl) {
+    SSL_SESSION * sess = SSL_get1_session(c->ssl);
+    if (sess && SSL_SESSION_is_resumable(sess)) {
+      if (*session)
+        SSL_SESSION_free(*session);
+      *session = sess;
+    } else if (sess)
+      SSL_SESSION_free(sess);
+    SSL_shutdown(c->ssl);
+    SSL_free(c->ssl);
+    c->ssl = NULL;
+  }
+  if (c->fd >= 0) close(c->fd);
+  c->fd = -1;
+  c->open = 0;
+}
+
+static int
+clientConnect(Client * c, SSL_CTX * ctx, struct sockaddr_in * addr,
+              SSL_SESSION ** session)
+{
+  c->fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (c->fd < 0) return 0;
+  if (connect(c->fd, (struct sockaddr *)addr, sizeof(*addr)) != 0) {
+    close(c->fd);
+    c->fd = -1;
+    return 0;
+  }
+  c->ssl = SSL_new(ctx);
+  SSL_set_fd(c->ssl, c->fd);
+  if (*session)		// try to resume
+    SSL_set_session(c->ssl, *session);
+  if (SSL_connect(c->ssl) != 1) {
+    SSL_free(c->ssl);
+    c->ssl = NULL;
+    close(c->fd);
+    c->fd = -1;
+    return 0;
+  }
+  c->pos = c->have = 0;
+  c->open = 1;
+  return 1;
+}
+
+/* Read one response. Returns 0 on error. */
+static int
+clientReadResponse(Client * c)
+{
+  char line[1024];
+  unsigned long contentLength = 0;
+  int chunked = 0;
+
+  if (!clientReadLine(c, line, sizeof(line))) return 0;
+  if (strncmp(line, "HTTP/1.1 ", 9)) return 0;
+  while (1) {
+    if (!clientReadLine(c, line, sizeof(line))) return 0;
+    if (!line[0]) break;	// end of headers
+    if (!memcmpci(line, "Content-Length:", 15))
+      contentLength = strtoul(line + 15, NULL, 10);
+    else if (!memcmpci(line, "Transfer-Encoding: chunked", 26))
+      chunked = 1;
+    else if (!memcmpci(line, "Connection: close", 17))
+      c->open = 0;	// server will close after this response
+  }
+  if (!chunked)
+    return clientSkip(c, contentLength);
+  while (1) {
+    if (!clientReadLine(c, line, sizeof(line))) return 0;
+    unsigned long chunkLen = strtoul(line, NULL, 16);
+    if (!chunkLen)
+      return clientReadLine(c, line, sizeof(line));	// final CRLF
+    if (!clientSkip(c, chunkLen)
+        || !clientReadLine(c, line, sizeof(line)))	// CRLF after data
+      return 0;
+  }
+}
+
+/* Per-client results, in memory shared with the parent. */
+typedef struct {
+  long completed;
+  long errors;
+  long connections;
+  long resumed;
+} ClientStats;
+
+static void
+runClient(struct sockaddr_in * addr, const char * host, const char * path,
+          long requests, double * latencies, ClientStats * stats)
+{
+  SSL_CTX * ctx = SSL_CTX_new(SSLv23_client_method());
+  SSL_SESSION * session = NULL;
+  Client c = {.fd = -1, .ssl = NULL, .open = 0};
+  char request[512];
+  int len = snprintf(request, sizeof(request),
+                     "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", path, host);
+  long i;
+
+  for (i = 0; i < requests; i++) {
+    double start = nowNs();
+    if (!c.open) {
+      clientClose(&c, &session);
+      if (!clientConnect(&c, ctx, addr, &session)) {
+        stats->errors++;
+        continue;
+      }
+      stats->connections++;
+      if (SSL_session_reused(c.ssl))
+        stats->resumed++;
+    }
+    if (SSL_write(c.ssl, request, len) != len
+        || !clientReadResponse(&c)) {
+      stats->errors++;
+      clientClose(&c, &session);
+      continue;
+    }
+    latencies[stats->completed++] = nowNs() - start;
+  }
+  clientClose(&c, &session);
+  if (session)
+    SSL_SESSION_free(session);
+  SSL_CTX_free(ctx);
+}
+
+static int
+compareDouble(const void * a, const void * b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static int
+load(const char * host, int port, int clients, long requests,
+     const char * path)
+{
+  struct sockaddr_in addr;
+  int i;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (!inet_aton(strcmp(host, "localhost") ? host : "127.0.0.1",
+                 &addr.sin_addr)) {
+    printf("Bad address %s\n", host);
+    return 1;
+  }
+
+  size_t latSize = sizeof(double) * clients * requests;
+  size_t statSize = sizeof(ClientStats) * clients;
+  double * latencies = mmap(NULL, latSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ClientStats * stats = mmap(NULL, statSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (latencies == MAP_FAILED || stats == MAP_FAILED) {
+    printf("mmap failed\n");
+    return 1;
+  }
+  memset(stats, 0, statSize);
+
+  SSL_load_error_strings();
+  SSL_library_init();
+
+  double start = nowNs();
+  for (i = 0; i < clients; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      runClient(&addr, host, path, requests,
+                latencies + i * requests, &stats[i]);
+      _exit(0);
+    }
+    if (pid < 0) {
+      printf("fork failed, errno=%d %s\n", errno, strerror(errno));
+      return 1;
+    }
+  }
+  for (i = 0; i < clients; i++)
+    wait(NULL);
+  double elapsed = nowNs() - start;
+
+  /* Gather the latencies of completed requests. */
+  long completed = 0, errors = 0, connections = 0, resumed = 0;
+  for (i = 0; i < clients; i++) {
+    memmove(latencies + completed, latencies + i * requests,
+            stats[i].completed * sizeof(double));
+    completed += stats[i].completed;
+    errors += stats[i].errors;
+    connections += stats[i].connections;
+    resumed += stats[i].resumed;
+  }
+  printf("%ld requests, %ld errors, %ld connections (%ld resumed)"
+         " in %.3f s\n",
+         completed, errors, connections, resumed, elapsed / 1e9);
+  if (!completed)
+    return 1;
+  qsort(latencies, completed, sizeof(double), &compareDouble);
+  printf("%.1f requests/s\n", completed / (elapsed / 1e9));
+  printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+         latencies[completed * 50 / 100] / 1e3,
+         latencies[completed * 90 / 100] / 1e3,
+         latencies[completed * 99 / 100] / 1e3,
+         latencies[completed - 1] / 1e3);
+  return errors != 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc >= 2 && !strcmp(argv[1], "micro"))
+    return micro(argc > 2 ? atol(argv[2]) : 10000000);
+  if (argc >= 6 && !strcmp(argv[1], "load"))
+    return load(argv[2], atoi(argv[3]), atoi(argv[4]), atol(argv[5]),
+                argc > 6 ? argv[6] : "/");
+  printf("Usage: httpbench micro [iterations]\n"
+         "       httpbench load host port clients requests [path]\n");
+  return 2;
+}
@@ -31,6 +31,7 @@ Approved for public release, distribution unlimited. */
 #include <idl/capros/Range.h>
 #include <idl/capros/SpaceBank.h>
 #include <idl/capros/Process.h>
+#include <idl/capros/Memory.h>
 #include <domain/InterpreterDestroy.h>
 #include "logfile.h"
 #include <domain/assert.h>
@@ -40,6 +41,8 @@ Approved for public release, distribution unlimited. */
 #define KR_MEMROOT KR_APP(2)
 /* NOTE!! The 3 or 4 key registers following KR_MEMROOT are a stack of
  * scratch registers for the recursive procedures. */
+#define KR_MAPBANK KR_APP(7)
+#define KR_LOGMAP  KR_APP(8)
 #define MemrootL2v 22
 
 #define dbg_memory 0x1
@@ -65,9 +68,9 @@ Records are contiguous and can span more than one block. */
 /* To support getNextRecord and getPreviousRecord operations,
 there are two ways to find a record given its RecordID.
 
-First, we cache a single id/location pair. This provides a
-quick way to find a record when there is a single client
-doing getNextRecord/getPreviousRecord.
+First, we cache an id/location pair for each reader (see struct Cursor
+below). This provides a quick way to find a record when clients
+are doing getNextRecord/getPreviousRecord sequentially.
 
 If that cache does not have the record we want, then we look in the index.
 The index has the id and location of the first record in each block.
@@ -141,23 +144,49 @@ struct IndexRecord {
   uint8_t * addr;
 };
 
-struct IndexRecord cachedLocation = {
-  .id = capros_Logfile_nullRecordID,
-  .addr = NULL	// for safety
+/* Readers are distinguished by a cursor number in the badge of the
+capability they invoke. The bits of the badge below CursorShift hold
+the restrictions and MapPermitted.
+Capabilities made by getCursorCap get distinct cursor numbers
+(until the numbers wrap); all other capabilities have cursor number 0.
+
+We keep the cached location of the most recently used NumCursors cursors. */
+#define RestrictionsMask \
+  (capros_Logfile_readOnly | capros_Logfile_noWait)
+#define MapPermitted 4	// set only by getMapCap
+#define CursorShift 3
+#define MaxCursorNum (0xffff >> CursorShift)
+#define NumCursors 16
+
+struct Cursor {
+  unsigned long lastUsed;	// 0 if the entry is free
+  uint16_t cursorNum;
+  struct IndexRecord loc;	// id is nullRecordID if nothing is cached
 };
 
+struct Cursor cursors[NumCursors];
+unsigned long cursorClock = 0;
+unsigned int nextCursorNum = 1;
+
 // BPSIZE is the larger of BLOCKSIZE and EROS_PAGE_SIZE.
 // Since both are powers of 2, BPSIZE is a multiple of each.
 #define BPSIZE (BLOCKSIZE > EROS_PAGE_SIZE ? BLOCKSIZE : EROS_PAGE_SIZE)
 
+/* The map returned by getMap is built of windows of MapUnitSize bytes,
+so the log must begin and end on a multiple of MapUnitSize,
+which is a multiple of BPSIZE. */
+#define MapUnitL2 (EROS_PAGE_LGSIZE + capros_GPT_l2nSlots)
+#define MapUnitSize (1ul << MapUnitL2)
+
 // Virtual memory available for the index and log:
-// SpaceStart and SpaceEnd must both be multiples of BPSIZE.
+// SpaceStart must be a multiple of BPSIZE,
+// and SpaceEnd must be a multiple of MapUnitSize.
 #define SpaceStart ((uint8_t *)0x00040000)
 #define SpaceEnd   ((uint8_t *)0x02000000)	// for ARM FCSE
 // Number of blocks in the log:
 #define NumBlocks (((SpaceEnd - SpaceStart) \
                     / (BLOCKSIZE + sizeof(struct IndexRecord))) \
-                   & (- (BPSIZE / BLOCKSIZE)))
+                   & (- (MapUnitSize / BLOCKSIZE)))
 // Virtual memory allocated to the index:
 #define IndexStart ((struct IndexRecord *)SpaceStart)
 #define IndexEnd   ((struct IndexRecord *)(SpaceStart + NumBlocks * sizeof(struct IndexRecord)))
@@ -388,10 +417,13 @@ DeleteOldestRecord(void)
   assert(CBOut == indexLo->addr);
   assert(indexLo == LogToIndex(CBOut));
 
-  if (cachedLocation.addr == CBOut) {
-    // We are deleting the cached location. Invalidate the cache.
-    cachedLocation.id = capros_Logfile_nullRecordID;
-    cachedLocation.addr = NULL;	// for safety
+  struct Cursor * c;
+  for (c = cursors; c < cursors + NumCursors; c++) {
+    if (c->loc.addr == CBOut) {
+      // We are deleting the cached location. Invalidate the cache.
+      c->loc.id = capros_Logfile_nullRecordID;
+      c->loc.addr = NULL;	// for safety
+    }
   }
 
   unsigned long recordLength = RecToHdr(CBOut)->length;
@@ -499,6 +531,46 @@ CheckDeletionBySpace(unsigned long newSpace)
 
 /***********************  Record search  **********************/
 
+// Get the cursor for a capability with the specified badge.
+static struct Cursor *
+GetCursor(uint16_t keyInfo)
+{
+  uint16_t num = keyInfo >> CursorShift;
+  struct Cursor * c;
+  struct Cursor * victim = &cursors[0];
+  for (c = cursors; c < cursors + NumCursors; c++) {
+    if (c->lastUsed && c->cursorNum == num)
+      goto found;
+    if (c->lastUsed < victim->lastUsed)
+      victim = c;	// least recently used so far
+  }
+  // Not cached. Reuse the least recently used entry.
+  c = victim;
+  c->cursorNum = num;
+  c->loc.id = capros_Logfile_nullRecordID;
+  c->loc.addr = NULL;	// for safety
+found:
+  c->lastUsed = ++cursorClock;
+  return c;
+}
+
+/* Returns the cached location of the record with the specified id,
+or NULL if it is not cached.
+The caller's own cursor is checked first, but another reader
+may have just gotten the same record. */
+static uint8_t *
+FindCachedLocation(struct Cursor * cursor, capros_Logfile_RecordID id)
+{
+  if (cursor->loc.id == id)
+    return cursor->loc.addr;
+  struct Cursor * c;
+  for (c = cursors; c < cursors + NumCursors; c++) {
+    if (c->loc.id == id)
+      return c->loc.addr;
+  }
+  return NULL;
+}
+
 static struct IndexRecord *
 GetIndexRecord(int i)
 {
@@ -533,7 +605,8 @@ SearchID(capros_Logfile_RecordID id)
 // On entry, rec->id <= id.
 // Returns NULL if no next record.
 uint8_t *
-SequentialSearchForNext(capros_Logfile_RecordID id, uint8_t * rec)
+SequentialSearchForNext(struct Cursor * cursor,
+  capros_Logfile_RecordID id, uint8_t * rec)
 {
   capros_Logfile_recordHeader * hdr, * nextHdr;
   uint8_t * nextRec;
@@ -547,8 +620,8 @@ SequentialSearchForNext(capros_Logfile_RecordID id, uint8_t * rec)
       nextRec = CBStart;	// wrap
     nextHdr = RecToHdr(nextRec);
     if (nextHdr->id > id) {
-      cachedLocation.id = nextHdr->id;
-      cachedLocation.addr = (uint8_t *)nextHdr;
+      cursor->loc.id = nextHdr->id;
+      cursor->loc.addr = (uint8_t *)nextHdr;
       return (uint8_t *)nextHdr;
     }
   }
@@ -556,7 +629,7 @@ SequentialSearchForNext(capros_Logfile_RecordID id, uint8_t * rec)
 
 // Returns NULL if no next record.
 uint8_t *
-GetNext(capros_Logfile_RecordID id)
+GetNext(struct Cursor * cursor, capros_Logfile_RecordID id)
 {
   if (! RecordsExist())
     return NULL;
@@ -565,13 +638,14 @@ GetNext(capros_Logfile_RecordID id)
     return CBOut;
   } else {
     // First check the cache:
-    if (cachedLocation.id == id)
-      return SequentialSearchForNext(id, cachedLocation.addr);
+    uint8_t * cached = FindCachedLocation(cursor, id);
+    if (cached)
+      return SequentialSearchForNext(cursor, id, cached);
 
     int u = SearchID(id);
     if (u < 0)
       return CBOut;	// id is before the first index record
-    return SequentialSearchForNext(id, GetIndexRecord(u)->addr);
+    return SequentialSearchForNext(cursor, id, GetIndexRecord(u)->addr);
   }
 }
 
@@ -594,7 +668,8 @@ GetPrevLogRecord(uint8_t * this)
 // On entry, rec->id >= id or rec is CBIn.
 // Returns NULL if no such record.
 uint8_t *
-SequentialSearchForPrev(capros_Logfile_RecordID id, uint8_t * rec)
+SequentialSearchForPrev(struct Cursor * cursor,
+  capros_Logfile_RecordID id, uint8_t * rec)
 {
   uint8_t * nextRec;
   for ( ; ; rec = nextRec) {
@@ -605,8 +680,8 @@ SequentialSearchForPrev(capros_Logfile_RecordID id, uint8_t * rec)
     nextRec = GetPrevLogRecord(rec);
     capros_Logfile_recordHeader * hdr = RecToHdr(nextRec);
     if (hdr->id < id) {
-      cachedLocation.id = hdr->id;
-      cachedLocation.addr = (uint8_t *)hdr;
+      cursor->loc.id = hdr->id;
+      cursor->loc.addr = (uint8_t *)hdr;
       return (uint8_t *)hdr;
     }
   }
@@ -614,7 +689,7 @@ SequentialSearchForPrev(capros_Logfile_RecordID id, uint8_t * rec)
 
 // Returns NULL if no previous record.
 uint8_t *
-GetPrev(capros_Logfile_RecordID id)
+GetPrev(struct Cursor * cursor, capros_Logfile_RecordID id)
 {
   if (! RecordsExist())
     return NULL;
@@ -623,8 +698,9 @@ GetPrev(capros_Logfile_RecordID id)
     return GetPrevLogRecord(CBIn);
   } else {
     // First check the cache:
-    if (cachedLocation.id == id)
-      return SequentialSearchForPrev(id, cachedLocation.addr);
+    uint8_t * cached = FindCachedLocation(cursor, id);
+    if (cached)
+      return SequentialSearchForPrev(cursor, id, cached);
 
     int u = SearchID(id);
     if (u < 0)
@@ -632,14 +708,54 @@ GetPrev(capros_Logfile_RecordID id)
     u++;	// we will search back from a higher record
     uint8_t * searchStart = 
       (u == numIndexRecords ? CBIn : GetIndexRecord(u)->addr);
-    return SequentialSearchForPrev(id, searchStart);
+    return SequentialSearchForPrev(cursor, id, searchStart);
+  }
+}
+
+/* Get as many records as will fit in maxLen, starting with the record
+with the smallest RecordID greater than id.
+The records returned are contiguous in memory, so this may return fewer
+than will fit if the log wraps.
+Returns NULL if no next record, otherwise stores the length in *lenp.
+If that record alone is longer than maxLen, returns it with *lenp zero,
+and leaves the cursor where it was. */
+uint8_t *
+GetNextRecords(struct Cursor * cursor, capros_Logfile_RecordID id,
+  uint32_t maxLen, uint32_t * lenp)
+{
+  struct IndexRecord oldLoc = cursor->loc;
+  uint8_t * rec = GetNext(cursor, id);
+  if (! rec)
+    return NULL;
+  if (RecToHdr(rec)->length > maxLen) {
+    cursor->loc = oldLoc;
+    *lenp = 0;
+    return rec;
+  }
+  uint8_t * curRec = rec;
+  uint8_t * lastRec = rec;
+  while (1) {
+    uint32_t length = RecToHdr(curRec)->length;
+    if (curRec + length - rec > maxLen)
+      break;	// next record doesn't fit
+    lastRec = curRec;
+    curRec += length;
+    if (curRec == CBIn || curRec == CBLast)
+      break;	// no more records, or would wrap
   }
+  /* Leave the cursor on the last record returned, whose id the reader
+  will pass to get the records that follow. */
+  cursor->loc.id = RecToHdr(lastRec)->id;
+  cursor->loc.addr = lastRec;
+  *lenp = curRec - rec;
+  return rec;
 }
 
 /***********************  Stuff for the waiter  **********************/
 
 bool notifWaiter = false;
 capros_Logfile_RecordID waiterID;
+uint16_t waiterKeyInfo;
 
 static void
 CheckWaiter(void)
@@ -647,7 +763,7 @@ CheckWaiter(void)
   assert(RecordsExist());
   if (notifWaiter && lastIDAdded > waiterID) {
     uint8_t * rec;
-    rec = GetNext(waiterID);
+    rec = GetNext(GetCursor(waiterKeyInfo), waiterID);
     assert(rec);
 
     Message Msg = {
@@ -779,8 +895,6 @@ AppendRecord(Message * msg)
   // Whew! Everything is OK to add the record. Do it.
   memcpy(tentativeLoc, messageBuffer, recordLength);
   CBIn = tentativeLoc + recordLength;
-  cachedLocation.id = id;
-  cachedLocation.addr = tentativeLoc;
 
   // Now update the index:
   struct IndexRecord * ir;
@@ -800,12 +914,16 @@ AppendRecord(Message * msg)
 
 /***********************  Capability server  **********************/
 
+bool logMapBuilt = false;	// see BuildLogMap
+
 // Destroy self:
 void
 Sepuku(uint32_t finalResult)
 {
   // Free all the memory:
   EnsureRangeDeallocated((uint32_t)SpaceStart, (uint32_t)SpaceEnd);
+  if (logMapBuilt)
+    capros_SpaceBank_destroyBankAndSpace(KR_MAPBANK);
 
   capros_Node_getSlotExtended(KR_CONSTIT, KC_INTERPRETERSPACE, KR_TEMP0);
   InterpreterDestroy(KR_TEMP0, KR_TEMP1, finalResult);
@@ -817,6 +935,62 @@ IsReadOnly(Message * msg)
   return msg->rcv_keyInfo & capros_Logfile_readOnly;
 }
 
+static inline bool
+CanMap(Message * msg)
+{
+  return msg->rcv_keyInfo & MapPermitted;
+}
+
+/* The map returned by getMap covers only the log, from CBStart to CBEnd.
+Its root, in KR_LOGMAP, has l2v MapUnitL2 + l2nSlots and has a
+read-only key to our address space as its background.
+Each slot of the root holds a GPT of l2v MapUnitL2 whose slots are
+background windows onto successive units of the log.
+The GPTs are bought from a sub-bank in KR_MAPBANK, so the map is
+built once and freed with it if building fails. */
+
+static result_t
+BuildLogMap(void)
+{
+  result_t result;
+  unsigned long nUnits = (CBEnd - CBStart) >> MapUnitL2;
+  unsigned long i;
+
+  assert((((uint32_t)CBStart) & (MapUnitSize - 1)) == 0);
+  assert(((nUnits - 1) >> l2nSlots) < capros_GPT_backgroundSlot);
+
+  result = capros_SpaceBank_createSubBank(KR_BANK, KR_MAPBANK);
+  if (result != RC_OK)
+    return result;
+  result = capros_SpaceBank_alloc1(KR_MAPBANK, capros_Range_otGPT, KR_LOGMAP);
+  if (result != RC_OK)
+    goto fail;
+  capros_GPT_setL2v(KR_LOGMAP, MapUnitL2 + l2nSlots);
+  capros_Memory_reduce(KR_MEMROOT, capros_Memory_readOnly, KR_TEMP0);
+  capros_GPT_setBackground(KR_LOGMAP, KR_TEMP0);
+
+  for (i = 0; i < nUnits; i++) {
+    unsigned int slot = i & (capros_GPT_nSlots - 1);
+    if (slot == 0) {
+      result = capros_SpaceBank_alloc1(KR_MAPBANK, capros_Range_otGPT,
+                                       KR_TEMP1);
+      if (result != RC_OK)
+        goto fail;
+      capros_GPT_setL2v(KR_TEMP1, MapUnitL2);
+      capros_GPT_setSlot(KR_LOGMAP, i >> l2nSlots, KR_TEMP1);
+    }
+    result = capros_GPT_setWindow(KR_TEMP1, slot, capros_GPT_windowBaseSlot,
+               0, (uint32_t)CBStart + (i << MapUnitL2));
+    assert(result == RC_OK);
+  }
+  logMapBuilt = true;
+  return RC_OK;
+
+fail:
+  capros_SpaceBank_destroyBankAndSpace(KR_MAPBANK);
+  return result;
+}
+
 int
 main(void)
 {
@@ -852,6 +1026,7 @@ main(void)
     capros_Logfile_RecordID id;
     uint32_t maxLenToReceive;
     uint8_t * rec;
+    uint32_t lengthGotten;
 
     RETURN(&Msg);
 
@@ -885,7 +1060,7 @@ main(void)
       break;
 
     case OC_capros_Logfile_reduce:
-      if (msg->rcv_w1 & ~(capros_Logfile_readOnly | capros_Logfile_noWait)) {
+      if (msg->rcv_w1 & ~RestrictionsMask) {
         Msg.snd_code = RC_capros_key_RequestError;
         break;
       }
@@ -899,6 +1074,64 @@ main(void)
       Msg.snd_key0 = KR_TEMP0;
       break;
 
+    case OC_capros_Logfile_getCursorCap:
+      capros_Process_makeStartKey(KR_SELF,
+               (msg->rcv_keyInfo & (RestrictionsMask | MapPermitted))
+               | (nextCursorNum << CursorShift),
+               KR_TEMP0);
+      // If the numbers wrap, capabilities will share cursors,
+      // which is correct but slower.
+      if (++nextCursorNum > MaxCursorNum)
+        nextCursorNum = 1;
+      Msg.snd_key0 = KR_TEMP0;
+      break;
+
+    case OC_capros_Logfile_getMapCap:
+      if (IsReadOnly(&Msg)) {
+        Msg.snd_code = RC_capros_key_NoAccess;
+        break;
+      }
+      capros_Process_makeStartKey(KR_SELF, msg->rcv_keyInfo | MapPermitted,
+                                  KR_TEMP0);
+      Msg.snd_key0 = KR_TEMP0;
+      break;
+
+    case OC_capros_Logfile_getMap:
+      if (! CanMap(&Msg)) {
+        Msg.snd_code = RC_capros_key_NoAccess;
+        break;
+      }
+      if (! logMapBuilt) {
+        Msg.snd_code = BuildLogMap();
+        if (Msg.snd_code != RC_OK)
+          break;
+      }
+      capros_Memory_reduce(KR_LOGMAP,
+                           capros_Memory_readOnly | capros_Memory_opaque,
+                           KR_TEMP0);
+      Msg.snd_key0 = KR_TEMP0;
+      Msg.snd_w1 = CBEnd - CBStart;
+      break;
+
+    case OC_capros_Logfile_locateNextRecords:
+      if (! CanMap(&Msg)) {
+        Msg.snd_code = RC_capros_key_NoAccess;
+        break;
+      }
+      id = Msg.rcv_w1 | ((uint64_t)Msg.rcv_w2 << 32);
+      rec = GetNextRecords(GetCursor(msg->rcv_keyInfo), id, Msg.rcv_w3,
+                           &lengthGotten);
+      if (! rec)
+        Msg.snd_code = RC_capros_Logfile_NoRecord;
+      else if (! lengthGotten) {
+        Msg.snd_code = RC_capros_Logfile_TooSmall;
+        Msg.snd_w1 = RecToHdr(rec)->length;	// the length needed
+      } else {
+        Msg.snd_w1 = rec - CBStart;	// offset in the map
+        Msg.snd_w2 = lengthGotten;
+      }
+      break;
+
     case 1:	// OC_capros_Logfile_appendRecord
       if (IsReadOnly(&Msg)) {
         Msg.snd_code = RC_capros_key_NoAccess;
@@ -917,7 +1150,7 @@ main(void)
 
     case 2:	// OC_capros_Logfile_getNextRecord
       id = Msg.rcv_w1 | ((uint64_t)Msg.rcv_w2 << 32);
-      rec = GetNext(id);
+      rec = GetNext(GetCursor(msg->rcv_keyInfo), id);
     returnOneRecord:
       if (! rec)
         Msg.snd_code = RC_capros_Logfile_NoRecord;
@@ -937,40 +1170,36 @@ main(void)
         break;
       }
       id = Msg.rcv_w1 | ((uint64_t)Msg.rcv_w2 << 32);
-      rec = GetNext(id);
+      rec = GetNext(GetCursor(msg->rcv_keyInfo), id);
       if (rec)
         goto returnOneRecord;
       // Must wait.
       notifWaiter = true;
       waiterID = id;
+      waiterKeyInfo = msg->rcv_keyInfo;
       COPY_KEYREG(KR_RETURN, KR_WAITER);	// save return cap
       Msg.snd_invKey = KR_VOID;
       break;
 
     case 3:	// OC_capros_Logfile_getPreviousRecord
       id = Msg.rcv_w1 | ((uint64_t)Msg.rcv_w2 << 32);
-      rec = GetPrev(id);
+      rec = GetPrev(GetCursor(msg->rcv_keyInfo), id);
       goto returnOneRecord;
 
     case 4:	// OC_capros_Logfile_getNextRecords
       id = Msg.rcv_w1 | ((uint64_t)Msg.rcv_w2 << 32);
       maxLenToReceive = Msg.rcv_w3;
       minEquals(maxLenToReceive, capros_key_messageLimit);
-      rec = GetNext(id);
+      rec = GetNextRecords(GetCursor(msg->rcv_keyInfo), id, maxLenToReceive,
+                           &lengthGotten);
       if (! rec)
         Msg.snd_code = RC_capros_Logfile_NoRecord;
-      else {
-        uint8_t * curRec = rec;
-        while (1) {
-          uint32_t length = RecToHdr(curRec)->length;
-          if (curRec + length - rec > maxLenToReceive)
-            break;	// next record doesn't fit
-          curRec += length;
-          if (curRec == CBIn || curRec == CBLast)
-            break;	// no more records, or would wrap
-        }
+      else if (! lengthGotten) {
+        Msg.snd_code = RC_capros_Logfile_TooSmall;
+        Msg.snd_w1 = RecToHdr(rec)->length;	// the length needed
+      } else {
         Msg.snd_data = rec;
-        Msg.snd_len = curRec - rec;
+        Msg.snd_len = lengthGotten;
       }
       break;
 
@@ -978,7 +1207,7 @@ main(void)
       id = Msg.rcv_w1 | ((uint64_t)Msg.rcv_w2 << 32);
       maxLenToReceive = Msg.rcv_w3;
       minEquals(maxLenToReceive, capros_key_messageLimit);
-      rec = GetPrev(id);
+      rec = GetPrev(GetCursor(msg->rcv_keyInfo), id);
       if (! rec)
         Msg.snd_code = RC_capros_Logfile_NoRecord;
       else {
@@ -35,6 +35,9 @@ Approved for public release, distribution unlimited. */
 #include <idl/capros/Constructor.h>
 #include <idl/capros/Node.h>
 #include <idl/capros/Discrim.h>
+#include <idl/capros/SpaceBank.h>
+#include <idl/capros/Range.h>
+#include <idl/capros/TCPSocket.h>
 #include <ethread/ethread.h>
 
 #include <domain/domdbg.h>
@@ -54,7 +57,15 @@ unsigned long long listenStack[2048 / sizeof(unsigned long long)];
 #define KR_LISTENPROC KR_APP(4) /* The listener process key if any */
 #define KR_HANDLER    KR_APP(5) /* The connection handler object */
 #define KR_TCPListenSocket KR_APP(6)
+#define KR_POOL       KR_APP(7) /* Node holding idle handlers' start keys */
+#define KR_DISPATCH   KR_APP(8) /* Listener thread's key to the main thread */
 #define KR_OSTREAM    KR_APP(9)	/* only used for debugging */
+#define KR_POOLKEY    KR_APP(10) /* Given to handlers to rejoin the pool */
+
+/* keyInfo values of start keys to the main thread */
+#define keyInfo_NetListener 0
+#define keyInfo_Dispatch    1	// from the listener thread
+#define keyInfo_Pool        2	// from a handler done with its connection
 
 /* DEBUG stuff */
 #define dbg_init	0x01u   /* debug initialization logic */
@@ -68,10 +79,137 @@ unsigned long long listenStack[2048 / sizeof(unsigned long long)];
 
 bool haveListener = false;
 
+/* The handler pool. Only the main thread changes these,
+   so no locking is needed. Idle handlers are in slots 0 through
+   poolStats.idle - 1 of KR_POOL. */
+bool havePoolNode = false;
+capros_NetListener_PoolStatistics poolStats;	// zero
+
 /* Internal routine prototypes */
 int listen(void);
 int processRequest(Message *argmsg);
+static result_t FillPool(void);
+
+
+/* Build a handler for the pool. Its start key is left in KR_HANDLER. */
+static result_t
+BuildHandler(void)
+{
+  result_t result = capros_Constructor_request(KR_CONNECTION_HANDLER_C,
+                      KR_BANK, KR_SCHED, KR_VOID, KR_HANDLER);
+  if (result == RC_OK)
+    poolStats.built++;
+  return result;
+}
+
+/* Give the handler in KR_HANDLER the socket in KR_ARG(0). */
+static void
+ServeConnection(void)
+{
+  Message msg = {
+    .snd_invKey = KR_HANDLER,
+    .snd_key0 = KR_ARG(0),
+    .snd_key1 = KR_POOLKEY,
+    .snd_key2 = KR_VOID,
+    .snd_rsmkey = KR_VOID,
+    .snd_len = 0,
+    .snd_code = capros_NetListener_serveOrderCode,
+    .snd_w1 = 0,
+    .snd_w2 = 0,
+    .snd_w3 = 0
+  };
+  SEND(&msg);	// the handler is waiting, so this does not block
+}
+
+/* Tell the handler in KR_HANDLER to go away. */
+static void
+DismissHandler(void)
+{
+  Message msg = {
+    .snd_invKey = KR_HANDLER,
+    .snd_key0 = KR_VOID,
+    .snd_key1 = KR_VOID,
+    .snd_key2 = KR_VOID,
+    .snd_rsmkey = KR_VOID,
+    .snd_len = 0,
+    .snd_code = OC_capros_key_destroy,
+    .snd_w1 = 0,
+    .snd_w2 = 0,
+    .snd_w3 = 0
+  };
+  SEND(&msg);
+}
+
+static void
+PoolPush(void)
+{
+  result_t result = capros_Node_swapSlot(KR_POOL, poolStats.idle++,
+                                         KR_HANDLER, KR_VOID);
+  assert(result == RC_OK);
+}
+
+static void
+PoolPop(void)
+{
+  result_t result = capros_Node_swapSlot(KR_POOL, --poolStats.idle,
+                                         KR_VOID, KR_HANDLER);
+  assert(result == RC_OK);
+}
+
+static result_t
+FillPool(void)
+{
+  while (poolStats.idle < poolStats.poolSize) {
+    result_t result = BuildHandler();
+    if (result != RC_OK)
+      return result;
+    PoolPush();
+  }
+  return RC_OK;
+}
+
+static void
+EmptyPool(unsigned int keep)
+{
+  while (poolStats.idle > keep) {
+    PoolPop();
+    DismissHandler();
+  }
+}
+
+/* The listener thread has a connection, in KR_ARG(0), for us. */
+static void
+DispatchConnection(Message * msg)
+{
+  msg->snd_key0 = KR_VOID;
+  msg->snd_code = RC_OK;
 
+  if (poolStats.idle) {
+    PoolPop();
+    poolStats.hits++;
+  } else {
+    result_t result = BuildHandler();
+    if (result != RC_OK) {
+      msg->snd_code = result;
+      return;
+    }
+    poolStats.misses++;
+  }
+  ServeConnection();
+}
+
+/* A handler, whose start key is in KR_ARG(0), is done with its connection.
+   No reply is expected. */
+static void
+HandlerDone(Message * msg)
+{
+  capros_Process_getKeyReg(KR_SELF, KR_ARG(0), KR_HANDLER);
+  poolStats.recycled++;
+  if (poolStats.idle < poolStats.poolSize)
+    PoolPush();
+  else
+    DismissHandler();
+}
 
 int
 main(void)
@@ -99,12 +237,26 @@ main(void)
   msg.rcv_rsmkey = KR_RETURN;
   msg.rcv_limit = 0;
 
+  capros_Process_makeStartKey(KR_SELF, keyInfo_Pool, KR_POOLKEY);
+
   for(;;) {
     RETURN(&msg);
 
     msg.snd_invKey = KR_RETURN;
+    msg.snd_len = 0;
+
+    switch (msg.rcv_keyInfo) {
+    case keyInfo_Dispatch:
+      DispatchConnection(&msg);
+      break;
 
-    (void) processRequest(&msg);
+    case keyInfo_Pool:
+      HandlerDone(&msg);
+      break;
+
+    default:
+      (void) processRequest(&msg);
+    }
   }
 }
 
@@ -133,16 +285,49 @@ processRequest(Message *argmsg)
 
       capros_Process_getKeyReg(KR_SELF, KR_ARG(0), KR_TCPPortNum);
       capros_Process_getKeyReg(KR_SELF, KR_ARG(1), KR_CONNECTION_HANDLER_C);
+      /* The listener thread gets a copy of KR_DISPATCH. */
+      capros_Process_makeStartKey(KR_SELF, keyInfo_Dispatch, KR_DISPATCH);
       result = ethread_new_thread1(KR_BANK,
                                    (uint8_t *)listenStack + sizeof(listenStack),
 				   &listen, KR_LISTENPROC);
       if (RC_OK == result) {
         haveListener = true;	// true forevermore
         ethread_start(KR_LISTENPROC);
+        (void) FillPool();	// failure just means more misses
       }
       argmsg->snd_code = result;
       break;
     }
+
+  case OC_capros_NetListener_setPoolSize:
+    {
+      uint32_t size = argmsg->rcv_w1;
+      if (size > capros_NetListener_maxPoolSize) {
+	argmsg->snd_code = RC_capros_key_RequestError;
+	break;
+      }
+      if (size && ! havePoolNode) {
+        result = capros_SpaceBank_alloc1(KR_BANK, capros_Range_otNode,
+                                         KR_POOL);
+        if (result != RC_OK) {
+	  argmsg->snd_code = RC_capros_NetListener_NoMem;
+	  break;
+        }
+        havePoolNode = true;
+      }
+      poolStats.poolSize = size;
+      EmptyPool(size);
+      if (haveListener)
+        (void) FillPool();
+      break;
+    }
+
+  case OC_capros_NetListener_getPoolStatistics:
+    {
+      argmsg->snd_data = &poolStats;
+      argmsg->snd_len = sizeof(poolStats);
+      break;
+    }
   case OC_capros_key_getType: /* Key type */
     {
       argmsg->snd_code = RC_OK;
@@ -157,6 +342,10 @@ processRequest(Message *argmsg)
         Until then, just destroy the thread. */
         capros_ProcCre_destroyProcess(KR_CREATOR, KR_BANK, KR_LISTENPROC);
       }
+      if (havePoolNode) {
+        EmptyPool(0);
+        capros_SpaceBank_free1(KR_BANK, KR_POOL);
+      }
       capros_Node_getSlot(KR_CONSTIT, KC_PROTOSPACE, KR_TEMP0);
 
       /* Invoke the protospace to destroy us and return. */
@@ -211,6 +400,34 @@ listen(void)
                       ip & 0xff,
                       port);
 
+        if (poolStats.poolSize) {
+          /* The main thread owns the pool. Have it give the socket
+             to a pooled handler. */
+          msg.snd_invKey = KR_DISPATCH;
+          msg.snd_key0 = KR_SOCKET;
+          msg.snd_key1 = KR_VOID;
+          msg.snd_key2 = KR_VOID;
+          msg.snd_rsmkey = KR_VOID;
+          msg.snd_len = 0;
+          msg.snd_code = 0;
+          msg.snd_w1 = 0;
+          msg.snd_w2 = 0;
+          msg.snd_w3 = 0;
+          msg.rcv_key0 = KR_VOID;
+          msg.rcv_key1 = KR_VOID;
+          msg.rcv_key2 = KR_VOID;
+          msg.rcv_rsmkey = KR_VOID;
+          msg.rcv_limit = 0;
+          CALL(&msg);
+          if (msg.rcv_code != RC_OK) {
+            DEBUG(errors) kprintf(KR_OSTREAM,
+                                  "NetListener: dispatch got rc=%#x\n",
+                                  msg.rcv_code);
+            capros_TCPSocket_abort(KR_SOCKET);
+          }
+          break;
+        }
+
 	rc = capros_Constructor_request(KR_CONNECTION_HANDLER_C,
 					KR_BANK, KR_SCHED, KR_SOCKET, KR_HANDLER);
         DEBUG(init) kprintf(KR_OSTREAM, "NetListener: Built handler\n");
@@ -39,6 +39,9 @@ Approved for public release, distribution unlimited. */
  * unable to do windowing tricks.
  *
  * The whole shebang is designed around 4Kbyte file blocks.
+ * Where possible, a file's blocks are allocated in contiguous runs
+ * (extents), which are recorded in the inode so that large transfers
+ * can be done without walking the block tables for each block.
  */
 
 #include <stddef.h>
@@ -47,8 +50,10 @@ Approved for public release, distribution unlimited. */
 #include <domain/Runtime.h>
 #include <domain/assert.h>
 #include <eros/Invoke.h>
+#include <eros/cap-instr.h>
 
 #include <idl/capros/key.h>
+#include <idl/capros/Memory.h>
 #include <idl/capros/GPT.h>
 #include <idl/capros/SpaceBank.h>
 #include <idl/capros/Node.h>
@@ -78,6 +83,8 @@ Approved for public release, distribution unlimited. */
 #define dbg_req     0x80
 #define dbg_free    0x100
 #define dbg_fresh   0x200
+#define dbg_ra      0x400
+#define dbg_map     0x800
 
 /* Following should be an OR of some of the above */
 #define dbg_flags   ( 0x0 )
@@ -88,6 +95,9 @@ Approved for public release, distribution unlimited. */
 #define KR_OSTREAM    KR_APP(2)
 #define KR_MYSPACE    KR_APP(3)
 #define KR_SCRATCH    KR_APP(4)
+#define KR_MAPBANK    KR_APP(5)
+#define KR_MAPROOT    KR_APP(6)
+#define KR_MAPLEAF    KR_APP(7)
 
 #define BUF_SZ  capros_key_messageLimit
 #define BLOCK_SIZE 4096
@@ -97,6 +107,7 @@ Approved for public release, distribution unlimited. */
 #define NSTACK (BUF_SZ/EROS_PAGE_SIZE + 1)
 const uint32_t __rt_stack_pages = NSTACK;
 
+#define GROW_TABLE  3	// grow indirection blocks but not the leaf
 #define GROW_NOZERO 2
 #define GROW        1
 #define NO_GROW     0
@@ -107,9 +118,22 @@ typedef capros_File_fileLocation f_size_t;
 /* We divide the CAPROS_FAST_SPACE_LGSIZE space into two halves: */
 #define SUBSPACE_LGSIZE (CAPROS_FAST_SPACE_LGSIZE-1)
 /* The first subspace is for program, bss, and stack.
-The second is for file storage, which grows upwards. */
+The second is for file storage. Data blocks are allocated upwards from
+its bottom, and indirection blocks downwards from its top, so that
+growing a file's block tables does not get in the way of extending
+its last extent in place. */
 
 #define INO_NINDIR 11
+#define INO_NEXTENTS 5
+
+/* An extent is a run of file blocks that are contiguous in our
+address space. Every block of an extent is also entered in the
+block tables, so the extents are only an accelerator. */
+struct extent {
+  uint32_t fileBlock;	// number of the first file block
+  uint32_t nBlocks;
+  uint8_t * addr;	// address of the first block
+};
 
 /* A file is defined by an inode aka struct ino.
 Inodes are allocated in the root file.
@@ -134,6 +158,7 @@ struct ino {
   } u;
   uint64_t uuid;		/* unique ID */
   uint8_t  nLayer;	// number of levels of indirection blocks
+  uint8_t  nExtents;	// number of valid entries in extents
   inoID_t id;		// this inode's own id
 
   /* A level 0 pointer is a pointer to a block of file data.
@@ -142,6 +167,11 @@ struct ino {
      A level n pointer (n >= 0) is NULL if there is no data at that location.
      indir[i] is a level nLayer pointer. */
   uint32_t *indir[INO_NINDIR];
+
+  /* Extents are in increasing order of fileBlock and do not overlap. */
+  struct extent extents[INO_NEXTENTS];
+  uint32_t mapBlocks;	// number of blocks covered by the map, if any
+  uint32_t mapHole;	// first hole left void in the map, or UINT_MAX
 } ;
 
 #define inodesPerBlock (BLOCK_SIZE / sizeof(ino_s))
@@ -166,13 +196,47 @@ const uint64_t sizes_by_layers[] = {
 };
 
 
+/* To speed up sequential access, we remember a little about the
+most recent access to a few files.
+The cursor for a file is cursors[id % NCURSORS]; it is valid only if
+its uuid matches the file's. */
+#define NCURSORS 16
+
+/* When a file is being read sequentially, we touch this many blocks
+ahead of the reader, so they are already in memory when it gets there. */
+#define READAHEAD_BLOCKS 32
+
+struct cursor {
+  uint64_t uuid;	// of the file, or 0 if unused
+  f_size_t nextAt;	// location following the last transfer
+
+  /* leaf is the level 0 block table entry for file block leafBlk,
+  which is a multiple of PtrsPerBlock, or NULL.
+  It is only cached for files with at least one level of indirection,
+  and only while the file has nLayer levels, because growing a
+  zero-level file moves its table. */
+  uint32_t **leaf;
+  uint64_t leafBlk;
+  uint8_t nLayer;
+
+  uint64_t raNext;	// blocks before this have been read ahead
+};
+
 typedef struct server_state {
   uint8_t *buf;
 
+  struct cursor cursors[NCURSORS];
+
+  /* Read-ahead to be done after replying to the current request: */
+  ino_s * raIno;
+  uint64_t raFrom;	// first block to touch
+  uint64_t raTo;	// last block to touch + 1
+
   ino_s    *first_free_inode;
   uint32_t *first_free_block;
   ino_s    root;
-  uint8_t * top_addr;	// highest allocated addr +1
+  uint8_t * top_addr;	// highest allocated data block addr +1
+  uint8_t * table_addr;	// lowest allocated indirection block addr
   uint64_t nxt_uuid;
 } server_state;
 
@@ -192,7 +256,7 @@ AllocBlock(server_state *ss, int wantZero)
       bzero(pg, BLOCK_SIZE);
   }
   else {
-    if (ss->top_addr >= (uint8_t *) (2ul << SUBSPACE_LGSIZE))
+    if (ss->top_addr >= ss->table_addr)
       kdprintf(KR_OSTREAM, "Nfile: out of address space!!\n");
 
     pg = ss->top_addr;
@@ -208,6 +272,45 @@ AllocBlock(server_state *ss, int wantZero)
   return pg;
 }
 
+/* Allocate a zeroed indirection block. */
+uint32_t **
+AllocTableBlock(server_state *ss)
+{
+  uint8_t * pg;
+
+  if (ss->first_free_block)
+    return (uint32_t **) AllocBlock(ss, WANT_ZERO);
+
+  if (ss->top_addr >= ss->table_addr)
+    kdprintf(KR_OSTREAM, "Nfile: out of address space!!\n");
+
+  ss->table_addr -= BLOCK_SIZE;
+  pg = ss->table_addr;
+  /* Newly allocated pages come to us pre-zeroed by VCSK. */
+
+  DEBUG(alloc)
+    kdprintf(KR_OSTREAM, "AllocTableBlock returns 0x%x\n", pg);
+  return (uint32_t **) pg;
+}
+
+/* Allocate nBlocks contiguous fresh blocks.
+   They come to us pre-zeroed by VCSK.
+   Returns NULL if there isn't enough address space. */
+uint8_t *
+AllocExtent(server_state *ss, uint32_t nBlocks)
+{
+  uint8_t * pg = ss->top_addr;
+
+  if (nBlocks > (ss->table_addr - pg) / BLOCK_SIZE)
+    return 0;
+
+  ss->top_addr += nBlocks * BLOCK_SIZE;
+
+  DEBUG(alloc)
+    kdprintf(KR_OSTREAM, "AllocExtent %d returns 0x%x\n", nBlocks, pg);
+  return pg;
+}
+
 void
 init(server_state *ss)
 {
@@ -245,6 +348,7 @@ init(server_state *ss)
 
   bzero(ss, sizeof(*ss));
   ss->top_addr = (uint8_t *) (1ul << SUBSPACE_LGSIZE);
+  ss->table_addr = (uint8_t *) (2ul << SUBSPACE_LGSIZE);
   ss->first_free_inode = 0;
   ss->first_free_block = 0;
   ss->root.nLayer = 0;
@@ -298,6 +402,9 @@ find_file_page(server_state *ss, ino_s *ino, f_size_t at, int wantGrow)
     kdprintf(KR_OSTREAM, "find: ino: %#llx sz %#llx at: "PS_FSIZE", grow? %c\n",
 	    ino->uuid, ino->u.sz, at, (wantGrow == GROW) ? 'y' : 'n');
   
+  if (wantGrow == NO_GROW && allocSz > sizes_by_layers[ino->nLayer])
+    return 0;	// beyond anything allocated
+
   /* Grow the file upwards as necessary. */
   while (allocSz > sizes_by_layers[ino->nLayer]) {
     int i;
@@ -308,7 +415,7 @@ find_file_page(server_state *ss, ino_s *ino, f_size_t at, int wantGrow)
 	      ino->uuid, allocSz, ino->nLayer,
 	      sizes_by_layers[ino->nLayer]);
   
-    newIndir = (uint32_t **) AllocBlock(ss, WANT_ZERO);
+    newIndir = AllocTableBlock(ss);
 
     for (i = 0; i < INO_NINDIR; i++) {
       newIndir[i] = ino->indir[i];
@@ -333,23 +440,22 @@ find_file_page(server_state *ss, ino_s *ino, f_size_t at, int wantGrow)
 	kdprintf(KR_OSTREAM, "find: ino: %#llx layer %d ndx %d\n",
 		ino->uuid, layer, ndx);
 
-      blockTable = (uint32_t **)blockTable[ndx];
-
       DEBUG(findpg)
 	kdprintf(KR_OSTREAM, "find: ino: %#llx layer %d ndx %d ==> 0x%x\n",
-		ino->uuid, layer, ndx, blockTable);
+		ino->uuid, layer, ndx, blockTable[ndx]);
 
-      if (blockTable == 0) {
+      if (blockTable[ndx] == 0) {
 	if (wantGrow == NO_GROW)
 	  return 0;
 
-	blockTable[ndx] = (uint32_t *) AllocBlock(ss, WANT_ZERO);
-	blockTable = (uint32_t **)blockTable[ndx];
+	blockTable[ndx] = (uint32_t *) AllocTableBlock(ss);
 
 	DEBUG(findpg)
 	  kdprintf(KR_OSTREAM, "find: ino: %#llx layer %d ndx %d: grow layer: 0x%x\n",
-		  ino->uuid, layer, ndx, blockTable);
+		  ino->uuid, layer, ndx, blockTable[ndx]);
       }
+
+      blockTable = (uint32_t **)blockTable[ndx];
     
       layer--;
     }
@@ -360,7 +466,8 @@ find_file_page(server_state *ss, ino_s *ino, f_size_t at, int wantGrow)
       kdprintf(KR_OSTREAM, "find: ino: %#llx layer %d ndx %d: blockTbl 0x%x bt[ndx] 0x%x\n",
 	       ino->uuid, layer, ndx, blockTable, blockTable[ndx]);
 
-    if (blockTable[ndx] == 0 && wantGrow != NO_GROW) {
+    if (blockTable[ndx] == 0
+        && wantGrow != NO_GROW && wantGrow != GROW_TABLE) {
       DEBUG(findpg)
 	kdprintf(KR_OSTREAM, "find: ino: %#llx layer %d ndx %d: grow leaf: 0x%x\n",
 		 ino->uuid, layer, ndx, blockTable[ndx]);
@@ -379,21 +486,250 @@ find_file_page(server_state *ss, ino_s *ino, f_size_t at, int wantGrow)
   return &blockTable[ndx];
 }
 
+/* Return the extent of ino containing file block blk, or NULL. */
+struct extent *
+find_extent(ino_s *ino, uint64_t blk)
+{
+  int i;
+
+  for (i = 0; i < ino->nExtents; i++) {
+    struct extent * ext = &ino->extents[i];
+    if (blk < ext->fileBlock)
+      break;
+    if (blk - ext->fileBlock < ext->nBlocks)
+      return ext;
+  }
+  return 0;
+}
+
+struct cursor *
+get_cursor(server_state *ss, ino_s *ino)
+{
+  struct cursor * cur = &ss->cursors[ino->id % NCURSORS];
+
+  if (cur->uuid != ino->uuid) {
+    cur->uuid = ino->uuid;
+    cur->nextAt = 0;
+    cur->leaf = 0;
+    cur->raNext = 0;
+  }
+  return cur;
+}
+
+/* Like find_file_page, but uses and maintains the cached leaf table
+   in cur. */
+uint32_t **
+translate(server_state *ss, ino_s *ino, struct cursor *cur,
+          f_size_t at, int wantGrow)
+{
+  uint64_t atPg = at / BLOCK_SIZE;
+  uint32_t **ppPage;
+
+  if (cur->leaf && cur->nLayer == ino->nLayer
+      && atPg - cur->leafBlk < PtrsPerBlock) {
+    ppPage = &cur->leaf[atPg - cur->leafBlk];
+    if (*ppPage || wantGrow == NO_GROW)
+      return *ppPage ? ppPage : 0;
+    /* Let find_file_page allocate the leaf. */
+  }
+
+  ppPage = find_file_page(ss, ino, at, wantGrow);
+  if (ppPage && ino->nLayer > 0) {
+    cur->leafBlk = atPg - atPg % PtrsPerBlock;
+    cur->leaf = ppPage - atPg % PtrsPerBlock;
+    cur->nLayer = ino->nLayer;
+  }
+  return ppPage;
+}
+
+/* Note a transfer of len bytes at at. If the file is being accessed
+   sequentially and the reader is getting close to the end of what
+   has been read ahead, arrange to read ahead after replying. */
+void
+note_access(server_state *ss, ino_s *ino, struct cursor *cur,
+            f_size_t at, uint32_t len, bool isRead)
+{
+  bool sequential = (at == cur->nextAt);
+  uint64_t lastPg;
+
+  cur->nextAt = at + len;
+  if (! isRead || len == 0)
+    return;
+  if (! sequential) {
+    cur->raNext = 0;
+    return;
+  }
+
+  lastPg = (at + len - 1) / BLOCK_SIZE;
+  if (cur->raNext < lastPg + 1)
+    cur->raNext = lastPg + 1;
+  if (cur->raNext > lastPg + READAHEAD_BLOCKS / 2)
+    return;	// still well ahead of the reader
+
+  ss->raIno = ino;
+  ss->raFrom = cur->raNext;
+  ss->raTo = lastPg + 1 + READAHEAD_BLOCKS;
+  cur->raNext = ss->raTo;
+}
+
+/* Touch the blocks noted by note_access, so the kernel fetches
+   any that are not in memory. */
+void
+read_ahead(server_state *ss)
+{
+  ino_s * ino = ss->raIno;
+  struct cursor * cur = get_cursor(ss, ino);
+  uint64_t blk;
+
+  DEBUG(ra)
+    kprintf(KR_OSTREAM, "ra: ino %#llx blocks %#llx to %#llx\n",
+            ino->uuid, ss->raFrom, ss->raTo);
+
+  for (blk = ss->raFrom; blk < ss->raTo; blk++) {
+    f_size_t at = blk * BLOCK_SIZE;
+    struct extent * ext;
+    volatile uint8_t * pPage;
+
+    if (at >= ino->u.sz)
+      break;
+    ext = find_extent(ino, blk);
+    if (ext)
+      pPage = ext->addr + (blk - ext->fileBlock) * BLOCK_SIZE;
+    else {
+      uint32_t ** ppPage = translate(ss, ino, cur, at, NO_GROW);
+      if (! ppPage)
+        continue;	// a hole
+      pPage = (uint8_t *) *ppPage;
+    }
+    (void) *pPage;
+  }
+
+  ss->raIno = 0;
+}
+
+/* Try to allocate an extent for file blocks starting at atPg,
+   which has no block yet. nWant is the number of blocks the caller
+   is about to write; no more than that are allocated, so the block
+   tables record only blocks that have been written.
+   If the extent recorded just before atPg ends at top_addr,
+   it is extended in place (indirection blocks come from the other
+   end of the subspace, so they do not prevent this); otherwise, if
+   more than one block is wanted, a new extent is started.
+   Returns the extent, or NULL if none was allocated,
+   in which case the caller should allocate block by block. */
+struct extent *
+grow_extent(server_state *ss, ino_s *ino, uint64_t atPg, uint64_t nWant)
+{
+  struct extent * ext = 0;
+  uint32_t nBlocks;
+  uint32_t i;
+  int e;
+  uint8_t * addr;
+
+  /* Find where the new run goes in the (sorted) list. */
+  for (e = 0; e < ino->nExtents; e++)
+    if (ino->extents[e].fileBlock > atPg)
+      break;
+
+  if (e > 0) {
+    struct extent * prev = &ino->extents[e-1];
+    if (prev->fileBlock + prev->nBlocks == atPg
+        && prev->addr + prev->nBlocks * BLOCK_SIZE == ss->top_addr)
+      ext = prev;	// can extend prev in place
+  }
+
+  if (! ext && (nWant < 2 || ino->nExtents == INO_NEXTENTS))
+    return 0;
+
+  if (atPg + nWant > UINT_MAX)
+    return 0;	// fileBlock won't fit
+
+  /* Don't run into blocks that are already allocated. */
+  for (nBlocks = 1; nBlocks < nWant; nBlocks++) {
+    uint32_t ** ppPage = find_file_page(ss, ino,
+                           (atPg + nBlocks) * BLOCK_SIZE, NO_GROW);
+    if (ppPage && *ppPage)
+      break;
+  }
+
+  addr = AllocExtent(ss, nBlocks);
+  if (addr == 0)
+    return 0;
+
+  if (! ext) {
+    memmove(&ino->extents[e+1], &ino->extents[e],
+            (ino->nExtents - e) * sizeof(struct extent));
+    ext = &ino->extents[e];
+    ext->fileBlock = atPg;
+    ext->nBlocks = 0;
+    ext->addr = addr;
+    ino->nExtents++;
+  }
+  assert(addr == ext->addr + ext->nBlocks * BLOCK_SIZE);
+
+  /* Enter the blocks in the block tables. */
+  for (i = 0; i < nBlocks; i++) {
+    uint32_t ** ppPage = find_file_page(ss, ino,
+                           (atPg + i) * BLOCK_SIZE, GROW_TABLE);
+    *ppPage = (uint32_t *) (addr + i * BLOCK_SIZE);
+  }
+  ext->nBlocks += nBlocks;
+
+  DEBUG(alloc)
+    kdprintf(KR_OSTREAM, "ino %#llx extent at block %d now %d blocks\n",
+             ino->uuid, ext->fileBlock, ext->nBlocks);
+
+  return ext;
+}
+
 /* Write /len/ bytes of data from /buf/ into /file/, starting at
    position /at/.  Extends the file as necessary. */
 result_t
 write_to_file(server_state *ss, ino_s *ino, f_size_t at,
 	      uint32_t len, uint8_t *buf)
 {
+  struct cursor * cur = get_cursor(ss, ino);
+
   DEBUG(write)
     kdprintf(KR_OSTREAM, "write: ino: %#llx writing %d at "PS_FSIZE"\n",
 	    ino->uuid, len, at);
 
+  note_access(ss, ino, cur, at, len, false);
+
   /* The passed /buf/ is contiguous, but there is no guarantee that
      the file itself is. */
   while (len) {
     uint32_t offset = at & (BLOCK_SIZE - 1);
     uint32_t nBytes = BLOCK_SIZE - offset;
+    uint64_t atPg = at / BLOCK_SIZE;
+    struct extent * ext = find_extent(ino, atPg);
+    uint32_t ** ppPage = 0;
+
+    if (! ext) {
+      ppPage = translate(ss, ino, cur, at, NO_GROW);
+      if (! ppPage || ! *ppPage) {
+        ppPage = 0;
+        ext = grow_extent(ss, ino, atPg,
+                (offset + len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+      }
+    }
+    if (ext) {
+      /* Copy as much as the extent holds in one go. */
+      uint64_t extOffset = at - (uint64_t)ext->fileBlock * BLOCK_SIZE;
+      nBytes = min(len, (uint64_t)ext->nBlocks * BLOCK_SIZE - extOffset);
+
+      memcpy(ext->addr + extOffset, buf, nBytes);
+
+      DEBUG(write)
+	kdprintf(KR_OSTREAM,
+                 "write: ino: %#llx ewrote %d at "PS_FSIZE" to %#x\n",
+		 ino->uuid, nBytes, at, ext->addr + extOffset);
+
+      len -= nBytes;
+      at += nBytes;
+      buf += nBytes;
+      continue;
+    }
 
     if (nBytes > len)
       nBytes = len;
@@ -406,7 +742,8 @@ write_to_file(server_state *ss, ino_s *ino, f_size_t at,
       uint32_t grow =
 	(offset == 0 && nBytes == BLOCK_SIZE) ? GROW_NOZERO : GROW;
       
-      uint32_t **ppPage = find_file_page(ss, ino, at, grow);
+      if (! ppPage)
+        ppPage = translate(ss, ino, cur, at, grow);
       uint8_t *pPage = (uint8_t *) *ppPage;
 
       memcpy(&pPage[offset], buf, nBytes);
@@ -436,6 +773,7 @@ read_from_file(server_state *ss, ino_s *ino, f_size_t at,
 	       uint32_t *rqLen, uint8_t *buf)
 {
   uint32_t len = *rqLen;
+  struct cursor * cur = get_cursor(ss, ino);
   
   DEBUG(read)
     kdprintf(KR_OSTREAM, "read: ino: %#llx reading %d at "PS_FSIZE"\n",
@@ -453,17 +791,33 @@ read_from_file(server_state *ss, ino_s *ino, f_size_t at,
 	       ino->uuid, len, at);
   }
   
+  note_access(ss, ino, cur, at, len, true);
+
   /* The passed /buf/ is contiguous, but there is no guarantee that
      the file itself is. */
   while (len) {
     uint32_t offset = at & (BLOCK_SIZE - 1);
     uint32_t nBytes = BLOCK_SIZE - offset;
+    struct extent * ext = find_extent(ino, at / BLOCK_SIZE);
+
+    if (ext) {
+      /* Copy as much as the extent holds in one go. */
+      uint64_t extOffset = at - (uint64_t)ext->fileBlock * BLOCK_SIZE;
+      nBytes = min(len, (uint64_t)ext->nBlocks * BLOCK_SIZE - extOffset);
+
+      memcpy(buf, ext->addr + extOffset, nBytes);
+
+      len -= nBytes;
+      at += nBytes;
+      buf += nBytes;
+      continue;
+    }
 
     if (nBytes > len)
       nBytes = len;
 
     {
-      uint32_t **ppPage = find_file_page(ss, ino, at, NO_GROW);
+      uint32_t **ppPage = translate(ss, ino, cur, at, NO_GROW);
 
       if (ppPage == 0) {
 	DEBUG(read)
@@ -564,6 +918,9 @@ create_new_file(server_state *ss, ino_s** outFile)
   }
   ino->u.sz = 0;
   ino->nLayer = 0;
+  ino->nExtents = 0;
+  ino->mapBlocks = 0;
+  ino->mapHole = UINT_MAX;
   ino->uuid = ss->nxt_uuid;
   ss->nxt_uuid++;
   
@@ -606,11 +963,175 @@ destroy_file(server_state *ss, ino_s *ino)
     reclaim_ino_pages(ss, ino->nLayer, ino->indir[i]);
     ino->indir[i] = 0;
   }
+  /* The blocks of the extents were freed individually above. */
+  ino->nExtents = 0;
+
+  struct cursor * cur = &ss->cursors[ino->id % NCURSORS];
+  if (cur->uuid == ino->uuid)
+    cur->uuid = 0;
+  if (ss->raIno == ino)
+    ss->raIno = 0;
 
   ino->u.nxt_free = ss->first_free_inode;
   ss->first_free_inode = ino;
 }
 
+/* A file's map (see File.getMap) is a tree of GPTs with l2v
+EROS_PAGE_LGSIZE at the leaves, each level covering capros_GPT_nSlots
+times as much as the level below. Each leaf slot holds a read-only
+background window onto the block in the storage subspace, and the
+root has the storage segment as its background.  Only the root has
+a background, so only the root gives up its background and keeper
+slots: the root uses slots 0 through capros_GPT_backgroundSlot - 1
+and every other GPT in the map uses all capros_GPT_nSlots slots.
+
+The GPTs are bought from a sub-bank, so destroying the sub-bank
+rescinds every key to the map.  The sub-bank and the root are kept
+in slots of the file's read-only forwarder.  ino->mapBlocks is the
+number of blocks the map covers; the map is extended as the file
+grows.  Mapping allocates no file storage: the slot of a hole is
+left void, and ino->mapHole is the first such slot, from which the
+next map_file looks again, in case the hole has since been written.
+
+The key returned is opaque as well as read-only.  A non-opaque key
+would let the client fetch the slots, including the root's
+background, which is the whole storage subspace. */
+#define fwdr_mapBankSlot 0	// in the read-only forwarder
+#define fwdr_mapRootSlot 1	// in the read-only forwarder
+
+bool
+key_is_void(cap_t k)
+{
+  uint32_t type;
+  return capros_key_getType(k, &type) == RC_capros_key_Void;
+}
+
+/* Buy a GPT with the given l2v from the map's bank into kr. */
+result_t
+alloc_map_GPT(cap_t kr, unsigned int l2v)
+{
+  result_t result = capros_SpaceBank_alloc1(KR_MAPBANK, capros_Range_otGPT,
+                                            kr);
+  if (result != RC_OK)
+    return result;
+  return capros_GPT_setL2v(kr, l2v);
+}
+
+/* Make the map of ino cover the whole file.
+   roFwdr is the file's read-only forwarder.
+   On success, returns a read-only key to the map in KR_TEMP0. */
+result_t
+map_file(server_state *ss, ino_s *ino, cap_t roFwdr)
+{
+  result_t result;
+  uint64_t nBlocks = (ino->u.sz + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  uint8_t l2v;		// of the root
+  uint32_t blk;
+  uint32_t leafNum = UINT_MAX;	// number of the leaf in KR_MAPLEAF
+
+  if (nBlocks > UINT_MAX)
+    return RC_capros_key_RequestError;
+
+  /* The storage segment, for backgrounds: */
+  capros_GPT_getSlot(KR_MYSPACE, 1, KR_SCRATCH);
+  capros_Memory_reduce(KR_SCRATCH, capros_Memory_readOnly, KR_SCRATCH);
+
+  capros_Forwarder_getSlot(roFwdr, fwdr_mapBankSlot, KR_MAPBANK);
+  if (key_is_void(KR_MAPBANK)) {
+    /* First map of this file. */
+    result = capros_SpaceBank_createSubBank(KR_BANK, KR_MAPBANK);
+    if (result != RC_OK)
+      return result;
+    result = alloc_map_GPT(KR_MAPROOT, EROS_PAGE_LGSIZE);
+    if (result != RC_OK) {
+      capros_SpaceBank_destroyBankAndSpace(KR_MAPBANK);
+      return result;
+    }
+    capros_GPT_setBackground(KR_MAPROOT, KR_SCRATCH);
+    capros_Forwarder_swapSlot(roFwdr, fwdr_mapBankSlot, KR_MAPBANK, KR_VOID);
+    capros_Forwarder_swapSlot(roFwdr, fwdr_mapRootSlot, KR_MAPROOT, KR_VOID);
+    ino->mapBlocks = 0;
+    ino->mapHole = UINT_MAX;
+  } else
+    capros_Forwarder_getSlot(roFwdr, fwdr_mapRootSlot, KR_MAPROOT);
+
+  /* Add levels at the top until the last block falls below the
+  root's background slot. */
+  capros_GPT_getL2v(KR_MAPROOT, &l2v);
+  while (nBlocks
+         && ((nBlocks * BLOCK_SIZE - 1) >> l2v) >= capros_GPT_backgroundSlot) {
+    l2v += capros_GPT_l2nSlots;
+    result = alloc_map_GPT(KR_MAPLEAF, l2v);
+    if (result != RC_OK)
+      return result;
+    /* The old root becomes an interior GPT with all its slots usable. */
+    capros_GPT_clearBackground(KR_MAPROOT);
+    capros_GPT_setSlot(KR_MAPLEAF, 0, KR_MAPROOT);
+    capros_GPT_setBackground(KR_MAPLEAF, KR_SCRATCH);
+    COPY_KEYREG(KR_MAPLEAF, KR_MAPROOT);
+    capros_Forwarder_swapSlot(roFwdr, fwdr_mapRootSlot, KR_MAPROOT, KR_VOID);
+  }
+
+  DEBUG(map)
+    kprintf(KR_OSTREAM, "map: ino %#llx blocks %d to %d, root l2v %d\n",
+            ino->uuid, ino->mapBlocks, (uint32_t)nBlocks, l2v);
+
+  blk = min(ino->mapBlocks, ino->mapHole);
+  ino->mapHole = UINT_MAX;
+  for (; blk < nBlocks; blk++) {
+    f_size_t at = (f_size_t)blk * BLOCK_SIZE;
+    struct extent * ext = find_extent(ino, blk);
+    uint8_t * pPage = NULL;
+
+    if (ext)
+      pPage = ext->addr + (blk - ext->fileBlock) * BLOCK_SIZE;
+    else {
+      uint32_t ** ppPage = find_file_page(ss, ino, at, NO_GROW);
+      if (ppPage)
+        pPage = (uint8_t *) *ppPage;	// NULL for a hole
+    }
+
+    if ((blk >> capros_GPT_l2nSlots) != leafNum) {
+      /* Walk down from the root to the leaf, growing the tree. */
+      uint8_t lvl;
+
+      leafNum = blk >> capros_GPT_l2nSlots;
+      COPY_KEYREG(KR_MAPROOT, KR_MAPLEAF);
+      for (lvl = l2v; lvl > EROS_PAGE_LGSIZE; lvl -= capros_GPT_l2nSlots) {
+        unsigned int slot = (at >> lvl) & (capros_GPT_nSlots - 1);
+
+        capros_GPT_getSlot(KR_MAPLEAF, slot, KR_TEMP1);
+        if (key_is_void(KR_TEMP1)) {
+          result = alloc_map_GPT(KR_TEMP1, lvl - capros_GPT_l2nSlots);
+          if (result != RC_OK)
+            return result;
+          capros_GPT_setSlot(KR_MAPLEAF, slot, KR_TEMP1);
+        }
+        COPY_KEYREG(KR_TEMP1, KR_MAPLEAF);
+      }
+    }
+
+    if (pPage)
+      result = capros_GPT_setWindow(KR_MAPLEAF,
+                 blk & (capros_GPT_nSlots - 1), capros_GPT_windowBaseSlot,
+                 capros_Memory_readOnly,
+                 pPage - (uint8_t *) (1ul << SUBSPACE_LGSIZE));
+    else {
+      result = capros_GPT_setSlot(KR_MAPLEAF,
+                 blk & (capros_GPT_nSlots - 1), KR_VOID);
+      if (ino->mapHole == UINT_MAX)
+        ino->mapHole = blk;
+    }
+    if (result != RC_OK)
+      return result;
+    if (blk >= ino->mapBlocks)
+      ino->mapBlocks = blk + 1;
+  }
+
+  return capros_Memory_reduce(KR_MAPROOT,
+           capros_Memory_readOnly | capros_Memory_opaque, KR_TEMP0);
+}
+
 int
 ProcessRequest(Message *msg, server_state *ss)
 {
@@ -711,6 +1232,12 @@ ProcessRequest(Message *msg, server_state *ss)
   
       // Rescind and free the forwarders:
       capros_Forwarder_getSlot(KR_CURFILE, fwdr_roSlot, KR_TEMP0);
+
+      // Rescind the map, if any:
+      capros_Forwarder_getSlot(KR_TEMP0, fwdr_mapBankSlot, KR_MAPBANK);
+      if (! key_is_void(KR_MAPBANK))
+        capros_SpaceBank_destroyBankAndSpace(KR_MAPBANK);
+
       result_t rez = capros_SpaceBank_free2(KR_BANK, KR_CURFILE, KR_TEMP0);
       if (rez != RC_OK)
         kdprintf(KR_OSTREAM, "NFILE: free(fwdr) returned %#x\n", rez);
@@ -772,6 +1299,29 @@ ProcessRequest(Message *msg, server_state *ss)
       break;
     }
 
+    case OC_capros_File_getMap:
+    {
+      cap_t roFwdr;
+      if (msg->rcv_keyInfo & keyInfo_readOnly) {
+        roFwdr = KR_CURFILE;	// non-opaque key to read-only forwarder
+      } else {
+        capros_Forwarder_getSlot(KR_CURFILE, fwdr_roSlot, KR_TEMP1);
+        roFwdr = KR_TEMP1;
+      }
+
+      DEBUG(req)
+	kdprintf(KR_OSTREAM, "NFILE: ino %#llx getMap\n", ino->uuid);
+
+      result = map_file(ss, ino, roFwdr);
+      if (result != RC_OK)
+        break;
+
+      msg->snd_w1 = (uint32_t) ino->u.sz;
+      msg->snd_w2 = ino->u.sz >> 32;
+      msg->snd_key0 = KR_TEMP0;
+      break;
+    }
+
     case 2:	// OC_capros_HTTPResource_request
       result = capros_Forwarder_getOpaqueForwarder(KR_CURFILE,
                  capros_Forwarder_sendCap, KR_TEMP0);
@@ -823,6 +1373,12 @@ main()
   msg.rcv_limit = BUF_SZ;
 
   do {
+    if (ss.raIno) {
+      /* Reply now, and read ahead while the client works on the data. */
+      SEND(&msg);
+      read_ahead(&ss);
+      msg.snd_invKey = KR_VOID;
+    }
     RETURN(&msg);
     msg.snd_len = 0;	/* unless it's a read, in which case
 			   ProcessRequest() will reset this. */
@@ -23,19 +23,49 @@
 Research Projects Agency under Contract No. W31P4Q-07-C-0070.
 Approved for public release, distribution unlimited. */
 
-/* Pipe -- limited size buffering object for unidirection streams.
-
-   This version assumes single writer/single reader.  Multi
-   reader/writer variants will come later. */
+/* Pipe -- limited size buffering object for unidirectional streams.
+
+   Any number of readers and writers may share a pipe.  A client that
+   cannot proceed is queued, its resume key held in a supernode, and
+   clients on each queue are woken in the order they arrived.
+
+   A write of at most PIPE_ATOMIC_SZ bytes is atomic: either all of it
+   is accepted or none of it is, and in the latter case the writer is
+   queued until there is room.  Longer writes may be accepted in
+   pieces.
+
+   A queued writer is woken with an acknowledgement of zero bytes and
+   a ticket in w2.  It resends its data with the ticket in w3.  While
+   a ticket is outstanding, or while writers are queued, a write
+   without that ticket is queued behind them, so a newcomer cannot
+   overtake a writer that has been waiting.  Free space cannot shrink
+   while a ticket is outstanding, so the resent write will fit.
+
+   A woken writer may never resend.  So that it cannot wedge the pipe,
+   it is passed over if, once a reader has taken data since it was
+   woken, the next queued writer could proceed: that writer is woken
+   instead.  Tickets are issued in arrival order, so a writer that
+   comes back with a ticket it was passed over with is queued in
+   ticket order, ahead of everyone who arrived after it, and keeps
+   its place.
+
+   Since keys can be copied, the pipe counts the holders of reader and
+   writer keys.  A holder that hands a copy of its key to another
+   process first calls OC_Pipe_AddRef.  Readers see EOF once every
+   writer has closed, and the pipe is destroyed once every reader has
+   closed. */
 
 #include <stddef.h>
+#include <string.h>
 #include <eros/target.h>
 #include <eros/Invoke.h>
 #include <eros/cap-instr.h>
 
 #include <idl/capros/key.h>
 #include <idl/capros/Node.h>
+#include <idl/capros/SuperNode.h>
 #include <idl/capros/Process.h>
+#include <idl/capros/Constructor.h>
 
 #include <domain/Runtime.h>
 #include <domain/domdbg.h>
@@ -62,200 +92,294 @@ Approved for public release, distribution unlimited. */
 #ifdef ALIGNED
 const uint32_t __rt_stack_pages = 1;
 #else
-const uint32_t __rt_stack_pages = (PIPE_BUF_SZ/EROS_PAGE_SIZE)+1;
+const uint32_t __rt_stack_pages = (PIPE_BUF_SZ/EROS_PAGE_SIZE)+2;
 #endif
 
+/* A client waiting on the pipe. Its resume key is in the supernode. */
+struct waiter {
+  uint32_t len;		/* reader: bytes wanted; writer: room needed */
+  uint32_t ticket;	/* writer only */
+};
+
+/* A FIFO of waiters, occupying PIPE_MAX_WAITERS consecutive
+   supernode slots starting at firstSlot. */
+struct waitq {
+  uint32_t firstSlot;
+  uint32_t head;		/* index of the oldest waiter */
+  uint32_t count;
+  struct waiter w[PIPE_MAX_WAITERS];
+};
+
 struct pipe_state {
   char     buf[PIPE_BUF_SZ];
   uint32_t start;
   uint32_t end;
-  uint32_t sleepSlot;
-  uint32_t sleep;
-  uint32_t wrReqLen;
-  uint32_t rdReqLen;
-  uint32_t wClosed;
+  struct waitq readers;
+  struct waitq writers;
+  uint32_t grant;		/* ticket of the writer we woke, or 0 */
+  bool grantPassed;		/* a reader has taken data since then */
+  uint32_t nextTicket;
+  uint32_t nReaders;		/* holders of reader keys */
+  uint32_t nWriters;		/* holders of writer keys that are open */
   uint32_t nWakeWriter;
   uint32_t nWakeReader;
 };
 typedef struct pipe_state pipe_state;
 
-/* Size of pipe buffer is chosen to guarantee that only one of the
-   following can be true. */
-#define SL_NONE    0		/* no one is sleeping */
-#define SL_WRITER  1		/* writer is sleeping */
-#define SL_READER  2		/* reader is sleeping */
-
-#define KR_CLIENT0     KR_APP(0)	/* Client can be either reader or */
-#define KR_CLIENT1     KR_APP(1)	/* writer; it ping pongs. */
+#define KR_CLIENT0     KR_APP(0)
+#define KR_CLIENT1     KR_APP(1)
 #define KR_OSTREAM     KR_APP(2)
+#define KR_SNODE       KR_APP(3)	/* resume keys of waiting clients */
 
 #define KI_READER      1
 #define KI_WRITER      2
 
-void
-teardown(uint32_t caller)
+/* Tickets are compared modulo 2**32. */
+static inline bool
+TicketBefore(uint32_t a, uint32_t b)
 {
-  COPY_KEYREG(caller, KR_RETURN);
-  
-  /* Wake up both clients as needed: */
-  
-  /* get the protospace */
-  capros_Node_getSlot(KR_CONSTIT, KC_PROTOSPC, KR_CLIENT0);
-
-  /* destroy as small space. */
-  protospace_destroy_small(KR_CLIENT0, RC_OK);
-  /* NOTREACHED */
+  return (int32_t)(a - b) < 0;
 }
 
-pipe_state *
-InitPipe(pipe_state *ps)
+/* Queue the caller, whose resume key is in KR_RETURN.  Readers have
+   no ticket and go at the tail; writers go in ticket order, which is
+   the tail unless the writer was passed over.
+   Returns false if the queue is full. */
+bool
+Enqueue(struct waitq *q, uint32_t len, uint32_t ticket)
 {
-  ps->start = 0;
-  ps->end = 0;
-  ps->sleep = SL_NONE;
-  ps->sleepSlot = 0;
-  ps->wClosed = 0;
-  ps->nWakeReader = 0;
-  ps->nWakeWriter = 0;
-  return ps;
+  uint32_t pos;
+  uint32_t j;
+  uint32_t ndx;
+
+  if (q->count == PIPE_MAX_WAITERS)
+    return false;
+
+  for (pos = q->count; pos > 0; pos--) {
+    ndx = (q->head + pos - 1) % PIPE_MAX_WAITERS;
+    if (! ticket || ! TicketBefore(ticket, q->w[ndx].ticket))
+      break;
+  }
+
+  /* Move the waiters after pos back one place. */
+  for (j = q->count; j > pos; j--) {
+    uint32_t to = (q->head + j) % PIPE_MAX_WAITERS;
+    uint32_t from = (q->head + j - 1) % PIPE_MAX_WAITERS;
+
+    capros_Node_getSlotExtended(KR_SNODE, q->firstSlot + from, KR_TEMP0);
+    capros_Node_swapSlotExtended(KR_SNODE, q->firstSlot + to,
+                                 KR_TEMP0, KR_VOID);
+    q->w[to] = q->w[from];
+  }
+
+  ndx = (q->head + pos) % PIPE_MAX_WAITERS;
+  capros_Node_swapSlotExtended(KR_SNODE, q->firstSlot + ndx,
+                               KR_RETURN, KR_VOID);
+  q->w[ndx].len = len;
+  q->w[ndx].ticket = ticket;
+  q->count++;
+  return true;
 }
 
-uint32_t
-return_to_writer(Message *msg, pipe_state *ps)
+/* Remove the oldest waiter from a nonempty queue,
+   leaving its resume key in KR_TEMP0. */
+struct waiter *
+Dequeue(struct waitq *q)
 {
-  /* Place reader to sleep and return to the writer. */
+  struct waiter *w = &q->w[q->head];
 
-  uint32_t sleeper = ps->sleepSlot;
-  
-  ps->sleep = SL_READER;
-  ps->sleepSlot = msg->snd_invKey;
-  ps->rdReqLen = msg->rcv_w2;
-  ps->nWakeWriter++;
-
-  msg->snd_invKey = sleeper;
-  msg->snd_len = 0;
-  msg->snd_w1 = ps->wrReqLen;
-  return RC_OK;
+  capros_Node_getSlotExtended(KR_SNODE, q->firstSlot + q->head, KR_TEMP0);
+  q->head = (q->head + 1) % PIPE_MAX_WAITERS;
+  q->count--;
+  return w;
 }
 
-uint32_t
-return_to_reader(Message *msg, pipe_state *ps)
+/* Reply to the waiter whose resume key is in KR_TEMP0. */
+void
+SendToWaiter(uint32_t code, const void *data, uint32_t len,
+             uint32_t w1, uint32_t w2)
 {
-  /* Place reader to sleep and return to the writer. */
+  Message wakeMsg;
 
-  uint32_t sleeper = ps->sleepSlot;
-  uint32_t result = RC_OK;
-  uint32_t len = ps->end - ps->start;
-  
-  ps->sleep = SL_WRITER;
-  ps->sleepSlot = msg->snd_invKey;
-  ps->wrReqLen = msg->rcv_w2;
+  wakeMsg.snd_invKey = KR_TEMP0;
+  wakeMsg.snd_key0 = KR_VOID;
+  wakeMsg.snd_key1 = KR_VOID;
+  wakeMsg.snd_key2 = KR_VOID;
+  wakeMsg.snd_rsmkey = KR_VOID;
+  wakeMsg.snd_data = data;
+  wakeMsg.snd_len = len;
+  wakeMsg.snd_code = code;
+  wakeMsg.snd_w1 = w1;
+  wakeMsg.snd_w2 = w2;
+  wakeMsg.snd_w3 = 0;
 
-  if (len > ps->rdReqLen)
-    len = ps->rdReqLen;
+  SEND(&wakeMsg);
+}
 
-  if (len > PIPE_BUF_SZ)
-    len = PIPE_BUF_SZ;
+/* Hand buffered data to waiting readers, oldest first.
+   Once all writers have closed, every waiting reader is woken,
+   with EOF if there is nothing left for it. */
+void
+WakeReaders(pipe_state *ps)
+{
+  while (ps->readers.count) {
+    uint32_t len = ps->end - ps->start;
+    uint32_t code = RC_OK;
+    struct waiter *w;
+
+    if (len == 0 && ps->nWriters)
+      break;
 
-  msg->snd_invKey = sleeper;
-  msg->snd_data = &ps->buf[ps->start];
-  msg->snd_len = len;
+    w = Dequeue(&ps->readers);
+    if (len > w->len)
+      len = w->len;
 
-  msg->snd_w1 = ps->rdReqLen;	/* ?? */
+    ps->start += len;
+    if (ps->nWriters == 0 && ps->start == ps->end) {
+      code = RC_EOF;
+      DEBUG(eof)
+	kprintf(KR_OSTREAM, "Send EOF to reader when waking\n");
+    }
 
-  ps->start += len;
-  ps->nWakeReader++;
+    DEBUG(sleep)
+      kprintf(KR_OSTREAM, "pipe wakes reader sending %d\n", len);
 
-  if (ps->wClosed && (ps->start == ps->end))
-    result = RC_EOF;
+    ps->nWakeReader++;
+    SendToWaiter(code, &ps->buf[ps->start - len], len, len, 0);
+  }
 
   if (ps->start == ps->end)
     ps->start = ps->end = 0;
-
-  return result;
 }
 
+/* If the oldest waiting writer would now fit, wake it with its ticket.
+   Only one writer is woken at a time; the next is considered when
+   the woken one has resent, or when it is passed over. */
 void
-wake_writer(pipe_state *ps)
+WakeWriter(pipe_state *ps)
 {
-  Message wakeMsg;
+  struct waiter *w;
+
+  if (ps->writers.count == 0)
+    return;
+
+  if (ps->writers.w[ps->writers.head].len > PIPE_BUF_SZ - ps->end)
+    return;
+
+  if (ps->grant) {
+    if (! ps->grantPassed)
+      return;
+
+    /* The writer we woke has not resent, although a reader has taken
+       data since and the next writer could proceed.  Pass it over;
+       if it comes back, it is queued by its ticket. */
+    DEBUG(sleep)
+      kprintf(KR_OSTREAM, "pipe passes over ticket %d\n", ps->grant);
+  }
+
+  w = Dequeue(&ps->writers);
+  ps->grant = w->ticket;
+  ps->grantPassed = false;
 
   DEBUG(sleep)
-    kprintf(KR_OSTREAM, "pipe wakes writer saying %d\n", ps->wrReqLen);
+    kprintf(KR_OSTREAM, "pipe wakes writer with ticket %d\n", ps->grant);
 
+  ps->nWakeWriter++;
   /* Tell writer that we accepted no data so they will resend */
-  wakeMsg.snd_invKey = ps->sleepSlot; /* if sleeping, always this KR */
-  wakeMsg.snd_key0 = KR_VOID;
-  wakeMsg.snd_key1 = KR_VOID;
-  wakeMsg.snd_key2 = KR_VOID;
-  wakeMsg.snd_rsmkey = KR_VOID;
-  wakeMsg.snd_data = 0;
-  wakeMsg.snd_len = 0;
-  wakeMsg.snd_code = RC_OK;
-  wakeMsg.snd_w1 = ps->wrReqLen;
-  wakeMsg.snd_w2 = 0;
-  wakeMsg.snd_w3 = 0;
+  SendToWaiter(RC_OK, 0, 0, 0, ps->grant);
+}
 
-  ps->nWakeWriter++;
-  
-  SEND(&wakeMsg);
+/* Move the buffered data to the front of the buffer, if that is needed
+   to make room for an atomic write.  Must not be called while a reply
+   referencing the buffer is pending. */
+void
+Compact(pipe_state *ps)
+{
+  if (ps->start == 0 || PIPE_BUF_SZ - ps->end >= PIPE_ATOMIC_SZ)
+    return;
 
-  ps->sleep = SL_NONE;
-  ps->sleepSlot = KR_VOID;
+  memmove(ps->buf, &ps->buf[ps->start], ps->end - ps->start);
+  ps->end -= ps->start;
+  ps->start = 0;
 }
-    
+
+/* Wake every waiting client with RC_EOF. */
 void
-wake_reader(pipe_state *ps)
+WakeAll(pipe_state *ps)
 {
-  Message wakeMsg;
-  uint32_t len = ps->end - ps->start;
-
-  if (len > ps->rdReqLen)
-    len = ps->rdReqLen;
+  while (ps->readers.count) {
+    (void) Dequeue(&ps->readers);
+    SendToWaiter(RC_EOF, 0, 0, 0, 0);
+  }
+  while (ps->writers.count) {
+    (void) Dequeue(&ps->writers);
+    SendToWaiter(RC_EOF, 0, 0, 0, 0);
+  }
+}
 
-  if (len > PIPE_BUF_SZ)
-    len = PIPE_BUF_SZ;
+void
+teardown(uint32_t caller)
+{
+  COPY_KEYREG(caller, KR_RETURN);
+  
+  capros_key_destroy(KR_SNODE);
 
-  wakeMsg.snd_invKey = ps->sleepSlot; /* if sleeping, always this KR */
-  wakeMsg.snd_key0 = KR_VOID;
-  wakeMsg.snd_key1 = KR_VOID;
-  wakeMsg.snd_key2 = KR_VOID;
-  wakeMsg.snd_rsmkey = KR_VOID;
-  wakeMsg.snd_data = &ps->buf[ps->start];
-  wakeMsg.snd_len = len;
-  wakeMsg.snd_code = RC_OK;
-  wakeMsg.snd_w1 = 0;
-  wakeMsg.snd_w2 = 0;
-  wakeMsg.snd_w3 = 0;
+  /* get the protospace */
+  capros_Node_getSlot(KR_CONSTIT, KC_PROTOSPC, KR_CLIENT0);
 
-  ps->start += len;
+  /* destroy as small space. */
+  protospace_destroy_small(KR_CLIENT0, RC_OK);
+  /* NOTREACHED */
+}
 
-  if (ps->wClosed && (ps->start == ps->end)) {
-    wakeMsg.snd_code = RC_EOF;
-    DEBUG(eof)
-      kprintf(KR_OSTREAM, "Send EOF to reader when waking\n");
-  }
-  
-  DEBUG(sleep)
-    kprintf(KR_OSTREAM, "pipe wakes reader sending %d\n", len);
+pipe_state *
+InitPipe(pipe_state *ps)
+{
+  ps->start = 0;
+  ps->end = 0;
+  ps->readers.firstSlot = 0;
+  ps->readers.head = 0;
+  ps->readers.count = 0;
+  ps->writers.firstSlot = PIPE_MAX_WAITERS;
+  ps->writers.head = 0;
+  ps->writers.count = 0;
+  ps->grant = 0;
+  ps->grantPassed = false;
+  ps->nextTicket = 1;
+  ps->nReaders = 1;
+  ps->nWriters = 1;
+  ps->nWakeReader = 0;
+  ps->nWakeWriter = 0;
+  return ps;
+}
 
-  ps->nWakeReader++;
+/* Queue a writer that sent sent bytes, none of which were accepted.
+   ticket is the one it already holds, or zero to issue a new one. */
+uint32_t
+BlockWriter(Message *msg, pipe_state *ps, uint32_t sent, uint32_t ticket)
+{
+  uint32_t need = min(sent, PIPE_ATOMIC_SZ);
 
-  SEND(&wakeMsg);
+  if (!Enqueue(&ps->writers, need, ticket ? ticket : ps->nextTicket))
+    return RC_Pipe_Full;
 
-  ps->sleep = SL_NONE;
-  ps->sleepSlot = KR_VOID;
+  DEBUG(sleep)
+    kprintf(KR_OSTREAM, "pipe blocks writer needing %d\n", need);
 
-  if (ps->start == ps->end)
-    ps->start = ps->end = 0;
+  if (! ticket && ++ps->nextTicket == 0)
+    ps->nextTicket = 1;		/* zero means no ticket */
+  msg->snd_invKey = KR_VOID;
+  return RC_OK;
 }
-    
+
 int
 ProcessRequest(Message *msg, pipe_state *ps)
 {
   uint32_t result = RC_OK;
   uint32_t code = msg->rcv_code;
   fixreg_t got = min(msg->rcv_limit, msg->rcv_sent);
+  msg->snd_len = 0;
+  msg->snd_w1 = 0;
   msg->snd_w2 = 0;
   msg->snd_w3 = 0;
 
@@ -269,12 +393,11 @@ ProcessRequest(Message *msg, pipe_state *ps)
     DEBUG(req)
       kprintf(KR_OSTREAM, "pipe accepts read of length %d\n", msg->rcv_w2);
 
+    /* Readers are only queued while the buffer is empty,
+       so if there is data no one is ahead of this reader. */
     if (ps->start != ps->end) {
       uint32_t xmit;
       
-      if (ps->sleep == SL_WRITER && ps->start == 0)
-	wake_writer(ps);
-    
       xmit = ps->end - ps->start;
       if (xmit > msg->rcv_w2)
 	xmit = msg->rcv_w2;
@@ -283,55 +406,36 @@ ProcessRequest(Message *msg, pipe_state *ps)
       
       msg->snd_len = xmit;
       msg->snd_data = ps->buf + ps->start;
+      msg->snd_w1 = xmit;
       ps->start += xmit;
 
-      if (ps->wClosed && (ps->start == ps->end)) {
+      /* If the writer we woke has still not resent, WakeWriter()
+	 may now pass it over. */
+      if (ps->grant)
+	ps->grantPassed = true;
+
+      if (ps->nWriters == 0 && (ps->start == ps->end)) {
 	result = RC_EOF;
 	DEBUG(eof)
 	  kprintf(KR_OSTREAM, "Send EOF to reader\n");
       }
     }
-    else if (ps->wClosed) {
-      if (ps->sleep == SL_WRITER && ps->start == 0)
-	wake_writer(ps);
-    
+    else if (ps->nWriters == 0) {
       result = RC_EOF;
       DEBUG(eof)
 	kprintf(KR_OSTREAM, "Send EOF to reader -- buffer empty\n");
-      msg->snd_len = 0;
     }
     else {
       /* buffer is empty -- go to sleep. */
-#if 0
-      if (ps->sleep == SL_WRITER && ps->start == 0)
-	wake_writer(ps);
-    
+      if (!Enqueue(&ps->readers, min(msg->rcv_w2, PIPE_BUF_SZ), 0)) {
+	result = RC_Pipe_Full;
+	break;
+      }
+
       DEBUG(sleep)
 	kprintf(KR_OSTREAM, "pipe blocks reader\n");
 
-      ps->rdReqLen = msg->rcv_w2;
-
-      ps->sleep = SL_READER;
-      ps->sleepSlot = msg->snd_invKey;
-      
       msg->snd_invKey = KR_VOID;
-      msg->snd_len = 0;
-#else
-      if (ps->sleep == SL_WRITER && ps->start == 0)
-	result = return_to_writer(msg, ps);
-      else {
-	DEBUG(sleep)
-	  kprintf(KR_OSTREAM, "pipe blocks reader\n");
-
-	ps->rdReqLen = msg->rcv_w2;
-
-	ps->sleep = SL_READER;
-	ps->sleepSlot = msg->snd_invKey;
-      
-	msg->snd_invKey = KR_VOID;
-	msg->snd_len = 0;
-      }
-#endif
     }
     
     if (ps->start == ps->end)
@@ -339,105 +443,90 @@ ProcessRequest(Message *msg, pipe_state *ps)
     break;
     
   case OC_Pipe_Write:
-    DEBUG(req)
-      kprintf(KR_OSTREAM, "pipe accepts write of length %d resid %d\n",
-	      got, msg->rcv_w2);
-
-    if (msg->rcv_keyInfo != KI_WRITER) {
-      result = RC_capros_key_UnknownRequest;
-      break;
-    }
+    {
+      uint32_t sent = msg->rcv_sent;
+      uint32_t ticket = msg->rcv_w3;
 
-    ps->end += got;
+      DEBUG(req)
+	kprintf(KR_OSTREAM, "pipe accepts write of length %d resid %d\n",
+		got, msg->rcv_w2);
 
-    if (ps->end == PIPE_BUF_SZ) {
-#if 1
-      /* If reader is sleeping, wake them up: */
-      if (ps->sleep == SL_READER &&
-	  (ps->wClosed ||
-	   ps->end == PIPE_BUF_SZ ||
-	   (ps->end - ps->start) >= ps->rdReqLen)) {
-	result = return_to_reader(msg, ps);
+      if (msg->rcv_keyInfo != KI_WRITER) {
+	result = RC_capros_key_UnknownRequest;
+	break;
       }
-      else {
-	DEBUG(sleep)
-	  kprintf(KR_OSTREAM, "pipe blocks writer\n");
-
-	/* This I/O cause a full pipe buffer.  Make note that we have it
-	   and put the writer to sleep. */
-	ps->sleep = SL_WRITER;
-	ps->sleepSlot = msg->snd_invKey;
 
-	msg->snd_invKey = KR_VOID;
-	msg->snd_len = 0;
-	ps->wrReqLen = got;
+      if (ticket && ticket == ps->grant)
+	ps->grant = 0;		/* the writer we woke is back */
+      else if (ticket && TicketBefore(ticket, ps->nextTicket)) {
+	/* A writer we passed over is back.  It goes ahead of
+	   everyone who arrived after it. */
+	if (ps->grant
+	    || (ps->writers.count
+		&& TicketBefore(ps->writers.w[ps->writers.head].ticket,
+				ticket))) {
+	  result = BlockWriter(msg, ps, sent, ticket);
+	  break;
+	}
       }
-#else
-      /* If reader is sleeping, wake them up: */
-      if (ps->sleep == SL_READER &&
-	  (ps->wClosed ||
-	   ps->end == PIPE_BUF_SZ ||
-	   (ps->end - ps->start) >= ps->rdReqLen)) {
-	wake_reader(ps);
+      else {
+	ticket = 0;		/* a newcomer */
+	if (ps->grant || ps->writers.count) {
+	  /* Others are waiting; go behind them. */
+	  result = BlockWriter(msg, ps, sent, ticket);
+	  break;
+	}
       }
-    
-      DEBUG(sleep)
-	kprintf(KR_OSTREAM, "pipe blocks writer\n");
 
-      /* This I/O cause a full pipe buffer.  Make note that we have it
-	 and put the writer to sleep. */
-      ps->sleep = SL_WRITER;
-      ps->sleepSlot = msg->snd_invKey;
-
-      msg->snd_invKey = KR_VOID;
-      msg->snd_len = 0;
-      ps->wrReqLen = got;
-#endif
-    }
-    else {
-      /* If reader is sleeping, wake them up: */
-      if (ps->sleep == SL_READER &&
-	  (ps->wClosed ||
-	   ps->end == PIPE_BUF_SZ ||
-	   (ps->end - ps->start) >= ps->rdReqLen)) {
-	wake_reader(ps);
+      if (got < sent && (sent <= PIPE_ATOMIC_SZ || got == 0)) {
+	/* An atomic write that does not fit, or no room at all. */
+	result = BlockWriter(msg, ps, sent, ticket);
+	break;
       }
 
+      ps->end += got;
+      WakeReaders(ps);
+
       DEBUG(ack)
 	kprintf(KR_OSTREAM, "pipe acks %d to  writer\n", got);
       msg->snd_w1 = got;
     }
-    
+    break;
+
+  case OC_Pipe_AddRef:
+    /* Once every writer has closed, readers have seen EOF;
+       the write side cannot be reopened. */
+    if (msg->rcv_keyInfo == KI_WRITER) {
+      if (ps->nWriters == 0)
+	result = RC_EOF;
+      else
+	ps->nWriters++;
+    }
+    else
+      ps->nReaders++;
     break;
 
   case OC_Pipe_Close:
     if (msg->rcv_keyInfo == KI_WRITER) {
-      /*       DEBUG(req) */
+      DEBUG(req)
 	kprintf(KR_OSTREAM, "pipe: writer closes\n");
-      ps->wClosed = 1;
-      msg->snd_len = 0;
-
-      /* If reader is sleeping, wake them up -- EVEN if there is
-	 no more to read. */
-      if (ps->sleep == SL_READER) {
-	wake_reader(ps);
-	ps->sleep = SL_NONE;
-	ps->sleepSlot = KR_VOID;
+
+      if (ps->nWriters && --ps->nWriters == 0) {
+	/* Wake all sleeping readers -- EVEN if there is
+	   no more to read. */
+	WakeReaders(ps);
       }
 
       /* MUST break here to prevent fall-through */
       break;
     }
 
-    if (ps->sleep == SL_WRITER) {
-      wake_writer(ps);
-      ps->sleep = SL_NONE;
-      ps->sleepSlot = KR_VOID;
-    }
-
     DEBUG(req)
       kprintf(KR_OSTREAM, "pipe: reader closes\n");
-    /* fall through is deliberate -- reader close means destroy! */
+
+    if (ps->nReaders && --ps->nReaders)
+      break;
+    /* fall through is deliberate -- last reader close means destroy! */
     
   case OC_capros_key_destroy:
     if (msg->rcv_keyInfo != KI_READER) {
@@ -448,6 +537,7 @@ ProcessRequest(Message *msg, pipe_state *ps)
     kprintf(KR_OSTREAM, "nWakeWriter: %u nWakeReader %u\n",
 	    ps->nWakeWriter, ps->nWakeReader);
 
+    WakeAll(ps);
     teardown(msg->snd_invKey);
     return 0; /* CAN'T HAPPEN */
     
@@ -456,6 +546,12 @@ ProcessRequest(Message *msg, pipe_state *ps)
     break;
   }
 
+  /* A reply carrying data points into the buffer,
+     so the buffer may only be rearranged when there is none. */
+  if (msg->snd_len == 0)
+    Compact(ps);
+  WakeWriter(ps);
+
   msg->snd_code = result;
   return 1;
 }
@@ -500,6 +596,19 @@ main(void)
   /* Initialization is not permitted to fail -- this would constitute
      an unrunnable system! */
   pps = InitPipe(&ps);
+
+  /* Buy the supernode that holds the resume keys of waiting clients: */
+  capros_Node_getSlot(KR_CONSTIT, KC_SNODEC, KR_SNODE);
+  result = capros_Constructor_request(KR_SNODE, KR_BANK, KR_SCHED, KR_VOID,
+                                      KR_SNODE);
+  if (result != RC_OK)
+    kdprintf(KR_OSTREAM, "Result from pipe cre supernode: 0x%x\n",
+	     result);
+  result = capros_SuperNode_allocateRange(KR_SNODE, 0,
+                                          2 * PIPE_MAX_WAITERS - 1);
+  if (result != RC_OK)
+    kdprintf(KR_OSTREAM, "Result from pipe alloc slots: 0x%x\n",
+	     result);
   
   /* Fabricate the reader and writer keys: */
   result = capros_Process_makeStartKey(KR_SELF, KI_WRITER, KR_CLIENT0);
@@ -518,7 +627,6 @@ main(void)
 
   msg.rcv_data = pps->buf;
   msg.rcv_limit = PIPE_BUF_SZ;
-  msg.rcv_rsmkey = KR_CLIENT0;
 
   DEBUG(init)
     kprintf(KR_OSTREAM, "init pipe: accept rsm key to %d\n",
@@ -532,15 +640,12 @@ main(void)
   msg.snd_rsmkey = KR_VOID;
   
   for(;;) {
-    /* Until somebody decides otherwise, we plan to return to the
-       client who calls us: */
-    msg.snd_invKey = msg.rcv_rsmkey;
+    /* We plan to return to the client who calls us, unless
+       ProcessRequest queues it: */
+    msg.snd_invKey = KR_RETURN;
 
-    (void) ProcessRequest(&msg, &ps);
+    (void) ProcessRequest(&msg, pps);
 
-    /* If, however, we have a sleeping client, we set things up to
-       accept the other side elsewhere: */
-    msg.rcv_rsmkey = (pps->sleepSlot == KR_CLIENT0) ? KR_CLIENT1 : KR_CLIENT0;
     msg.rcv_data = &pps->buf[pps->end];
     msg.rcv_limit = PIPE_BUF_SZ - pps->end;
 
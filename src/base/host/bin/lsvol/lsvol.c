@@ -29,6 +29,12 @@ const char* targname;
 int showdiv = 0;
 int showhdr = 0;
 int showckdir = 0;
+int showlogsum = 0;
+int showlogobj = 0;
+int showlogchg = 0;
+bool useLogIndex = true;
+OID logOid;
+uint64_t logFromGen, logToGen;
 
 int main(int argc, char *argv[])
 {
@@ -36,14 +42,13 @@ int main(int argc, char *argv[])
 
   int c;
   extern int optind;
-#if 0
   extern char *optarg;
-#endif
+  char *cp;
   int opterr = 0;
    
  app_Init("lsvol");
 
-  while ((c = getopt(argc, argv, "hdc")) != -1) {
+  while ((c = getopt(argc, argv, "hdcso:g:n")) != -1) {
     switch(c) {
     case 'd':
       showdiv = 1;
@@ -54,12 +59,38 @@ int main(int argc, char *argv[])
     case 'h':
       showhdr = 1;
       break;
+    case 's':
+      showlogsum = 1;
+      break;
+    case 'o':
+      showlogobj = 1;
+      logOid = strtoull(optarg, &cp, 0);
+      if (*cp)
+        opterr++;
+      break;
+    case 'g':
+      /* -g from:to lists the objects written after generation from,
+         through generation to. */
+      showlogchg = 1;
+      logFromGen = strtoull(optarg, &cp, 0);
+      if (*cp != ':')
+        opterr++;
+      else {
+        logToGen = strtoull(cp + 1, &cp, 0);
+        if (*cp)
+          opterr++;
+      }
+      break;
+    case 'n':
+      useLogIndex = false;
+      break;
     default:
       opterr++;
     }
   }
   
-  if (!showdiv && !showhdr && !showckdir)
+  if (!showdiv && !showhdr && !showckdir
+      && !showlogsum && !showlogobj && !showlogchg)
     showdiv = 1;
   
       /* remaining arguments describe node and/or page space divisions */
@@ -70,7 +101,8 @@ int main(int argc, char *argv[])
     opterr++;
   
   if (opterr)
-    diag_fatal(1, "Usage: lsvol [-h | -d | -r | -c ] file\n");
+    diag_fatal(1, "Usage: lsvol [-h | -d | -r | -c | -s | -o oid"
+               " | -g from:to ] [-n] file\n");
   
   targname = *argv;
   
@@ -90,6 +122,22 @@ int main(int argc, char *argv[])
     extern void PrintCkptDir(Volume*);
     PrintCkptDir(pVol);
   }
+
+  if (showlogsum) {
+    extern void PrintLogSummary(Volume*, const char*, bool);
+    PrintLogSummary(pVol, targname, useLogIndex);
+  }
+
+  if (showlogobj) {
+    extern void PrintLogObject(Volume*, const char*, bool, OID);
+    PrintLogObject(pVol, targname, useLogIndex, logOid);
+  }
+
+  if (showlogchg) {
+    extern void PrintLogChanges(Volume*, const char*, bool,
+                                uint64_t, uint64_t);
+    PrintLogChanges(pVol, targname, useLogIndex, logFromGen, logToGen);
+  }
   
   vol_Close(pVol);
   free(pVol);
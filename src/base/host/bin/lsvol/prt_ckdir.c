@@ -23,12 +23,16 @@
 Research Projects Agency under Contract No. W31P4Q-07-C-0070.
 Approved for public release, distribution unlimited. */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <disk/GenerationHdr.h>
 #include <erosimg/App.h>
 #include <erosimg/Volume.h>
 #include <disk/TagPot.h>
 #include <disk/CkptRoot.h>
+#include <idl/capros/Range.h>
 
 static void
 showProcs(uint8_t * p, unsigned int num)
@@ -77,7 +81,8 @@ PrintCkptDir(Volume* pVol)
   showProcs(pagep + sizeof(DiskGenerationHdr), numDescrs);
 
   LID dirLID = get_target_lid(&genHdr->processDir.firstDirFrame);
-  for (i = genHdr->processDir.nDirFrames; i-- > 0; dirLID++) {
+  for (i = genHdr->processDir.nDirFrames; i-- > 0;
+       dirLID = vol_IncrementLogLid(pVol, dirLID)) {
     vol_ReadLogPage(pVol, dirLID, page);
     numDescrs = *(uint32_t *)pagep;
     diag_printf("%d procs in dir frame %#llx:\n", numDescrs, dirLID);
@@ -126,3 +131,286 @@ PrintCkptDir(Volume* pVol)
   }
 #endif
 }
+
+/* The log directory index.
+ *
+ * Reading the object directory means reading every directory frame
+ * of every generation in the log, which is slow on a large volume.
+ * The index built by vol_LoadLogDirectory is therefore saved next to
+ * the volume as <volume>.logidx, and reused as long as the volume's
+ * checkpoint root has not changed.  The file is in host byte order;
+ * it is a cache, not an interchange format. */
+
+#define LOGIDX_MAGIC "LOGIDX1"
+
+struct LogIndexHdr {
+  char magic[8];
+  CkptRoot root;
+  uint32_t nLogGen;
+};
+
+struct LogIndexGen {
+  uint64_t generationNumber;
+  LID hdrLid;
+  uint32_t nProcs;
+  uint32_t nDirFrames;
+  uint32_t nDirent;
+};
+
+static char *
+LogIndexName(const char * volName)
+{
+  char * name = malloc(strlen(volName) + sizeof(".logidx"));
+  strcpy(name, volName);
+  strcat(name, ".logidx");
+  return name;
+}
+
+static bool
+ReadLogIndex(Volume * pVol, const char * idxName)
+{
+  struct LogIndexHdr hdr;
+  uint32_t g;
+  FILE * f = fopen(idxName, "rb");
+  if (!f)
+    return false;
+
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1
+      || memcmp(hdr.magic, LOGIDX_MAGIC, sizeof(hdr.magic)) != 0
+      || memcmp(&hdr.root, pVol->curDskCkpt, sizeof(CkptRoot)) != 0
+      || hdr.nLogGen > MaxUnmigratedGenerations + 1) {
+    fclose(f);
+    return false;
+  }
+
+  pVol->logGen = (LogGeneration *) calloc(hdr.nLogGen, sizeof(LogGeneration));
+  for (g = 0; g < hdr.nLogGen; g++) {
+    LogGeneration * lg = &pVol->logGen[g];
+    struct LogIndexGen ig;
+
+    if (fread(&ig, sizeof(ig), 1, f) != 1)
+      break;
+    lg->generationNumber = ig.generationNumber;
+    lg->hdrLid = ig.hdrLid;
+    lg->nProcs = ig.nProcs;
+    lg->nDirFrames = ig.nDirFrames;
+    lg->dirent = (LogDirent *) malloc(ig.nDirent * sizeof(LogDirent));
+    pVol->nLogGen = g + 1;	// so vol_FreeLogDirectory frees it
+    if (fread(lg->dirent, sizeof(LogDirent), ig.nDirent, f) != ig.nDirent)
+      break;
+    lg->nDirent = ig.nDirent;
+  }
+  fclose(f);
+
+  if (g != hdr.nLogGen) {
+    vol_FreeLogDirectory(pVol);
+    return false;
+  }
+  return true;
+}
+
+static void
+WriteLogIndex(Volume * pVol, const char * idxName)
+{
+  struct LogIndexHdr hdr;
+  uint32_t g;
+  bool ok;
+  char * tmpName = malloc(strlen(idxName) + sizeof(".tmp"));
+  strcpy(tmpName, idxName);
+  strcat(tmpName, ".tmp");
+
+  FILE * f = fopen(tmpName, "wb");
+  if (!f) {
+    // Not fatal: the volume may be in a read-only directory.
+    free(tmpName);
+    return;
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, LOGIDX_MAGIC, sizeof(hdr.magic));
+  memcpy(&hdr.root, pVol->curDskCkpt, sizeof(CkptRoot));
+  hdr.nLogGen = pVol->nLogGen;
+  ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+  for (g = 0; ok && g < pVol->nLogGen; g++) {
+    const LogGeneration * lg = &pVol->logGen[g];
+    struct LogIndexGen ig;
+
+    memset(&ig, 0, sizeof(ig));
+    ig.generationNumber = lg->generationNumber;
+    ig.hdrLid = lg->hdrLid;
+    ig.nProcs = lg->nProcs;
+    ig.nDirFrames = lg->nDirFrames;
+    ig.nDirent = lg->nDirent;
+    ok = fwrite(&ig, sizeof(ig), 1, f) == 1
+      && fwrite(lg->dirent, sizeof(LogDirent), lg->nDirent, f)
+         == lg->nDirent;
+  }
+
+  if (fclose(f) != 0)
+    ok = false;
+  if (!ok || rename(tmpName, idxName) != 0)
+    unlink(tmpName);
+  free(tmpName);
+}
+
+/* Make pVol->logGen available, from the index file if it is current
+ * and otherwise from the log itself. */
+static void
+LoadLogIndex(Volume * pVol, const char * volName, bool useIndex)
+{
+  char * idxName;
+
+  if (pVol->logGen)
+    return;
+
+  if (!useIndex) {
+    if (! vol_LoadLogDirectory(pVol))
+      diag_fatal(1, "Could not load the checkpoint log directory\n");
+    return;
+  }
+
+  idxName = LogIndexName(volName);
+  if (! ReadLogIndex(pVol, idxName)) {
+    if (! vol_LoadLogDirectory(pVol))
+      diag_fatal(1, "Could not load the checkpoint log directory\n");
+    WriteLogIndex(pVol, idxName);
+  }
+  free(idxName);
+}
+
+static void
+PrintLogDirent(const LogDirent * de)
+{
+  char pageNode = (de->type == capros_Range_otNode) ? 'N' : 'P';
+
+  diag_printf("%c OID=%#" PRIxOID " ac=%#x cc=%#x ",
+              pageNode, de->oid, de->allocCount, de->callCount);
+  if (CONTENT_LID(de->lid))
+    diag_printf("LID=%#llx\n", (unsigned long long) de->lid);
+  else
+    diag_printf("<zero>\n");
+}
+
+/* Where is oid in each generation of the log? */
+void
+PrintLogObject(Volume * pVol, const char * volName, bool useIndex, OID oid)
+{
+  uint32_t g;
+  bool found = false;
+
+  LoadLogIndex(pVol, volName, useIndex);
+
+  for (g = 0; g < pVol->nLogGen; g++) {
+    const LogGeneration * lg = &pVol->logGen[g];
+    const LogDirent * de = vol_FindLogDirent(lg, oid);
+
+    if (de) {
+      diag_printf("gen %-8llu ", (unsigned long long) lg->generationNumber);
+      PrintLogDirent(de);
+      found = true;
+    }
+  }
+
+  if (!found)
+    diag_printf("OID %#" PRIxOID " is not in the log\n", oid);
+}
+
+struct ChangedObject {
+  const LogDirent * de;
+  uint64_t generationNumber;
+};
+
+static int
+CompareChanged(const void * a, const void * b)
+{
+  const struct ChangedObject * ca = (const struct ChangedObject *) a;
+  const struct ChangedObject * cb = (const struct ChangedObject *) b;
+
+  if (ca->de->oid != cb->de->oid)
+    return (ca->de->oid < cb->de->oid) ? -1 : 1;
+  // Newest generation first:
+  if (ca->generationNumber != cb->generationNumber)
+    return (ca->generationNumber > cb->generationNumber) ? -1 : 1;
+  return 0;
+}
+
+/* Which objects were written after generation from, up to and
+ * including generation to?  Each is shown at its newest location. */
+void
+PrintLogChanges(Volume * pVol, const char * volName, bool useIndex,
+                uint64_t from, uint64_t to)
+{
+  uint32_t g, i, n = 0, nDistinct = 0;
+  struct ChangedObject * changed;
+
+  LoadLogIndex(pVol, volName, useIndex);
+
+  if (from > to) {
+    uint64_t t = from;
+    from = to;
+    to = t;
+  }
+
+  for (g = 0; g < pVol->nLogGen; g++) {
+    const LogGeneration * lg = &pVol->logGen[g];
+    if (lg->generationNumber > from && lg->generationNumber <= to)
+      n += lg->nDirent;
+  }
+
+  changed = (struct ChangedObject *) malloc(n * sizeof(*changed));
+  n = 0;
+  for (g = 0; g < pVol->nLogGen; g++) {
+    const LogGeneration * lg = &pVol->logGen[g];
+    if (lg->generationNumber > from && lg->generationNumber <= to) {
+      for (i = 0; i < lg->nDirent; i++, n++) {
+        changed[n].de = &lg->dirent[i];
+        changed[n].generationNumber = lg->generationNumber;
+      }
+    }
+  }
+  qsort(changed, n, sizeof(*changed), CompareChanged);
+
+  for (i = 0; i < n; i++) {
+    if (i > 0 && changed[i].de->oid == changed[i-1].de->oid)
+      continue;
+    diag_printf("gen %-8llu ",
+                (unsigned long long) changed[i].generationNumber);
+    PrintLogDirent(changed[i].de);
+    nDistinct++;
+  }
+  diag_printf("%u objects changed after generation %llu through %llu\n",
+              nDistinct, (unsigned long long) from, (unsigned long long) to);
+
+  free(changed);
+}
+
+/* Per-generation size summary. */
+void
+PrintLogSummary(Volume * pVol, const char * volName, bool useIndex)
+{
+  uint32_t g, i;
+
+  LoadLogIndex(pVol, volName, useIndex);
+
+  diag_printf("Generation  HdrLID              Procs  DirFrames"
+              "  Pages  Nodes  Zero\n");
+  for (g = 0; g < pVol->nLogGen; g++) {
+    const LogGeneration * lg = &pVol->logGen[g];
+    uint32_t nPages = 0, nNodes = 0, nZero = 0;
+
+    for (i = 0; i < lg->nDirent; i++) {
+      const LogDirent * de = &lg->dirent[i];
+      if (! CONTENT_LID(de->lid))
+        nZero++;
+      else if (de->type == capros_Range_otNode)
+        nNodes++;
+      else
+        nPages++;
+    }
+    diag_printf("%-10llu  %#-18llx  %5u  %9u  %5u  %5u  %4u\n",
+                (unsigned long long) lg->generationNumber,
+                (unsigned long long) lg->hdrLid,
+                lg->nProcs, lg->nDirFrames, nPages, nNodes, nZero);
+  }
+}
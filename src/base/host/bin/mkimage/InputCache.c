@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2026, Strawberry Development Group.
+ *
+ * This file is part of the CapROS Operating System.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <eros/target.h>
+#include <erosimg/App.h>
+#include <erosimg/Intern.h>
+#include <erosimg/ExecImage.h>
+
+#include "InputCache.h"
+
+typedef struct CachedImage CachedImage;
+struct CachedImage {
+  CachedImage *next;
+  const char *fileName;		/* interned */
+  ExecImage *image;
+  uint64_t hash;		/* of the file content */
+};
+
+static CachedImage *images;
+
+/* Symbol values remembered between runs: */
+typedef struct CachedSymbol CachedSymbol;
+struct CachedSymbol {
+  CachedSymbol *next;
+  uint64_t hash;		/* of the binary's content */
+  const char *name;		/* interned */
+  uint32_t value;
+  bool used;			/* in this run */
+};
+
+enum { nSymPockets = 256 };
+
+static CachedSymbol *symTable[nSymPockets];
+
+static uint64_t
+HashContent(const uint8_t *buf, uint32_t len)
+{
+  uint64_t h = 0xcbf29ce484222325ull;	/* FNV-1a */
+  uint32_t i;
+
+  for (i = 0; i < len; i++)
+    h = (h ^ buf[i]) * 0x100000001b3ull;
+
+  return h;
+}
+
+static CachedImage *
+incache_Find(const char *fileName)
+{
+  CachedImage *ci;
+
+  fileName = intern(fileName);
+
+  for (ci = images; ci; ci = ci->next)
+    if (ci->fileName == fileName)
+      return ci;
+
+  ci = (CachedImage *) malloc(sizeof(CachedImage));
+  ci->fileName = fileName;
+  ci->image = xi_create();
+
+  if ( !xi_SetImage(ci->image, fileName, 0, 0) ) {
+    xi_destroy(ci->image);
+    free(ci);
+    return 0;
+  }
+
+  ci->hash = HashContent(xi_GetImage(ci->image), xi_GetImageSz(ci->image));
+  ci->next = images;
+  images = ci;
+
+  return ci;
+}
+
+ExecImage *
+incache_GetImage(const char *fileName)
+{
+  CachedImage *ci = incache_Find(fileName);
+
+  return ci ? ci->image : 0;
+}
+
+static CachedSymbol **
+incache_SymPocket(uint64_t hash, const char *name)
+{
+  return &symTable[(intern_gensig(name, strlen(name)) ^ (unsigned) hash)
+                   % nSymPockets];
+}
+
+static CachedSymbol *
+incache_FindSymbol(uint64_t hash, const char *name)
+{
+  CachedSymbol *cs;
+
+  for (cs = *incache_SymPocket(hash, name); cs; cs = cs->next)
+    if (cs->hash == hash && cs->name == name)
+      return cs;
+
+  return 0;
+}
+
+static CachedSymbol *
+incache_AddSymbol(uint64_t hash, const char *name, uint32_t value)
+{
+  CachedSymbol **pocket = incache_SymPocket(hash, name);
+  CachedSymbol *cs = (CachedSymbol *) malloc(sizeof(CachedSymbol));
+
+  cs->hash = hash;
+  cs->name = name;
+  cs->value = value;
+  cs->used = false;
+  cs->next = *pocket;
+  *pocket = cs;
+
+  return cs;
+}
+
+bool
+incache_GetSymbolValue(const char *fileName, const char *symName,
+                       uint32_t *value)
+{
+  CachedImage *ci = incache_Find(fileName);
+  CachedSymbol *cs;
+
+  if (!ci)
+    return false;
+
+  symName = intern(symName);
+
+  cs = incache_FindSymbol(ci->hash, symName);
+  if (!cs) {
+    uint32_t v;
+
+    if ( !xi_GetSymbolValue(ci->image, symName, &v) )
+      return false;
+
+    cs = incache_AddSymbol(ci->hash, symName, v);
+  }
+
+  cs->used = true;
+  *value = cs->value;
+  return true;
+}
+
+void
+incache_Load(const char *cacheFile)
+{
+  FILE *f = fopen(cacheFile, "r");
+  char line[1024];
+
+  if (!f)
+    return;			/* first build */
+
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long long hash;
+    unsigned long value;
+    char name[sizeof(line)];
+
+    if (sscanf(line, "%llx %lx %s", &hash, &value, name) != 3) {
+      diag_printf("%s: ignoring malformed cache entry\n", cacheFile);
+      continue;
+    }
+
+    if (!incache_FindSymbol(hash, intern(name)))
+      incache_AddSymbol(hash, intern(name), value);
+  }
+
+  fclose(f);
+}
+
+void
+incache_Save(const char *cacheFile)
+{
+  FILE *f = fopen(cacheFile, "w");
+  unsigned i;
+
+  if (!f) {
+    diag_printf("Cannot write cache file \"%s\"\n", cacheFile);
+    return;
+  }
+
+  for (i = 0; i < nSymPockets; i++) {
+    CachedSymbol *cs;
+
+    for (cs = symTable[i]; cs; cs = cs->next)
+      if (cs->used)
+        fprintf(f, "%016llx %08lx %s\n", (unsigned long long) cs->hash,
+                (unsigned long) cs->value, cs->name);
+  }
+
+  if (fclose(f) != 0)
+    diag_printf("Cannot write cache file \"%s\"\n", cacheFile);
+}
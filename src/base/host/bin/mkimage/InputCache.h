@@ -0,0 +1,52 @@
+#ifndef __INPUTCACHE_H__
+#define __INPUTCACHE_H__
+/*
+ * Copyright (C) 2026, Strawberry Development Group.
+ *
+ * This file is part of the CapROS Operating System.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* A description names the same binary many times: once for each
+ * segment built from it, and once for each symbol looked up in it.
+ * The input cache reads and parses each binary once per run.
+ * 
+ * Given a cache file (mkimage -c), symbol values are also kept
+ * between runs, keyed by a hash of the binary's content, so a binary
+ * that has not changed since the last build need not have its symbol
+ * table read at all.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns the named binary with all of its loadable regions, or NULL
+   if it cannot be read.  The cache owns the result. */
+ExecImage *incache_GetImage(const char *fileName);
+
+bool incache_GetSymbolValue(const char *fileName, const char *symName,
+                            uint32_t *value);
+
+void incache_Load(const char *cacheFile);
+/* Writes the symbol values used in this run, dropping stale ones. */
+void incache_Save(const char *cacheFile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INPUTCACHE_H__ */
@@ -49,6 +49,7 @@ Approved for public release, distribution unlimited. */
 #include <idl/capros/Forwarder.h>
 #include <idl/capros/SchedC.h>
 #include "PtrMap.h"
+#include "InputCache.h"
 #include "../../../lib/domain/include/domain/Runtime.h"
 
 /* Made this a structure to avoid construction problems */
@@ -1997,6 +1998,7 @@ main(int argc, char *argv[])
   int opterr = 0;
   const char *output;
   const char *architecture;
+  const char *cacheFile = 0;
   bool verbose = false;
   bool use_std_inc_path = true;
   bool use_std_def_list = true;
@@ -2024,7 +2026,7 @@ main(int argc, char *argv[])
 
   strbuf_append_char(stddef, ' ');
 
-  while ((c = getopt(argc, argv, "a:o:dvn:I:A:D:")) != -1) {
+  while ((c = getopt(argc, argv, "a:o:c:dvn:I:A:D:")) != -1) {
     const char cc = c;
 
     switch(c) {
@@ -2040,6 +2042,10 @@ main(int argc, char *argv[])
       architecture = optarg;
       break;
 
+    case 'c':
+      cacheFile = optarg;
+      break;
+
     case 'd':
       showparse = true;
       yy_flex_debug = 1;
@@ -2115,7 +2121,7 @@ main(int argc, char *argv[])
     opterr++;
 
   if (opterr)
-    diag_fatal(1, "Usage: mkimage -a architecture -o output [-v] [-d] [-nostdinc] [-Idir]"
+    diag_fatal(1, "Usage: mkimage -a architecture -o output [-c cachefile] [-v] [-d] [-nostdinc] [-Idir]"
 		" [-Ddef] [-Aassert] descrip_file\n");
 
   arch = ExecArch_FromString(architecture);
@@ -2159,10 +2165,17 @@ main(int argc, char *argv[])
   if (verbose)
     app_SetInteractive(true);
 
+  if (cacheFile)
+    incache_Load(cacheFile);
+
   yyparse();
 
-  if (num_errors == 0)
+  if (num_errors == 0) {
     ei_WriteToFile(image, output);
+
+    if (cacheFile)
+      incache_Save(cacheFile);
+  }
   
   pclose(yyin);
 
@@ -2281,24 +2294,13 @@ GetProgramSymbolValue(const char *fileName,
 		      const char *symName,
 		      uint32_t *value)
 {
-  ExecImage *ei = xi_create();
-  bool ok;
-
-  if ( !xi_SetImage(ei, fileName, 0, 0) ) {
-    xi_destroy(ei);
-    return false;
-  }
-
-  ok = xi_GetSymbolValue(ei, symName, value);
+  bool ok = incache_GetSymbolValue(fileName, symName, value);
 
 #if 0
-  diag_printf("Value of \"%s\" in \"%s\" is 0x%08x\n"
-	       "  entry pt is 0x%08x\n", symName,
-	       fileName, value,
-	       ei->EntryPt());
+  diag_printf("Value of \"%s\" in \"%s\" is 0x%08x\n",
+	       symName, fileName, *value);
 #endif
   
-  xi_destroy(ei);
   return ok;
 }
 
@@ -2334,7 +2336,7 @@ AddProgramSegment(ErosImage * image,
                   uint32_t permMask, uint32_t permValue,
                   bool initOnly)
 {
-  ExecImage *ei = xi_create();
+  ExecImage *ei;
   KeyBits pageKey;
   PtrMap *map = ptrmap_create();
   unsigned i;
@@ -2344,8 +2346,11 @@ AddProgramSegment(ErosImage * image,
 
   keyBits_InitToVoid(segKey);
 
-  if (! xi_SetImage(ei, fileName, permMask, permValue) ) {
-    xi_destroy(ei);
+  /* The cached image has all the loadable regions; this segment is
+     made from those whose permissions match. */
+  ei = incache_GetImage(fileName);
+  if (!ei) {
+    ptrmap_destroy(map);
     return false;
   }
   
@@ -2358,6 +2363,8 @@ AddProgramSegment(ErosImage * image,
 
   for (i = 0; i < xi_NumRegions(ei); i++) {
     er = xi_GetRegion(ei, i);
+    if ((er->perm & permMask) != permValue)
+      continue;
 
 #if 0
     char perm[4] = "\0\0\0";
@@ -2419,6 +2426,8 @@ AddProgramSegment(ErosImage * image,
   if (!initOnly) {
     for (i = 0; i < xi_NumRegions(ei); i++) {
       er = xi_GetRegion(ei, i);
+      if ((er->perm & permMask) != permValue)
+        continue;
 
       bool readOnly = (er->perm & ER_W) == 0;
 
@@ -2445,7 +2454,6 @@ AddProgramSegment(ErosImage * image,
     }
   }
 
-  xi_destroy(ei);
   ptrmap_destroy(map);
 
   if (keyBits_IsVoidKey(segKey)) {
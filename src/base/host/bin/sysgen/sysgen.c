@@ -28,15 +28,23 @@ Approved for public release, distribution unlimited. */
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <disk/NPODescr.h>
+#include <disk/TagPot.h>
 
 #include <erosimg/App.h>
 #include <erosimg/Parse.h>
 #include <erosimg/Volume.h>
 #include <erosimg/ErosImage.h>
+#include <erosimg/DiskKey.h>
 	  
 #define DIVRNDUP(x,y) (((x) + (y) - 1)/(y))
+#define min(x,y) ((x) > (y) ? (y) : (x))
+
+/* Limit on -j.  The per-thread arrays are on the stack. */
+#define MAX_THREADS 64
 
 Volume *pVol;
 
@@ -47,6 +55,77 @@ OID OIDBase;
 
 #include "common.c"
 
+/* Timing report for -t: */
+bool reportTimes = false;
+struct timespec phaseStart;
+
+static double
+ElapsedSince(const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec)
+         + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void
+EndPhase(const char *phase)
+{
+  if (reportTimes) {
+    diag_printf("sysgen: %-12s %8.3f s\n", phase, ElapsedSince(&phaseStart));
+    clock_gettime(CLOCK_MONOTONIC, &phaseStart);
+  }
+}
+
+/* The nodes are packed into their frames in memory, relocating their
+ * keys, and the frames are then written to the volume in one pass.
+ * Packing can be split across several threads. */
+typedef struct NodePacker NodePacker;
+struct NodePacker {
+  const ErosImage *image;
+  uint8_t *frames;	/* nodeFrames pages */
+  uint32_t first;	/* image node indexes first .. last-1 */
+  uint32_t last;
+  OID nodeBase;
+  OID pageBase;
+};
+
+static DiskNode *
+FrameNode(uint8_t *frames, uint32_t ndx)
+{
+  uint32_t frame = ndx / DISK_NODES_PER_PAGE;
+  DiskNode *pot = (DiskNode *) &frames[frame * EROS_PAGE_SIZE];
+
+  return &pot[ndx % DISK_NODES_PER_PAGE];
+}
+
+static void *
+PackNodes(void *arg)
+{
+  NodePacker *np = arg;
+  uint32_t ndx;
+
+  for (ndx = np->first; ndx < np->last; ndx++) {
+    unsigned slot;
+    DiskNode *node = FrameNode(np->frames, ndx);
+    OID frame = ndx / DISK_NODES_PER_PAGE;
+    OID offset = ndx % DISK_NODES_PER_PAGE;
+
+    ei_GetNodeContent(np->image, ndx, node);
+
+    /* Relocate keys: */
+    for (slot = 0; slot < EROS_NODE_SIZE; slot++) {
+      RelocateKey(&node->slot[slot], np->nodeBase, np->pageBase,
+                  np->image->hdr.nPages);
+    }
+
+    put_target_oid(&node->oid, FrameObIndexToOID(frame, offset) + np->nodeBase);
+  }
+
+  return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -61,10 +140,12 @@ main(int argc, char *argv[])
   unsigned ndx;
   unsigned int drive, partition;
   OID nodeBase, pageBase;
+  int nThreads = 1;
+  struct timespec start;
 
   app_Init("sysgen");
 
-  while ((c = getopt(argc, argv, "m:b:")) != -1) {
+  while ((c = getopt(argc, argv, "m:b:j:t")) != -1) {
     switch(c) {
     case 'm':
       map_file = fopen(optarg, "w");
@@ -81,6 +162,16 @@ main(int argc, char *argv[])
         opterr = true;
       break;
 
+    case 'j':
+      nThreads = atoi(optarg);
+      if (nThreads < 1 || nThreads > MAX_THREADS)
+        opterr = true;
+      break;
+
+    case 't':
+      reportTimes = true;
+      break;
+
     default:
       opterr = true;
     }
@@ -93,11 +184,16 @@ main(int argc, char *argv[])
     opterr = true;
   
   if (opterr)
-    diag_fatal(1, "Usage: sysgen [-m mapfile] [-b oidbase] volume-file eros-image\n");
+    diag_fatal(1, "Usage: sysgen [-m mapfile] [-b oidbase] [-j threads] [-t] "
+               "volume-file eros-image\n"
+               "  threads is 1 to %d\n", MAX_THREADS);
   
   targname = argv[0];
   erosimage = argv[1];
 
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  phaseStart = start;
+
   {
     /* Kluge to derive boot volume drive and partition from target name. */
     /* Assume last character of the name is a digit. */
@@ -130,9 +226,11 @@ main(int argc, char *argv[])
     diag_fatal(1, "Could not open \"%s\"\n", targname);
   
   vol_ResetVolume(pVol);
+  EndPhase("format");
   
   image = ei_create();
   ei_ReadFromFile(image, erosimage);
+  EndPhase("read image");
 
   for (i = 0; i < vol_MaxDiv(pVol); i++) {
     const Division* d = vol_GetDivision(pVol, i);
@@ -173,72 +271,89 @@ main(int argc, char *argv[])
   nodeBase = OIDBase;
   pageBase = nodeBase + FrameToOID(nodeFrames);
 
-  /* Copy all of the nodes, relocating the page key and node key
-   * OID's appropriately:
+  /* Pack all of the nodes into their frames, relocating the page key
+   * and node key OID's appropriately.  Nodes past the last one in
+   * the image are left empty, as vol_WriteNode would leave them.
    */
-  for (ndx = 0; ndx < nNodes; ndx++) {
-    unsigned slot;
-    DiskNode node;
-    OID frame, offset;
+  {
+    uint8_t *frames = calloc(nodeFrames, EROS_PAGE_SIZE);
+    NodePacker packers[nThreads];
+    pthread_t threads[nThreads];
+    bool threaded[nThreads];
+    uint32_t perThread = DIVRNDUP(nNodes, nThreads);
+
+    if (nodeFrames && frames == NULL)
+      diag_fatal(1, "Out of memory for %u node frames\n", nodeFrames);
+
+    for (ndx = nNodes; ndx < nodeFrames * DISK_NODES_PER_PAGE; ndx++) {
+      DiskNode *node = FrameNode(frames, ndx);
+      OID frame = ndx / DISK_NODES_PER_PAGE;
+      OID offset = ndx % DISK_NODES_PER_PAGE;
+
+      init_DiskNodeKeys(node);
+      put_target_oid(&node->oid, FrameObIndexToOID(frame, offset) + nodeBase);
+    }
 
-    ei_GetNodeContent(image, ndx, &node);
+    for (i = 0; i < nThreads; i++) {
+      NodePacker *np = &packers[i];
 
-    /* Relocate keys: */
-    for (slot = 0; slot < EROS_NODE_SIZE; slot++) {
-      RelocateKey(&node.slot[slot], nodeBase, pageBase, nPages);
+      np->image = image;
+      np->frames = frames;
+      np->first = min(i * perThread, nNodes);
+      np->last = min(np->first + perThread, nNodes);
+      np->nodeBase = nodeBase;
+      np->pageBase = pageBase;
+
+      /* The first share is packed here, as is any share whose thread
+       * could not be started. */
+      threaded[i] = i > 0
+                    && pthread_create(&threads[i], NULL, PackNodes, np) == 0;
     }
-    
-    frame = ndx / DISK_NODES_PER_PAGE;
-    offset = ndx % DISK_NODES_PER_PAGE;
-    OID oid = FrameObIndexToOID(frame, offset) + nodeBase;
 
-    put_target_oid(&node.oid, oid);
-    
-    vol_WriteNode(pVol, oid, &node);
+    for (i = 0; i < nThreads; i++) {
+      if (threaded[i])
+        pthread_join(threads[i], NULL);
+      else
+        PackNodes(&packers[i]);
+    }
+    EndPhase("pack nodes");
 
-    if (map_file != NULL)
-      fprintf(map_file, "image node ndx 0x%lx => disk node oid %#llx\n",
-	      ndx, oid);
+    vol_WriteFrames(pVol, nodeBase, nodeFrames, FRM_TYPE_NODE, frames);
+    free(frames);
+    EndPhase("write nodes");
   }
 
-  /* Write the nonzero pages: */
-  for (ndx = 0; ndx < nPages; ndx++) {
-    uint8_t buf[EROS_PAGE_SIZE];
-    
-    ei_GetDataPageContent(image, ndx, buf);
+  /* Write the nonzero pages straight from the image: */
+  vol_WriteFrames(pVol, pageBase, nPages, FRM_TYPE_DPAGE, image->pageImages);
 
-    OID oid = FrameObIndexToOID(ndx, 0) + pageBase;
-    vol_WriteDataPage(pVol, oid, buf);
+  /* Zero the non-contentful pages: */
+  vol_WriteFrames(pVol, pageBase + FrameToOID(nPages), nZeroPages,
+                  FRM_TYPE_DPAGE, NULL);
+  EndPhase("write pages");
 
-    if (map_file != NULL)
-      fprintf(map_file, "image dpage ndx 0x%lx => disk page oid %#llx\n",
+  if (map_file != NULL) {
+    for (ndx = 0; ndx < nNodes; ndx++) {
+      OID frame = ndx / DISK_NODES_PER_PAGE;
+      OID offset = ndx % DISK_NODES_PER_PAGE;
+      OID oid = FrameObIndexToOID(frame, offset) + nodeBase;
+
+      fprintf(map_file, "image node ndx 0x%lx => disk node oid %#llx\n",
 	      ndx, oid);
-  }
+    }
 
-  /* Zero the non-contentful pages: */
-  for (ndx = 0; ndx < nZeroPages; ndx++) {
-    OID oid;
-    uint8_t buf[EROS_PAGE_SIZE];
+    for (ndx = 0; ndx < nPages; ndx++) {
+      OID oid = FrameObIndexToOID(ndx, 0) + pageBase;
 
-    /* Following is redundant, but useful until zero pages are
-     * implemented:
-     */
-    
-    memset(buf, 0, EROS_PAGE_SIZE);
-    
-    oid = ((ndx + nPages) * EROS_OBJECTS_PER_FRAME) + pageBase;
-    vol_WriteDataPage(pVol, oid, buf);
+      fprintf(map_file, "image dpage ndx 0x%lx => disk page oid %#llx\n",
+	      ndx, oid);
+    }
+
+    for (ndx = 0; ndx < nZeroPages; ndx++) {
+      OID oid = ((ndx + nPages) * EROS_OBJECTS_PER_FRAME) + pageBase;
 
-    if (map_file != NULL)
       fprintf(map_file, "image zdpage ndx 0x%lx => disk page oid 0x%08lx%08lx\n",
 	      ndx, (uint32_t) (oid >> 32), (uint32_t) oid);
-
-#if 0
-    PagePot pagePot;
-    pagePot.flags = PagePot::ZeroPage;
-    
-    pVol->WritePagePotEntry(oid, pagePot);
-#endif
+    }
   }
 
   if (map_file != NULL)
@@ -246,10 +361,15 @@ main(int argc, char *argv[])
 
   vol_Close(pVol);
   free(pVol);
+  EndPhase("close");
   
   ei_destroy(image);
   free(image);
 
+  if (reportTimes)
+    diag_printf("sysgen: %u nodes, %u pages, %u zero pages in %.3f s\n",
+                nNodes, nPages, nZeroPages, ElapsedSince(&start));
+
   app_Exit();
   exit(0);
 }
@@ -151,6 +151,10 @@ ei_create()
   ei->nodeImages = 0;
   ei->dir = 0;
   ei->startupsDir = 0;
+  ei->dirIndex.slot = 0;
+  ei->dirIndex.nSlots = 0;
+  ei->startupsIndex.slot = 0;
+  ei->startupsIndex.nSlots = 0;
 
   ei->maxPage = 0;
   ei->maxNode = 0;
@@ -174,6 +178,8 @@ ei_destroy(ErosImage *ei)
   free(ei->nodeImages);
   free(ei->dir);
   free(ei->startupsDir);
+  free(ei->dirIndex.slot);
+  free(ei->startupsIndex.slot);
 }
 
 const char *
@@ -182,6 +188,70 @@ ei_GetString(const ErosImage *ei, int ndx)
   return intern(strpool_Get(ei->pool, ndx));
 }
 
+static uint32_t
+dirindex_Hash(const EiDirIndex *ndx, uint32_t name)
+{
+  name *= 0x9e3779b1u;
+  return (name ^ (name >> 16)) & (ndx->nSlots - 1);
+}
+
+/* Return the index of the entry with the given name, or -1. */
+static int
+dirindex_Find(const EiDirIndex *ndx, const EiDirent *ents, uint32_t name)
+{
+  uint32_t s;
+
+  if (ndx->nSlots == 0)
+    return -1;
+
+  for (s = dirindex_Hash(ndx, name); ndx->slot[s];
+       s = (s + 1) & (ndx->nSlots - 1)) {
+    if (ents[ndx->slot[s] - 1].name == name)
+      return ndx->slot[s] - 1;
+  }
+
+  return -1;
+}
+
+static void
+dirindex_Put(EiDirIndex *ndx, const EiDirent *ents, uint32_t ent)
+{
+  uint32_t s;
+
+  for (s = dirindex_Hash(ndx, ents[ent].name); ndx->slot[s];
+       s = (s + 1) & (ndx->nSlots - 1))
+    ;
+
+  ndx->slot[s] = ent + 1;
+}
+
+static void
+dirindex_Build(EiDirIndex *ndx, const EiDirent *ents, uint32_t nEnts)
+{
+  uint32_t i;
+
+  free(ndx->slot);
+
+  for (ndx->nSlots = DIR_ALLOC_QUANTA; ndx->nSlots < 2 * nEnts;
+       ndx->nSlots <<= 1)
+    ;
+
+  ndx->slot = (uint32_t *) calloc(ndx->nSlots, sizeof(uint32_t));
+
+  for (i = 0; i < nEnts; i++)
+    dirindex_Put(ndx, ents, i);
+}
+
+/* Index the last of nEnts entries, which has just been appended. */
+static void
+dirindex_Append(EiDirIndex *ndx, const EiDirent *ents, uint32_t nEnts)
+{
+  if (2 * nEnts > ndx->nSlots)
+    dirindex_Build(ndx, ents, nEnts);
+  else
+    dirindex_Put(ndx, ents, nEnts - 1);
+}
+
 static void
 ei_GrowStartupsTable(ErosImage *ei, uint32_t newMax)
 {
@@ -269,7 +339,6 @@ ei_GrowPageTable(ErosImage *ei, uint32_t newMax)
 bool
 ei_AddStartup(ErosImage *ei, const char *name, KeyBits key)
 {
-  uint32_t i;
   uint32_t nameNdx = strpool_Add(ei->pool, name);
   KeyBits threadChain;
   keyBits_InitToVoid(&threadChain);
@@ -295,9 +364,8 @@ ei_AddStartup(ErosImage *ei, const char *name, KeyBits key)
     return false;
   }
 
-  for (i = 0; i < ei->hdr.nStartups; i++)
-    if (ei->startupsDir[i].name == nameNdx)
-      diag_fatal(5, "Duplicate name \"%s\" added to image file\n", name);
+  if (dirindex_Find(&ei->startupsIndex, ei->startupsDir, nameNdx) >= 0)
+    diag_fatal(5, "Duplicate name \"%s\" added to image file\n", name);
   
   if (ei->hdr.nStartups >= ei->maxStartups)
     ei_GrowStartupsTable(ei, ei->maxStartups + THREAD_ALLOC_QUANTA);
@@ -310,115 +378,118 @@ ei_AddStartup(ErosImage *ei, const char *name, KeyBits key)
   ei_AppendToChain(ei, &threadChain, key);
 
   ei->hdr.nStartups++;
+  dirindex_Append(&ei->startupsIndex, ei->startupsDir, ei->hdr.nStartups);
 
   return true;
 }
 
-void
-ei_AddDirEnt(ErosImage *ei, const char *name, KeyBits key)
+static void
+ei_AppendDirEnt(ErosImage *ei, uint32_t nameNdx, KeyBits key)
 {
-  uint32_t i;
-  uint32_t nameNdx = strpool_Add(ei->pool, name);
-
-  assert ( name != 0 );
-  
-  for (i = 0; i < ei->hdr.nDirEnt; i++)
-    if (ei->dir[i].name == nameNdx)
-      diag_fatal(5, "Duplicate name \"%s\" added to image file\n", name);
-  
   if (ei->hdr.nDirEnt >= ei->maxDir)
     ei_GrowDirTable(ei, ei->maxDir + DIR_ALLOC_QUANTA);
 
   ei->dir[ei->hdr.nDirEnt].key = key;
   ei->dir[ei->hdr.nDirEnt].name = nameNdx;
   ei->hdr.nDirEnt++;
+  dirindex_Append(&ei->dirIndex, ei->dir, ei->hdr.nDirEnt);
+}
+
+/* Return the index of the directory entry for name, or -1.
+ * Names that are not in the string pool are not added to it. */
+static int
+ei_FindDirEnt(const ErosImage *ei, const char *name)
+{
+  int nameNdx = strpool_Lookup(ei->pool, name);
+
+  if (nameNdx < 0)
+    return -1;
+
+  return dirindex_Find(&ei->dirIndex, ei->dir, nameNdx);
 }
 
 void
-ei_AssignDirEnt(ErosImage *ei, const char *name, KeyBits key)
+ei_AddDirEnt(ErosImage *ei, const char *name, KeyBits key)
 {
-  uint32_t i;
   uint32_t nameNdx = strpool_Add(ei->pool, name);
 
-  for (i = 0; i < ei->hdr.nDirEnt; i++)
-    if (ei->dir[i].name == nameNdx) {
-      ei->dir[i].key = key;
-      return;
-    }
+  assert ( name != 0 );
   
-  if (ei->hdr.nDirEnt >= ei->maxDir)
-    ei_GrowDirTable(ei, ei->maxDir + DIR_ALLOC_QUANTA);
+  if (dirindex_Find(&ei->dirIndex, ei->dir, nameNdx) >= 0)
+    diag_fatal(5, "Duplicate name \"%s\" added to image file\n", name);
+  
+  ei_AppendDirEnt(ei, nameNdx, key);
+}
 
-  ei->dir[ei->hdr.nDirEnt].key = key;
-  ei->dir[ei->hdr.nDirEnt].name = nameNdx;
-  ei->hdr.nDirEnt++;
+void
+ei_AssignDirEnt(ErosImage *ei, const char *name, KeyBits key)
+{
+  uint32_t nameNdx = strpool_Add(ei->pool, name);
+  int i = dirindex_Find(&ei->dirIndex, ei->dir, nameNdx);
+
+  if (i >= 0)
+    ei->dir[i].key = key;
+  else
+    ei_AppendDirEnt(ei, nameNdx, key);
 }
 
 bool
 ei_DelDirEnt(ErosImage *ei, const char *name)
 {
-  uint32_t i;
-  uint32_t nameNdx = strpool_Add(ei->pool, name);
+  int i = ei_FindDirEnt(ei, name);
+  uint32_t ent;
 
-  for (i = 0; i < ei->hdr.nDirEnt; i++) {
-    if (ei->dir[i].name == nameNdx) {
-      uint32_t ent;
-      for (ent = i; ent < (ei->hdr.nDirEnt - 1); ent++)
-	ei->dir[ent] = ei->dir[ent+1];
-      ei->hdr.nDirEnt--;
-      return true;
-    }
-  }
+  if (i < 0)
+    return false;
+
+  for (ent = i; ent < (ei->hdr.nDirEnt - 1); ent++)
+    ei->dir[ent] = ei->dir[ent+1];
+  ei->hdr.nDirEnt--;
+
+  /* The later entries have moved down: */
+  dirindex_Build(&ei->dirIndex, ei->dir, ei->hdr.nDirEnt);
 
-  return false;
+  return true;
 }
 
 bool
 ei_GetDirEnt(ErosImage *ei, const char *name, KeyBits *key)
 {
-  uint32_t i;
-  uint32_t nameNdx = strpool_Add(ei->pool, name);
+  int i = ei_FindDirEnt(ei, name);
 
-  for (i = 0; i < ei->hdr.nDirEnt; i++) {
-    if (ei->dir[i].name == nameNdx) {
-      *key = ei->dir[i].key;
-      return true;
-    }
-  }
+  if (i < 0)
+    return false;
 
-  return false;
+  *key = ei->dir[i].key;
+  return true;
 }
 
 bool
 ei_GetStartupEnt(ErosImage *ei, const char *name, KeyBits *key)
 {
-  uint32_t i;
-  uint32_t nameNdx = strpool_Add(ei->pool, name);
+  int nameNdx = strpool_Lookup(ei->pool, name);
+  int i;
 
-  for (i = 0; i < ei->hdr.nStartups; i++) {
-    if (ei->startupsDir[i].name == nameNdx) {
-      *key = ei->startupsDir[i].key;
-      return true;
-    }
-  }
+  if (nameNdx < 0)
+    return false;
+
+  i = dirindex_Find(&ei->startupsIndex, ei->startupsDir, nameNdx);
+  if (i < 0)
+    return false;
 
-  return false;
+  *key = ei->startupsDir[i].key;
+  return true;
 }
 
 void
 ei_SetDirEnt(ErosImage *ei, const char *name, KeyBits key)
 {
-  uint32_t i;
-  uint32_t nameNdx = strpool_Add(ei->pool, name);
+  int i = ei_FindDirEnt(ei, name);
 
-  for (i = 0; i < ei->hdr.nDirEnt; i++) {
-    if (ei->dir[i].name == nameNdx) {
-      ei->dir[i].key = key;
-      return;
-    }
-  }
+  if (i < 0)
+    diag_fatal(1, "No directory entry for \"%s\"\n", name);
 
-  diag_fatal(1, "No directory entry for \"%s\"\n", name);
+  ei->dir[i].key = key;
 }
 
 KeyBits
@@ -730,12 +801,149 @@ ei_ValidateImage(ErosImage *ei, const char* target)
   init_SmallNumberKey(&pNode->slot[capros_Range_otPage], ei->hdr.nPages + ei->hdr.nZeroPages);
 }
 
+/* True if key designates one of the image's (nonzero) page images. */
+static bool
+IsImagePageKey(const KeyBits *key)
+{
+  return keyBits_IsType(key, KKT_Page)
+         && !keyBits_IsPrepared(key)
+         && get_target_oid(&key->u.unprep.oid) < OID_RESERVED_PHYSRANGE;
+}
+
+/* Call fn on every key the image holds. */
+static void
+ei_ForEachKey(ErosImage *ei, void (*fn)(KeyBits *, void *), void *arg)
+{
+  uint32_t i;
+  unsigned slot;
+
+  for (i = 0; i < ei->hdr.nNodes; i++)
+    for (slot = 0; slot < EROS_NODE_SIZE; slot++)
+      fn(&ei->nodeImages[i].slot[slot], arg);
+
+  for (i = 0; i < ei->hdr.nDirEnt; i++)
+    fn(&ei->dir[i].key, arg);
+
+  for (i = 0; i < ei->hdr.nStartups; i++)
+    fn(&ei->startupsDir[i].key, arg);
+}
+
+static void
+NoteWritablePage(KeyBits *key, void *arg)
+{
+  bool *writable = arg;
+
+  if (IsImagePageKey(key) && !keyBits_IsReadOnly(key))
+    writable[get_target_oid(&key->u.unprep.oid)] = true;
+}
+
+static void
+RenumberPage(KeyBits *key, void *arg)
+{
+  const uint32_t *newNdx = arg;
+
+  if (IsImagePageKey(key))
+    put_target_oid(&key->u.unprep.oid,
+                   newNdx[get_target_oid(&key->u.unprep.oid)]);
+}
+
+static uint32_t
+HashPage(const uint8_t *page)
+{
+  const uint32_t *w = (const uint32_t *) page;
+  uint64_t h = 0;
+  unsigned i;
+
+  for (i = 0; i < EROS_PAGE_SIZE / sizeof(uint32_t); i++)
+    h = (h ^ w[i]) * 0x9e3779b97f4a7c15ull;
+
+  return (uint32_t) (h >> 32);
+}
+
+/* A page that is only reachable through read-only keys can never be
+ * changed, so identical such pages (shared library text, constant
+ * tables, padding) need only be stored once.  Merge them, keeping
+ * the first copy of each, and renumber the page keys to match.
+ */
+static void
+ei_ShareDataPages(ErosImage *ei)
+{
+  uint32_t nPages = ei->hdr.nPages;
+  uint32_t nBuckets;
+  uint32_t *bucket;	/* new page index + 1, or 0 if empty */
+  uint32_t *hash;	/* hash of each kept page, by new index */
+  uint32_t *newNdx;
+  bool *writable;
+  uint32_t nKept = 0;
+  uint32_t ndx;
+
+  if (nPages < 2)
+    return;
+
+  for (nBuckets = 2; nBuckets < 2 * nPages; nBuckets <<= 1)
+    ;
+
+  writable = calloc(nPages, sizeof(bool));
+  newNdx = malloc(nPages * sizeof(uint32_t));
+  hash = malloc(nPages * sizeof(uint32_t));
+  bucket = calloc(nBuckets, sizeof(uint32_t));
+  if (!writable || !newNdx || !hash || !bucket)
+    diag_fatal(1, "Out of memory sharing page images\n");
+
+  ei_ForEachKey(ei, NoteWritablePage, writable);
+
+  for (ndx = 0; ndx < nPages; ndx++) {
+    uint8_t *page = &ei->pageImages[ndx * EROS_PAGE_SIZE];
+    uint32_t h = 0;
+    uint32_t b = 0;
+
+    if (!writable[ndx]) {
+      h = HashPage(page);
+
+      for (b = h & (nBuckets - 1); bucket[b]; b = (b + 1) & (nBuckets - 1)) {
+        uint32_t kept = bucket[b] - 1;
+
+        if (hash[kept] == h
+            && memcmp(&ei->pageImages[kept * EROS_PAGE_SIZE], page,
+                      EROS_PAGE_SIZE) == 0)
+          break;
+      }
+
+      if (bucket[b]) {
+        newNdx[ndx] = bucket[b] - 1;
+        continue;
+      }
+
+      bucket[b] = nKept + 1;
+    }
+
+    /* Keep this page, moving it down over any merged ones: */
+    if (nKept != ndx)
+      memcpy(&ei->pageImages[nKept * EROS_PAGE_SIZE], page, EROS_PAGE_SIZE);
+    hash[nKept] = h;
+    newNdx[ndx] = nKept++;
+  }
+
+  if (nKept != nPages) {
+    diag_debug(1, "Shared %u of %u page images\n", nPages - nKept, nPages);
+
+    ei_ForEachKey(ei, RenumberPage, newNdx);
+    ei->hdr.nPages = nKept;
+  }
+
+  free(writable);
+  free(newNdx);
+  free(hash);
+  free(bucket);
+}
+
 void
 ei_WriteToFile(ErosImage *ei, const char *target)
 {
   int tfd;
   int sz;
 
+  ei_ShareDataPages(ei);
   ei_ValidateImage(ei, target);
   
   tfd = open(target, O_RDWR|O_TRUNC);
@@ -877,6 +1085,9 @@ ei_ReadFromFile(ErosImage *ei, const char *source)
 
   if (read(sfd, ei->startupsDir, sz) != sz)
     diag_fatal(2, "Cannot read thread list from \"%s\"\n", source);
+
+  dirindex_Build(&ei->dirIndex, ei->dir, ei->hdr.nDirEnt);
+  dirindex_Build(&ei->startupsIndex, ei->startupsDir, ei->hdr.nStartups);
   
   /* Step 4: read page images: */
 
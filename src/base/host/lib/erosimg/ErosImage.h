@@ -74,6 +74,15 @@ struct EiDirent {
 
 void ei_dirent_init(EiDirent *);
 
+/* Hash index from name to entry for a directory, so lookups need not
+ * scan it.  It is rebuilt when an image is read and is not part of
+ * the image file. */
+typedef struct EiDirIndex EiDirIndex;
+struct EiDirIndex {
+  uint32_t *slot;	/* entry index + 1, or 0 if empty */
+  uint32_t nSlots;	/* 0 or a power of 2 */
+};
+
 typedef struct ErosHeader ErosHeader;
 struct ErosHeader {
   char		signature[8];	/* "ErosImg\0" */
@@ -112,6 +121,8 @@ struct ErosImage {
   struct DiskNode * nodeImages;
   struct EiDirent *dir;
   struct EiDirent *startupsDir;
+  EiDirIndex dirIndex;
+  EiDirIndex startupsIndex;
 
   uint32_t maxPage;
   uint32_t maxNode;
@@ -49,6 +49,10 @@ xi_ResetImage(ExecImage *pImage)
   if (pImage->regions)
     free(pImage->regions);
   pImage->regions = 0;
+
+  free(pImage->symbols);
+  pImage->symbols = 0;
+  pImage->nSymbols = -1;
 }
 
 ExecImage *
@@ -57,6 +61,7 @@ xi_create()
   ExecImage *pImage = (ExecImage *) malloc(sizeof(ExecImage));
   pImage->image = 0;
   pImage->regions = 0;
+  pImage->symbols = 0;
   xi_ResetImage(pImage);
   return pImage;
 }
@@ -66,6 +71,7 @@ void xi_destroy(ExecImage *pImage)
   free(pImage->image);
   if (pImage->regions)
     free(pImage->regions);
+  free(pImage->symbols);
 }
 
 bool
@@ -61,6 +61,13 @@ struct ExecRegion {
   uint32_t perm;
 }; 
 
+typedef struct ExecSymbol ExecSymbol;
+struct ExecSymbol {
+  const char *name;	/* interned */
+  uint32_t value;
+  long ndx;		/* position in the file's symbol table */
+};
+
 typedef struct ExecImage ExecImage;
 struct ExecImage {
   const char *imageTypeName;
@@ -73,6 +80,11 @@ struct ExecImage {
   uint32_t nRegions;
   
   uint32_t  entryPoint;
+
+  /* Symbol table sorted by name, read on the first symbol lookup.
+     nSymbols is -1 until then. */
+  ExecSymbol *symbols;
+  long nSymbols;
 };
 
 #ifdef __cplusplus
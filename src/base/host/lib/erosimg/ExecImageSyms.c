@@ -19,6 +19,7 @@
  */
 
 #include <bfd.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <erosimg/App.h>
@@ -34,8 +35,25 @@
 
 extern char* target;
 
-bool
-xi_GetSymbolValue(ExecImage *pImage, const char *symName, uint32_t *pValue)
+static int
+CompareSymbols(const void *a, const void *b)
+{
+  const ExecSymbol *sa = a;
+  const ExecSymbol *sb = b;
+  int cmp = strcmp(sa->name, sb->name);
+
+  /* Where a name appears more than once, keep file order, so that
+     lookups find the same entry the file's first match would: */
+  if (cmp == 0)
+    cmp = (sa->ndx > sb->ndx) - (sa->ndx < sb->ndx);
+
+  return cmp;
+}
+
+/* Read the whole symbol table once, so that each lookup after the
+ * first is a binary search rather than another pass through bfd. */
+static bool
+xi_LoadSymbols(ExecImage *pImage)
 {
   bfd *bfd_file;
   long symcount;
@@ -45,6 +63,7 @@ xi_GetSymbolValue(ExecImage *pImage, const char *symName, uint32_t *pValue)
   char **matching;
   const char *imageFileName;
   asymbol *store;
+  long nSyms = 0;
   
   bfd_init ();
 
@@ -63,21 +82,26 @@ xi_GetSymbolValue(ExecImage *pImage, const char *symName, uint32_t *pValue)
   if (bfd_check_format_matches (bfd_file, bfd_object, &matching) == 0) {
     diag_printf("\"%s\" is not an executable\n", bfd_get_filename
 		 (bfd_file));
+    bfd_close(bfd_file);
     return false;
   }
 
   if (!(bfd_get_file_flags (bfd_file) & HAS_SYMS)) {
     diag_printf("No symbols in \"%s\".\n", bfd_get_filename
 		 (bfd_file));
+    bfd_close(bfd_file);
     return false;
   }
 
   symcount = bfd_read_minisymbols (bfd_file, BFD_FALSE, &minisyms, &size);
   if (symcount < 0) {
     diag_printf("File \"%s\" had no symbols.\n", pImage->name);
+    bfd_close(bfd_file);
     return false;
   }
 
+  pImage->symbols = (ExecSymbol *) malloc(sizeof(ExecSymbol) * (symcount + 1));
+
   from = (bfd_byte *) minisyms;
   fromend = from + symcount * size;
 
@@ -85,21 +109,52 @@ xi_GetSymbolValue(ExecImage *pImage, const char *symName, uint32_t *pValue)
 
   for (; from < fromend; from += size) {
     asymbol *sym;
+    symbol_info syminfo;
 
     sym = bfd_minisymbol_to_symbol (bfd_file, BFD_FALSE, from, store);
     if (sym == NULL)
       diag_fatal(3, "Could not fetch symbol info!\n");
 
-    if (strcmp(bfd_asymbol_name (sym), symName) == 0) {
-      symbol_info syminfo;
+    bfd_get_symbol_info (bfd_file, sym, &syminfo);
+
+    pImage->symbols[nSyms].name = intern(bfd_asymbol_name (sym));
+    pImage->symbols[nSyms].value = syminfo.value;
+    pImage->symbols[nSyms].ndx = nSyms;
+    nSyms++;
+  }
+
+  qsort(pImage->symbols, nSyms, sizeof(ExecSymbol), CompareSymbols);
+  pImage->nSymbols = nSyms;
 
-      bfd_get_symbol_info (bfd_file, sym, &syminfo);
+  free(minisyms);
+  bfd_close(bfd_file);
+  return true;
+}
+
+bool
+xi_GetSymbolValue(ExecImage *pImage, const char *symName, uint32_t *pValue)
+{
+  long lo = 0;
+  long hi;
 
-      *pValue = syminfo.value;
-      return true;
-    }
+  if (pImage->nSymbols < 0 && !xi_LoadSymbols(pImage))
+    return false;
+
+  /* Find the first entry not less than symName: */
+  hi = pImage->nSymbols;
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+
+    if (strcmp(pImage->symbols[mid].name, symName) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < pImage->nSymbols && strcmp(pImage->symbols[lo].name, symName) == 0) {
+    *pValue = pImage->symbols[lo].value;
+    return true;
   }
 
   return false;
 }
-
@@ -101,8 +101,8 @@ strpool_reinit(StringPool *pStrPool)
   strpool_Add(pStrPool, intern(""));	/* empty string is ALWAYS first! */
 }
 
-static int
-strpool_Lookup(StringPool *pStrPool, const char *s)
+int
+strpool_Lookup(const StringPool *pStrPool, const char *s)
 {
   unsigned sig = intern_gensig(s, strlen(s));
   int pocket = sig % nPockets;
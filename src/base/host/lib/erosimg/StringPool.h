@@ -39,6 +39,8 @@ extern "C" {
   void strpool_destroy(StringPool *pStrPool);
 
   int strpool_Add(StringPool *, const char *);
+  /* Like strpool_Add, but returns -1 rather than adding a new string. */
+  int strpool_Lookup(const StringPool *, const char *);
   const char *strpool_Get(const StringPool *, int offset);
 
   INLINE int 
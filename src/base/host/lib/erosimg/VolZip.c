@@ -31,7 +31,7 @@
 #include <erosimg/App.h>
 #include <erosimg/Volume.h>
 
-static unsigned char in_buf[EROS_SECTOR_SIZE];
+static unsigned char in_buf[64 * 1024];
 
 #define min(x,y) ((x) > (y) ? (y) : (x))
 
@@ -57,9 +57,9 @@ vol_CompressTarget(Volume *pVol)
 	diag_fatal(3, "Cannot seek working file\n");
 
       {
-	int len = wkstat.st_size;
+	off_t len = wkstat.st_size;
 	while (len) {
-	  int sz = min(len, EROS_SECTOR_SIZE);
+	  int sz = min(len, sizeof(in_buf));
 
 	  if (read(pVol->working_fd, in_buf, sz) != sz)
 	    diag_fatal(3, "Cannot read to copy image\n");
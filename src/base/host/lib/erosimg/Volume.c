@@ -23,6 +23,8 @@
 Research Projects Agency under Contract No. W31P4Q-07-C-0070.
 Approved for public release, distribution unlimited. */
 
+#define _GNU_SOURCE	// for fallocate
+
 #include <assert.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -34,11 +36,12 @@ Approved for public release, distribution unlimited. */
 
 #include <a.out.h>
 
-#include <sys/fcntl.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 
 #include <disk/TagPot.h>
 #include <disk/CkptRoot.h>
+#include <disk/GenerationHdr.h>
 #include <erosimg/App.h>
 #include <erosimg/Volume.h>
 #include <erosimg/DiskDescrip.h>
@@ -53,14 +56,14 @@ Approved for public release, distribution unlimited. */
 #define RESERVES_PER_PAGE (EROS_PAGE_SIZE / sizeof(CpuReserveInfo))
 #define RESERVE_PAGES ((RESERVE_BYTES + EROS_PAGE_SIZE - 1) / EROS_PAGE_SIZE)
     
-static uint32_t
+static uint64_t
 vol_GetOidFrameVolOffset(Volume *pVol, int ndx, OID oid)
 {
   const Division *d = &pVol->divTable[ndx];
   OID startOid = get_target_oid(&d->startOid);
   uint32_t relPage;
-  uint32_t divStart;
-  uint32_t pageOffset;
+  uint64_t divStart;
+  uint64_t pageOffset;
 
   assert(div_contains(d, oid));
 
@@ -68,8 +71,8 @@ vol_GetOidFrameVolOffset(Volume *pVol, int ndx, OID oid)
 
   relPage = FrameToRangeLoc(OIDToFrame(oid - startOid));
 
-  divStart = d->start * EROS_SECTOR_SIZE;
-  pageOffset = relPage * EROS_PAGE_SIZE;
+  divStart = (uint64_t) d->start * EROS_SECTOR_SIZE;
+  pageOffset = (uint64_t) relPage * EROS_PAGE_SIZE;
 
   return divStart + pageOffset;
 }
@@ -91,6 +94,9 @@ vol_InitVolume(Volume *pVol)
   
   pVol->rewriting = true;
 
+  pVol->logGen = 0;
+  pVol->nLogGen = 0;
+
 #if 0 // this is not working now ...
   pVol->ckptDir = 0;
   pVol->maxCkptDirent = 0;
@@ -113,38 +119,50 @@ vol_Init(Volume *pVol)
   vol_InitVolume(pVol);
 }
 
+/* Volume offsets are 64 bits, so volumes can exceed 4GB.
+ * pread and pwrite save a seek per transfer. */
 static bool
-vol_Read(Volume *pVol, uint32_t offset, void *buf, uint32_t sz)
+vol_Read(Volume *pVol, uint64_t offset, void *buf, uint32_t sz)
 {
-  int e;
+  ssize_t e;
 
   assert(pVol->working_fd >= 0);
 
-  e = lseek(pVol->working_fd, (int) offset, SEEK_SET);
-  if (e < 0) {
-    diag_debug(0, "lseek got %d\n", e);
-    return false;
-  }
-
-  e = read(pVol->working_fd, buf, (int) sz);
-  if (e != (int) sz) {
-    diag_debug(0, "read, offset=%d, size=%d, got %d\n", offset, sz, e);
-    return false;
+  while (sz) {
+    e = pread(pVol->working_fd, buf, sz, (off_t) offset);
+    if (e <= 0) {
+      if (e < 0 && errno == EINTR)
+        continue;
+      diag_debug(0, "read, offset=%llu, size=%u, got %d\n",
+                 (unsigned long long) offset, sz, (int) e);
+      return false;
+    }
+    buf = (uint8_t *) buf + e;
+    offset += e;
+    sz -= e;
   }
 
   return true;
 }
 
 static bool
-vol_Write(Volume *pVol, uint32_t offset, const void *buf, uint32_t sz)
+vol_Write(Volume *pVol, uint64_t offset, const void *buf, uint32_t sz)
 {
-  assert(pVol->working_fd >= 0);
+  ssize_t e;
 
-  if (lseek(pVol->working_fd, (int) offset, SEEK_SET) < 0)
-    return false;
+  assert(pVol->working_fd >= 0);
 
-  if (write(pVol->working_fd, buf, (int) sz) != (int) sz)
-    return false;
+  while (sz) {
+    e = pwrite(pVol->working_fd, buf, sz, (off_t) offset);
+    if (e <= 0) {
+      if (e < 0 && errno == EINTR)
+        continue;
+      return false;
+    }
+    buf = (const uint8_t *) buf + e;
+    offset += e;
+    sz -= e;
+  }
 
   return true;
 }
@@ -338,7 +356,9 @@ static void
 vol_FormatObjectDivision(Volume *pVol, int ndx)
 {
   Division *d;
-  OID oid;
+  OID startOid;
+  frame_t nFrames;
+  frame_t cluster;
 
   assert(pVol->working_fd >= 0);
 
@@ -347,14 +367,28 @@ vol_FormatObjectDivision(Volume *pVol, int ndx)
   
   d = &pVol->divTable[ndx];
 
-  for (oid = get_target_oid(&d->startOid);
-       oid < get_target_oid(&d->endOid);
-       oid += EROS_OBJECTS_PER_FRAME) {
-    VolPagePot pagePot;
-    pagePot.type = FRM_TYPE_DPAGE;
-    pagePot.isZero = TagIsZero;
-    pagePot.count = 0;
-    vol_WritePagePotEntry(pVol, oid, &pagePot);
+  startOid = get_target_oid(&d->startOid);
+  nFrames = OIDToFrame(get_target_oid(&d->endOid) - startOid);
+
+  /* Every frame starts out as an empty data page with a count of
+   * zero.  Write each cluster's tag pot whole, rather than
+   * rewriting it once per frame.
+   */
+  for (cluster = 0; ClusterToTagPotRelID(cluster) < nFrames; cluster++) {
+    uint8_t data[EROS_PAGE_SIZE];
+    TagPot * tp = (TagPot *) data;
+    frame_t nTags = min(nFrames - ClusterToTagPotRelID(cluster),
+                        FramesPerCluster);
+    uint64_t offset = (uint64_t) d->start * EROS_SECTOR_SIZE
+                      + (uint64_t) ClusterToTagPotRangeLoc(cluster)
+                        * EROS_PAGE_SIZE;
+
+    memset(data, 0, EROS_PAGE_SIZE);
+    memset(tp->tags, FRM_TYPE_DPAGE | TagIsZero, nTags);
+
+    if ( !vol_Write(pVol, offset, data, EROS_PAGE_SIZE) )
+      diag_fatal(5, "Volume write failed at offset %llu.\n",
+                 (unsigned long long) offset);
   }
 }
 
@@ -400,25 +434,71 @@ vol_FormatLogDivision(Volume *pVol, int ndx)
   pVol->needSyncCkptLog = true;
 }
 
+/* Make the bytes from start to end of the volume zero,
+ * as a hole if the file system supports it, so that the time to create
+ * a volume depends on the data written, not the size of the volume.
+ */
+static bool
+vol_ZeroRange(Volume *pVol, uint64_t start, uint64_t end)
+{
+  struct stat st;
+
+  if (fstat(pVol->working_fd, &st) < 0)
+    return false;
+
+  if (S_ISREG(st.st_mode)) {
+    uint64_t fileEnd = st.st_size;
+
+    /* Bytes past the end of the file read as zero once the file
+     * is extended. */
+    if (end > fileEnd) {
+      if (ftruncate(pVol->working_fd, (off_t) end) < 0)
+        return false;
+      if (start >= fileEnd)
+        return true;
+      end = fileEnd;
+    }
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (fallocate(pVol->working_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  (off_t) start, (off_t) (end - start)) == 0)
+      return true;
+    /* Else the file system can't punch holes; write the zeros. */
+#endif
+  }
+
+  {
+#define ZERO_CHUNK (64 * 1024)
+    static const uint8_t zeros[ZERO_CHUNK];
+
+    while (start < end) {
+      uint32_t sz = min(end - start, ZERO_CHUNK);
+
+      if ( !vol_Write(pVol, start, zeros, sz) )
+        return false;
+      start += sz;
+    }
+#undef ZERO_CHUNK
+  }
+
+  return true;
+}
+
 static void
 vol_ZeroDivision(Volume *pVol, int ndx)
 {
-  uint8_t buf[EROS_SECTOR_SIZE];
   Division *d;
-  uint32_t i;
 
   assert(pVol->working_fd >= 0);
 
   if (ndx >= pVol->topDiv)
     diag_fatal(1, "Attempt to zero nonexistent division\n");
   
-  bzero(buf, EROS_SECTOR_SIZE);
-  
   d = &pVol->divTable[ndx];
   
-  for (i = d->start; i < d->end; i++)
-    if ( !vol_Write(pVol, i * EROS_SECTOR_SIZE, buf, EROS_SECTOR_SIZE) )
-      diag_fatal(1, "Couldn't zero division %d\n", ndx);
+  if ( !vol_ZeroRange(pVol, (uint64_t) d->start * EROS_SECTOR_SIZE,
+                      (uint64_t) d->end * EROS_SECTOR_SIZE) )
+    diag_fatal(1, "Couldn't zero division %d\n", ndx);
 
   pVol->divNeedsInit[ndx] = false;
 }
@@ -515,8 +595,8 @@ vol_WriteImageAtDivisionOffset(Volume *pVol, int div, const ExecImage *pImage,
   uint8_t *imageBuf;
   const uint8_t *fileImage;
   Division *d;
-  uint32_t divStart;
-  uint32_t divEnd;
+  uint64_t divStart;
+  uint64_t divEnd;
 
   assert(pVol->working_fd >= 0);
   
@@ -555,8 +635,8 @@ vol_WriteImageAtDivisionOffset(Volume *pVol, int div, const ExecImage *pImage,
 
   d = &pVol->divTable[div];
   
-  divStart = d->start * EROS_SECTOR_SIZE;
-  divEnd   = d->end * EROS_SECTOR_SIZE;
+  divStart = (uint64_t) d->start * EROS_SECTOR_SIZE;
+  divEnd   = (uint64_t) d->end * EROS_SECTOR_SIZE;
 
   if (divStart + offset + imageSz > divEnd)
     diag_fatal(1, "Image \"%s\" will not fit in division %d\n",
@@ -767,49 +847,173 @@ vol_LoadLogHeaders(Volume *pVol)
   }
 }
 
+/* The log wraps at endLog, exactly as IncrementLID does in the kernel. */
+LID
+vol_IncrementLogLid(const Volume *pVol, LID lid)
+{
+  lid += FrameToOID(1);
+  if (lid >= get_target_lid(&pVol->curDskCkpt->endLog))
+    return MAIN_LOG_START;
+  return lid;
+}
+
+static int
+CompareLogDirents(const void *a, const void *b)
+{
+  const LogDirent *da = (const LogDirent *) a;
+  const LogDirent *db = (const LogDirent *) b;
+
+  if (da->oid != db->oid)
+    return (da->oid < db->oid) ? -1 : 1;
+  return 0;
+}
+
 static void
-vol_LoadLogDirectory(Volume *pVol)
+AddLogDirents(LogGeneration *lg, const uint8_t *p, uint32_t n)
 {
-#if 0	// This is not working now ...
-  uint32_t logEnt = 0;
-  uint32_t d;
+  const DiskObjectDescriptor *dod = (const DiskObjectDescriptor *) p;
+  uint32_t i;
 
-  assert(pVol->curDskCkpt);
+  for (i = 0; i < n; i++, dod++) {
+    /* dod is unaligned and packed, so use memcpy. */
+    LogDirent *de = &lg->dirent[lg->nDirent++];
+    OID_s oids;
+
+    memcpy(&oids, &dod->oid, sizeof(oids));
+    de->oid = get_target_oid(&oids);
+    de->lid = GetDiskObjectDescriptorLogLoc(dod);
+    memcpy(&de->allocCount, &dod->allocCount, sizeof(ObCount));
+    memcpy(&de->callCount, &dod->callCount, sizeof(ObCount));
+    de->type = dod->type;
+  }
+}
 
-  /* Read the thread directory from the current checkpoint. */
-  for (d = 0; d < pVol->curDskCkpt->hdr.nThreadPage; d++, logEnt++) {
-    uint8_t dirPage[EROS_PAGE_SIZE];
-    ThreadDirPage *tdp;
-    uint32_t entry;
+/* Read the generation header and object directory frames of one
+ * generation.  Descriptor counts are clamped to what fits in a
+ * frame, so a damaged log cannot run us off the end of a page. */
+static bool
+vol_LoadLogGeneration(Volume *pVol, LID hdrLid, LogGeneration *lg)
+{
+  uint64_t page[EROS_PAGE_SIZE / sizeof(uint64_t)];
+  uint8_t *pagep = (uint8_t *) page;
+  const DiskGenerationHdr *genHdr = (const DiskGenerationHdr *) page;
+  const uint32_t perFrame = (EROS_PAGE_SIZE - sizeof(uint32_t))
+    / sizeof(DiskObjectDescriptor);
+  uint32_t hdrProcs, hdrObjs, nProcFrames, i;
+  uint32_t room;
+  LID procLid, dirLid;
+
+  if (! vol_ReadLogPage(pVol, hdrLid, page))
+    return false;
 
-    vol_ReadLogPage(pVol, pVol->curDskCkpt->dirPage[logEnt], dirPage);
-    tdp = (ThreadDirPage*) dirPage;
+  lg->generationNumber = get_target_u64(&genHdr->generationNumber);
+  lg->hdrLid = hdrLid;
+  lg->nDirFrames = genHdr->objectDir.nDirFrames;
+  lg->nDirent = 0;
 
-    for (entry = 0; entry < tdp->hdr.nDirent; entry++) {
-      ThreadDirent *tde = &tdp->entry[entry];
-	
-      vol_AddThread(pVol, tde->oid, tde->allocCount, tde->schedNdx);
-    }
+  room = EROS_PAGE_SIZE - sizeof(DiskGenerationHdr);
+  hdrProcs = genHdr->processDir.nDescriptors;
+  if (hdrProcs > room / sizeof(struct DiskProcessDescriptor))
+    return false;
+  room -= hdrProcs * sizeof(struct DiskProcessDescriptor);
+  hdrObjs = genHdr->objectDir.nDescriptors;
+  if (hdrObjs > room / sizeof(DiskObjectDescriptor))
+    return false;
+
+  nProcFrames = genHdr->processDir.nDirFrames;
+  procLid = get_target_lid(&genHdr->processDir.firstDirFrame);
+  dirLid = get_target_lid(&genHdr->objectDir.firstDirFrame);
+
+  lg->dirent = (LogDirent *)
+    malloc((hdrObjs + lg->nDirFrames * perFrame) * sizeof(LogDirent));
+  AddLogDirents(lg, pagep + EROS_PAGE_SIZE - room, hdrObjs);
+
+  lg->nProcs = hdrProcs;
+  for (i = 0; i < nProcFrames; i++, procLid = vol_IncrementLogLid(pVol, procLid)) {
+    if (! vol_ReadLogPage(pVol, procLid, page))
+      return false;
+    lg->nProcs += *(uint32_t *) pagep;
   }
 
-  /* Read the object directory from the current checkpoint. */
-  if (pVol->curDskCkpt->hdr.hasMigrated == false) {
-    for (d = 0; d < pVol->curDskCkpt->hdr.nDirPage; d++, logEnt++) {
-      uint8_t dirPage[EROS_PAGE_SIZE];
-      CkptDirPage *dp;
-      uint32_t entry;
+  for (i = 0; i < lg->nDirFrames; i++, dirLid = vol_IncrementLogLid(pVol, dirLid)) {
+    uint32_t n;
 
-      vol_ReadLogPage(pVol, pVol->curDskCkpt->dirPage[logEnt], dirPage);
-      dp = (CkptDirPage*) dirPage;
+    if (! vol_ReadLogPage(pVol, dirLid, page))
+      return false;
+    n = *(uint32_t *) pagep;
+    if (n > perFrame)
+      return false;
+    AddLogDirents(lg, pagep + sizeof(uint32_t), n);
+  }
 
-      for (entry = 0; entry < dp->hdr.nDirent; entry++) {
-	CkptDirent *de = &dp->entry[entry];
-	
-	vol_AddDirent(pVol, de->oid, de->count, de->lid, de->type);
-      }
+  qsort(lg->dirent, lg->nDirent, sizeof(LogDirent), CompareLogDirents);
+  return true;
+}
+
+/* Load the object directory of every generation recorded in the
+ * current checkpoint root, most recent first.  This reads every
+ * directory frame in the log, so it is done only on request. */
+bool
+vol_LoadLogDirectory(Volume *pVol)
+{
+  const CkptRoot *root = pVol->curDskCkpt;
+  uint32_t nGens = root->numUnmigratedGenerations + 1;
+  uint32_t g;
+
+  vol_FreeLogDirectory(pVol);
+
+  if (pVol->topLogLid == 0)
+    return false;
+
+  if (nGens > MaxUnmigratedGenerations + 1) {
+    diag_warning("Checkpoint root claims %u generations\n", nGens);
+    return false;
+  }
+
+  pVol->logGen = (LogGeneration *) calloc(nGens, sizeof(LogGeneration));
+
+  for (g = 0; g < nGens; g++) {
+    LogGeneration *lg = &pVol->logGen[pVol->nLogGen];
+    LID hdrLid = get_target_lid(&root->generations[g]);
+
+    if (! CONTENT_LID(hdrLid))
+      break;
+
+    if (! vol_LoadLogGeneration(pVol, hdrLid, lg)) {
+      diag_warning("Generation header at LID %#llx is damaged\n",
+                   (unsigned long long) hdrLid);
+      free(lg->dirent);
+      lg->dirent = 0;
+      return false;
     }
+    pVol->nLogGen++;
   }
-#endif
+
+  return true;
+}
+
+void
+vol_FreeLogDirectory(Volume *pVol)
+{
+  uint32_t g;
+
+  for (g = 0; g < pVol->nLogGen; g++)
+    free(pVol->logGen[g].dirent);
+  free(pVol->logGen);
+
+  pVol->logGen = 0;
+  pVol->nLogGen = 0;
+}
+
+const LogDirent *
+vol_FindLogDirent(const LogGeneration *lg, OID oid)
+{
+  LogDirent key;
+
+  key.oid = oid;
+  return (const LogDirent *)
+    bsearch(&key, lg->dirent, lg->nDirent, sizeof(LogDirent),
+            CompareLogDirents);
 }
 
 static void
@@ -829,7 +1033,7 @@ vol_SyncDivTables(Volume *pVol)
     if (d->type == dt_DivTbl) {
       uint8_t buf[EROS_PAGE_SIZE];
       
-      uint32_t divStart = d->start * EROS_SECTOR_SIZE;
+      uint64_t divStart = (uint64_t) d->start * EROS_SECTOR_SIZE;
 
       if ( !vol_Read(pVol, divStart, buf, EROS_PAGE_SIZE) )
 	diag_fatal(1, "Unable to read division table\n");
@@ -985,7 +1189,7 @@ vol_Open(const char* targname, bool rewriting,
 
   pVol->needSyncHdr = 0;
   
-  if ( !vol_Read(pVol, EROS_SECTOR_SIZE * pVol->volHdr.DivTable,
+  if ( !vol_Read(pVol, (uint64_t) EROS_SECTOR_SIZE * pVol->volHdr.DivTable,
 		      &pVol->divTable, NDIVENT * sizeof(Division)) )
     diag_fatal(3, "Couldn't read primary division table\n");
 
@@ -1010,16 +1214,10 @@ vol_Open(const char* targname, bool rewriting,
     }
   }
 
+  /* Tools that examine the checkpoint log call vol_LoadLogDirectory
+   * themselves; reading it here would cost every other open a pass
+   * over the whole log. */
   vol_LoadLogHeaders(pVol);
-
-  if (rewriting == false && pVol->topLogLid) {
-    /* We are opening for volume debugging rather than writing an
-     * erosimage onto the volume.  We must therefore read in the
-     * directory of the existing checkpoint log.
-     */
-
-    vol_LoadLogDirectory(pVol);
-  }
   
   return pVol;
 }
@@ -1225,6 +1423,8 @@ struct PreloadedModule {
 void
 vol_Close(Volume *pVol)
 {
+  vol_FreeLogDirectory(pVol);
+
   /* If we are exiting on an error, there is no need to save anything,
    * since the file has been deleted.
    */
@@ -1265,20 +1465,20 @@ vol_Close(Volume *pVol)
 #endif
 }
 
-static uint32_t
+static uint64_t
 vol_GetLogFrameVolOffset(Volume *pVol, int ndx, OID loc)
 {
   const Division *d = &pVol->divTable[ndx];
   uint32_t relPage;
-  uint32_t divStart;
-  uint32_t pageOffset;
+  uint64_t divStart;
+  uint64_t pageOffset;
 
   assert(div_contains(d, loc));
 
   relPage = (uint32_t) (loc - get_target_oid(&d->startOid));
   relPage /= EROS_OBJECTS_PER_FRAME;
-  divStart = d->start * EROS_SECTOR_SIZE;
-  pageOffset = relPage * EROS_PAGE_SIZE;
+  divStart = (uint64_t) d->start * EROS_SECTOR_SIZE;
+  pageOffset = (uint64_t) relPage * EROS_PAGE_SIZE;
 
   return divStart + pageOffset;
 }
@@ -1315,11 +1515,11 @@ vol_ValidOid(Volume *pVol, int ndx, OID oid)
 /* given a division index and a OID, return the volume-relative
  * offset of the object in that division.
  */
-static uint32_t
+static uint64_t
 vol_GetOidVolOffset(Volume *pVol, int ndx, OID oid)
 {
   const Division *d = &pVol->divTable[ndx];
-  uint32_t frameStart;
+  uint64_t frameStart;
   uint32_t obOffset;
 
   assert(div_contains(d, oid));
@@ -1412,7 +1612,7 @@ vol_ReadDataPage(Volume *pVol, OID oid, uint8_t *buf)
     if (((d->type == dt_Object) || (d->type == dt_Kernel)) &&
 	div_contains(d, oid)) {
       VolPagePot frameInfo;
-      uint32_t offset;
+      uint64_t offset;
 
       if (vol_ValidOid(pVol, div, oid) == false) {
 	diag_printf("Requested OID invalid\n");
@@ -1435,20 +1635,25 @@ vol_ReadDataPage(Volume *pVol, OID oid, uint8_t *buf)
   return false;
 }
 
+static bool
+PageIsZero(const uint8_t *buf)
+{
+  uint32_t i;
+
+  for (i = 0; i < EROS_PAGE_SIZE; i++)
+    if (buf[i])
+      return false;
+
+  return true;
+}
+
 bool
 vol_WriteDataPage(Volume *pVol, OID oid, const uint8_t *buf)
 {
-  bool isZeroPage = true;
+  bool isZeroPage = PageIsZero(buf);
   CkptDirent *cpd;
-  uint32_t i;
   int div;
 
-  for (i = 0; i < EROS_PAGE_SIZE; i++)
-    if (buf[i]) {
-      isZeroPage = false;
-      break;
-    }
-    
   cpd = vol_LookupObject(pVol, oid);
     
   if (cpd && cpd->type != FRM_TYPE_DPAGE)
@@ -1468,7 +1673,7 @@ vol_WriteDataPage(Volume *pVol, OID oid, const uint8_t *buf)
     if (((d->type == dt_Object) || (d->type == dt_Kernel)) &&
 	div_contains(d, oid)) {
       VolPagePot frameInfo;
-      uint32_t offset;
+      uint64_t offset;
 
       vol_ReadPagePotEntry(pVol, oid, &frameInfo);
 
@@ -1487,7 +1692,8 @@ vol_WriteDataPage(Volume *pVol, OID oid, const uint8_t *buf)
       offset = vol_GetOidVolOffset(pVol, div, oid);
 
       if ( !vol_Write(pVol, offset, buf, EROS_PAGE_SIZE) )
-	diag_fatal(5, "Volume write failed at offset %d.\n", offset);
+	diag_fatal(5, "Volume write failed at offset %llu.\n",
+                 (unsigned long long) offset);
 
       return true;
     }
@@ -1512,7 +1718,7 @@ vol_ReadLogPage(Volume * pVol, const LID lid, void * buf)
     Division *d = &pVol->divTable[div];
     
     if (d->type == dt_Log && div_contains(d, lid)) {
-      uint32_t offset = vol_GetLogFrameVolOffset(pVol, div, lid);
+      uint64_t offset = vol_GetLogFrameVolOffset(pVol, div, lid);
 
       return vol_Read(pVol, offset, (uint8_t *)buf, EROS_PAGE_SIZE);
     }
@@ -1530,10 +1736,11 @@ vol_WriteLogPage(Volume *pVol, const LID lid, const void * buf)
     Division *d = &pVol->divTable[div];
     
     if (d->type == dt_Log && div_contains(d, lid)) {
-      uint32_t offset = vol_GetLogFrameVolOffset(pVol, div, lid);
+      uint64_t offset = vol_GetLogFrameVolOffset(pVol, div, lid);
 
       if ( !vol_Write(pVol, offset, (const uint8_t *)buf, EROS_PAGE_SIZE) )
-	diag_fatal(5, "Volume write failed at offset %d.\n", offset);
+	diag_fatal(5, "Volume write failed at offset %llu.\n",
+                 (unsigned long long) offset);
     }
   }
 
@@ -1543,14 +1750,14 @@ vol_WriteLogPage(Volume *pVol, const LID lid, const void * buf)
 /* given a division index and a OID, return the volume-relative
  * offset of the page pot for that OID
  */
-static uint32_t
+static uint64_t
 vol_GetOidPagePotVolOffset(Volume *pVol, int ndx, OID oid)
 {
   const Division *d = &pVol->divTable[ndx];
   OID startOid = get_target_oid(&d->startOid);
   uint32_t pagePotFrame;
-  uint32_t pageOffset;
-  uint32_t divStart;
+  uint64_t pageOffset;
+  uint64_t divStart;
 
   assert(d->type == dt_Object);
   assert(div_contains(d, oid));
@@ -1560,15 +1767,15 @@ vol_GetOidPagePotVolOffset(Volume *pVol, int ndx, OID oid)
   pagePotFrame = FrameToCluster(OIDToFrame(oid - startOid))
                  * RangeLocsPerCluster;
 
-  pageOffset = pagePotFrame * EROS_PAGE_SIZE;
-  divStart = d->start * EROS_SECTOR_SIZE;
+  pageOffset = (uint64_t) pagePotFrame * EROS_PAGE_SIZE;
+  divStart = (uint64_t) d->start * EROS_SECTOR_SIZE;
   
   return divStart + pageOffset;
 }
 
 static int
 vol_FindPagePotEntry(Volume *pVol, OID oid,
-  uint8_t data[EROS_PAGE_SIZE], uint32_t * pOffset)
+  uint8_t data[EROS_PAGE_SIZE], uint64_t * pOffset)
 {
   int div;
 
@@ -1579,7 +1786,7 @@ vol_FindPagePotEntry(Volume *pVol, OID oid,
     if ( d->type == dt_Object && div_contains(d, oid) ) {
       assert((startOid % EROS_OBJECTS_PER_FRAME) == 0);
 
-      uint32_t offset = vol_GetOidPagePotVolOffset(pVol, div, oid);
+      uint64_t offset = vol_GetOidPagePotVolOffset(pVol, div, oid);
 
       bool result = vol_Read(pVol, offset, data, EROS_PAGE_SIZE);
       if (! result)
@@ -1596,7 +1803,7 @@ vol_FindPagePotEntry(Volume *pVol, OID oid,
 bool
 vol_ReadPagePotEntry(Volume *pVol, OID oid, VolPagePot *pPagePot)
 {
-  uint32_t offset;
+  uint64_t offset;
   uint8_t data[EROS_PAGE_SIZE];
   int potEntry = vol_FindPagePotEntry(pVol, oid, data, &offset);
   if (potEntry >= 0) {
@@ -1614,7 +1821,7 @@ vol_ReadPagePotEntry(Volume *pVol, OID oid, VolPagePot *pPagePot)
 bool
 vol_WritePagePotEntry(Volume *pVol, OID oid, const VolPagePot *pPagePot)
 {
-  uint32_t offset;
+  uint64_t offset;
   uint8_t data[EROS_PAGE_SIZE];
   int potEntry = vol_FindPagePotEntry(pVol, oid, data, &offset);
   if (potEntry >= 0) {
@@ -1623,7 +1830,8 @@ vol_WritePagePotEntry(Volume *pVol, OID oid, const VolPagePot *pPagePot)
     tp->count[potEntry] = pPagePot->count;
 
     if ( !vol_Write(pVol, offset, data, EROS_PAGE_SIZE) )
-      diag_fatal(5, "Volume write failed at offset %d.\n", offset);
+      diag_fatal(5, "Volume write failed at offset %llu.\n",
+                 (unsigned long long) offset);
 
     return true;
   } else {
@@ -1662,7 +1870,7 @@ vol_ReadNode(Volume * pVol, OID oid, DiskNode * pNode)
     Division *d = &pVol->divTable[div];
     
     if (d->type == dt_Object && div_contains(d, oid)) {
-      uint32_t offset;
+      uint64_t offset;
       VolPagePot frameInfo;
 
       if (vol_ValidOid(pVol, div, oid) == false) {
@@ -1692,7 +1900,7 @@ vol_FormatNodeFrame(Volume *pVol, int div, OID frameOID)
   char buf[EROS_PAGE_SIZE];
   DiskNode * pdn = (DiskNode *) buf;
   int nd;
-  uint32_t offset;
+  uint64_t offset;
 
   bzero (buf, EROS_PAGE_SIZE);
 	
@@ -1740,12 +1948,12 @@ vol_WriteNode(Volume *pVol, OID oid, const DiskNode * pNode)
     
     if (d->type == dt_Object && div_contains(d, oid)) {
       VolPagePot frameInfo;
-      uint32_t offset;
+      uint64_t offset;
 
       vol_ReadPagePotEntry(pVol, oid, &frameInfo);
 
       if (frameInfo.type != FRM_TYPE_NODE) {
-	OID frameOID = oid & ~(EROS_OBJECTS_PER_FRAME - 1u);
+	OID frameOID = oid & ~(OID) (EROS_OBJECTS_PER_FRAME - 1);
 
 	diag_debug(1, "Re-tagging frame for OID 0x%08x%08x to %d\n",
 		    (uint32_t) (oid >> 32),
@@ -1764,7 +1972,8 @@ vol_WriteNode(Volume *pVol, OID oid, const DiskNode * pNode)
       offset = vol_GetOidVolOffset(pVol, div, oid);
 
       if ( !vol_Write(pVol, offset, pNode, sizeof(DiskNode)) )
-	diag_fatal(5, "Volume write failed at offset %d.\n", offset);
+	diag_fatal(5, "Volume write failed at offset %llu.\n",
+                 (unsigned long long) offset);
 
       return true;
     }
@@ -1779,7 +1988,90 @@ vol_WriteNode(Volume *pVol, OID oid, const DiskNode * pNode)
   return false;
 }
 
-	
+
+bool
+vol_WriteFrames(Volume *pVol, OID oid, uint32_t nFrames, uint8_t frameType,
+                const uint8_t *buf)
+{
+  Division *d = 0;
+  OID startOid;
+  frame_t relFrame;
+  int div;
+
+  assert((oid % EROS_OBJECTS_PER_FRAME) == 0);
+  assert(buf || frameType == FRM_TYPE_DPAGE);
+
+  if (nFrames == 0)
+    return true;
+
+  for (div = 0; div < pVol->topDiv; div++) {
+    d = &pVol->divTable[div];
+
+    if (d->type == dt_Object && div_contains(d, oid))
+      break;
+  }
+
+  if (div == pVol->topDiv
+      || !div_contains(d, oid + FrameToOID(nFrames - 1))) {
+    if (pVol->rewriting == false)
+      return false;
+
+    diag_fatal(1, "Cannot write %u frames at OID %#llx -- no home location\n",
+               nFrames, oid);
+  }
+
+  startOid = get_target_oid(&d->startOid);
+  relFrame = OIDToFrame(oid - startOid);
+
+  /* The frames of one cluster are contiguous on the volume, following
+   * their tag pot. Tag them all, then write them all. */
+  while (nFrames) {
+    uint8_t data[EROS_PAGE_SIZE];
+    TagPot * tp = (TagPot *) data;
+    unsigned int first = FrameIndexInCluster(relFrame);
+    uint32_t count = min(nFrames, FramesPerCluster - first);
+    uint64_t potOffset = vol_GetOidPagePotVolOffset(pVol, div, oid);
+    uint64_t offset = vol_GetOidFrameVolOffset(pVol, div, oid);
+    uint64_t len = (uint64_t) count * EROS_PAGE_SIZE;
+    uint32_t i;
+
+    if ( !vol_Read(pVol, potOffset, data, EROS_PAGE_SIZE) )
+      diag_fatal(5, "Volume read failed at offset %llu.\n",
+                 (unsigned long long) potOffset);
+
+    for (i = 0; i < count; i++) {
+      uint8_t tag = frameType;
+
+      if (buf == 0
+          || (frameType == FRM_TYPE_DPAGE
+              && PageIsZero(buf + i * EROS_PAGE_SIZE)))
+        tag |= TagIsZero;
+
+      tp->tags[first + i] = tag;
+    }
+
+    if ( !vol_Write(pVol, potOffset, data, EROS_PAGE_SIZE) )
+      diag_fatal(5, "Volume write failed at offset %llu.\n",
+                 (unsigned long long) potOffset);
+
+    if (buf) {
+      if ( !vol_Write(pVol, offset, buf, len) )
+        diag_fatal(5, "Volume write failed at offset %llu.\n",
+                   (unsigned long long) offset);
+      buf += len;
+    }
+    else if ( !vol_ZeroRange(pVol, offset, offset + len) )
+      diag_fatal(5, "Couldn't zero volume at offset %llu.\n",
+                 (unsigned long long) offset);
+
+    nFrames -= count;
+    relFrame += count;
+    oid += FrameToOID(count);
+  }
+
+  return true;
+}
+
 bool
 vol_ContainsNode(Volume *pVol, OID oid)
 {
@@ -52,6 +52,27 @@ typedef struct DiskObjectDescriptor CkptDirent;	// an older name
 struct ExecImage;
 struct CkptDirent;
 
+/* One entry of a generation's object directory, as recovered from
+ * the checkpoint log for post-mortem examination. */
+typedef struct LogDirent LogDirent;
+struct LogDirent {
+  OID oid;
+  LID lid;		/* UNUSED_LID if the object is all zero */
+  ObCount allocCount;
+  ObCount callCount;
+  uint8_t type;		/* capros_Range_otPage or capros_Range_otNode */
+};
+
+typedef struct LogGeneration LogGeneration;
+struct LogGeneration {
+  uint64_t generationNumber;
+  LID hdrLid;		/* LID of the generation header */
+  uint32_t nProcs;	/* number of process descriptors */
+  uint32_t nDirFrames;	/* object directory frames after the header */
+  uint32_t nDirent;
+  LogDirent * dirent;	/* sorted by OID */
+};
+
 typedef struct VolPagePot VolPagePot;
 struct VolPagePot {
   ObCount count;
@@ -98,6 +119,12 @@ struct Volume {
   struct CkptRoot * curDskCkpt;
   struct CkptRoot * oldDskCkpt;
   
+  /* The object directories of the generations in the current
+   * checkpoint, most recent first.  Empty until vol_LoadLogDirectory
+   * is called. */
+  LogGeneration * logGen;
+  uint32_t nLogGen;
+
 #if 0 // this is not working now ...
   ThreadDirent* threadDir;
   uint32_t nThreadDirent;
@@ -171,11 +198,22 @@ const VolHdr *vol_GetVolHdr(Volume *pVolume)
 
 bool vol_ReadLogPage(Volume *, const LID lid, void * buf);
 bool vol_WriteLogPage(Volume *, const LID lid, const void * buf);
+LID vol_IncrementLogLid(const Volume *, LID lid);
+
+/* Log directory support, for post-mortem examination of a volume: */
+bool vol_LoadLogDirectory(Volume *);
+void vol_FreeLogDirectory(Volume *);
+const LogDirent * vol_FindLogDirent(const LogGeneration *, OID oid);
 /* object I/O.  All of this assumes allocation/call count of 0! */
 bool vol_ReadDataPage(Volume *, OID oid, uint8_t* buf);
 bool vol_WriteDataPage(Volume *, OID oid, const uint8_t* buf);
 bool vol_ReadNode(Volume *, OID oid, DiskNode * node);
 bool vol_WriteNode(Volume *, OID oid, const DiskNode * node);
+/* Write nFrames consecutive frames of one type, starting at oid,
+ * in as few large writes as the volume layout allows.
+ * buf holds the frame contents, or is NULL for zero pages. */
+bool vol_WriteFrames(Volume *, OID oid, uint32_t nFrames, uint8_t frameType,
+                     const uint8_t * buf);
 bool vol_GetPagePotInfo(Volume *, OID oid, VolPagePot *);
 bool vol_ReadPagePotEntry(Volume *, OID oid, VolPagePot *);
 bool vol_WritePagePotEntry(Volume *, OID oid, const VolPagePot *);
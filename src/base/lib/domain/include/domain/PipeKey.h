@@ -26,12 +26,22 @@
    all machines we currently support. */
 #define PIPE_BUF_SZ 4096
 
+/* Writes of at most this many bytes are never interleaved with data
+   from other writers. */
+#define PIPE_ATOMIC_SZ 512
+
+/* Maximum number of readers, and separately of writers, that can be
+   waiting on a pipe at once. */
+#define PIPE_MAX_WAITERS 32
+
 
 #define OC_Pipe_Read			    1
 #define OC_Pipe_Write			    2
 #define OC_Pipe_Close			    3
+#define OC_Pipe_AddRef			    4
 
 #define RC_EOF                              1
+#define RC_Pipe_Full                        2
 
 #ifndef __ASSEMBLER__
 
@@ -41,6 +51,7 @@ uint32_t pipe_create(uint32_t krPipeCre, uint32_t krBank,
 			     uint32_t krRpipe /* OUT */);
 
 uint32_t pipe_close(uint32_t krPipe);
+uint32_t pipe_addref(uint32_t krPipe);
 
 uint32_t pipe_write(uint32_t krPipe, uint32_t len, const uint8_t *inBuf,
 		    uint32_t *outLen);
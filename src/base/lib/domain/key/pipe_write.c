@@ -59,6 +59,7 @@ pipe_write(uint32_t krPipe, uint32_t len, const uint8_t *buf, uint32_t *outLen)
   };
 
   msg.snd_invKey = krPipe;
+  msg.snd_w3 = 0;
      
   do {
     uint32_t rqLen = resid;
@@ -73,6 +74,10 @@ pipe_write(uint32_t krPipe, uint32_t len, const uint8_t *buf, uint32_t *outLen)
 
     resid -= msg.rcv_w1;
     outbuf += msg.rcv_w1;
+
+    /* If we were queued, the pipe hands us a ticket that holds our
+       place; present it when we resend. */
+    msg.snd_w3 = msg.rcv_w2;
   } while (resid && result == RC_OK);
   
   *outLen = len - resid;
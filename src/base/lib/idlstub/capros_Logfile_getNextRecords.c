@@ -51,5 +51,7 @@ capros_Logfile_getNextRecords(cap_t _self, capros_Logfile_RecordID thisRL,
   CALL(&msg);
   if (msg.rcv_code == RC_OK)
     *lengthGotten = msg.rcv_sent;
+  else if (msg.rcv_code == RC_capros_Logfile_TooSmall)
+    *lengthGotten = msg.rcv_w1;	// the length of the first record
   return msg.rcv_code;
 }
@@ -172,6 +172,12 @@ ifndef EROS_HD
 EROS_HD=/dev/null
 endif
 
+# Operations that capidl gives a batch companion, as -b options, e.g.
+# CAPIDL_BATCH=-b capros.Number.get
+# The runs that make the headers and stubs of all the IDL get them;
+# a domain that generates a c-server for one of these operations
+# must pass them too, so that it agrees with the header.
+CAPIDL_BATCH=
 CAPIDL=$(EROS_SRC)/build/bin/capidl
 #HTMLCAPIDL = $(EROS_SRC)/build/bin/coyotos-capidl
 #HTMLCAPIDL = /home/clandau/coyotos/src/ccs/capidl/BUILD/capidl
@@ -42,6 +42,9 @@
 
 bool showparse = false;
 bool opt_dispatchers = false;
+bool opt_direct_regs = false;
+bool opt_zero_copy = false;
+std::vector<const char *> batchOps;	// operations named with -b
 extern int yyparse(void *);
 
 // Include locations specified on the command line with -I:
@@ -288,7 +291,7 @@ main(int argc, char *argv[])
   app_init("capidl");
 
   while ((c = getopt(argc, argv, 
-		     "D:X:A:sdvl:o:I:h:"
+		     "D:X:A:b:srzdvl:o:I:h:"
 		     )) != -1) {
 
     switch(c) {
@@ -328,6 +331,22 @@ main(int argc, char *argv[])
       opt_dispatchers = true;
       break;
 
+    case 'r':
+      /* c-server: pass register arguments straight from the message */
+      opt_direct_regs = true;
+      break;
+
+    case 'z':
+      /* c-stubs, c-server: pass single byte strings in place */
+      opt_zero_copy = true;
+      break;
+
+    case 'b':
+      /* c-header, c-stubs, c-server: give the named operation
+	 (e.g. capros.Node.getSlot) a batch companion */
+      batchOps.push_back(optarg);
+      break;
+
     case 'h':
       cHeaderName = optarg;
       break;
@@ -350,7 +369,7 @@ main(int argc, char *argv[])
 
   if (opterr)
     diag_fatal(1, "Usage: capidl -D target-dir [-v] [-d] [-nostdinc] [-Idir] [-Ddef] "
-		"[-Aassert] [-o server-file.c] [-o server-header-name.h] -l language idl_file\n");
+		"[-Aassert] [-o server-file.c] [-o server-header-name.h] [-r] [-z] [-b package.interface.op] -l language idl_file\n");
 
   if (verbose)
     app_SetInteractive();
@@ -383,6 +402,13 @@ main(int argc, char *argv[])
 
   symbol_ResolveIfDepth(symbol_UniversalScope);
 
+  for (const auto eachName : batchOps) {
+    Symbol *op = symbol_LookupChild(symbol_UniversalScope, eachName, 0);
+
+    if (op == 0 || op->cls != sc_operation)
+      diag_fatal(1, "-b %s does not name an operation\n", eachName);
+  }
+
   if (!symbol_TypeCheck(symbol_UniversalScope))
     diag_fatal(1, "Type errors are present.\n");
 
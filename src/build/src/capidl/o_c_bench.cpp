@@ -0,0 +1,602 @@
+/*
+ * Copyright (C) 2026, Strawberry Development Group.
+ *
+ * This file is part of the CapROS Operating System runtime library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330 Boston, MA 02111-1307, USA.
+ */
+
+/* The c-bench back end emits a host program that measures the cost of
+   the generated stubs and server code for the interfaces of a file.
+   The program contains the c-server dispatch code, a trivial
+   implementation of each operation, and a CALL() that copies the
+   message to the server and the reply back, as the kernel would.
+   The client stubs are #included by name, so compile it with the
+   c-stubs output directory, generated with the same options, on the
+   include path.  Each string is filled to its IDL bound in both
+   directions, and a call that fails or returns a short string stops
+   the program.  For each operation it prints the time per call and
+   the number of message string bytes copied per call; the batch
+   companion of an operation (-b) is timed per request.  Generate it
+   with and without -r and -z to compare the marshalling modes. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <errno.h>
+#include <vector>
+
+/* GNU multiple precision library: */
+#include <gmp.h>
+
+#include <applib/xmalloc.h>
+#include <applib/Intern.h>
+#include <applib/Diag.h>
+#include <applib/PtrVec.h>
+#include <applib/path.h>
+#include <applib/buffer.h>
+#include "SymTab.h"
+#include "util.h"
+#include "backend.h"
+#include "o_c_util.h"
+
+extern MP_INT compute_value(Symbol *s);
+extern bool opt_direct_regs;
+extern bool opt_zero_copy;
+
+/* From o_c_server.cpp: */
+extern size_t size_server_buffer(Symbol *scope, bool output);
+extern void compute_server_dependencies(Symbol *scope, PtrVec *vec);
+extern void emit_server_code(Symbol *universalScope, FILE *outFile);
+
+/* The number of elements the benchmark puts in a string of sequence
+   type seqType.  An unbounded sequence is sent empty. */
+static unsigned
+seq_count(Symbol *seqType)
+{
+  if (seqType->value == 0)
+    return 0;
+
+  MP_INT bound = compute_value(seqType->value);
+  return mpz_get_ui(&bound);
+}
+
+static unsigned
+seq_bytes(Symbol *seqType)
+{
+  return seq_count(seqType) * symbol_directSize(seqType->type);
+}
+
+/* Collect the operations the server code dispatches: those of each
+   interface and its base interfaces, in the order emit_decoders()
+   visits them. */
+static void
+collect_impl_ops(Symbol *s, std::vector<Symbol *> & ops)
+{
+  if (s->mark)
+    return;
+
+  s->mark = true;
+
+  switch(s->cls) {
+  case sc_absinterface:
+  case sc_interface:
+    {
+      if (s->baseType)
+	collect_impl_ops(symbol_ResolveRef(s->baseType), ops);
+
+      for (const auto eachChild : s->children)
+	collect_impl_ops(eachChild, ops);
+
+      return;
+    }
+
+  case sc_operation:
+    {
+      if ((s->flags & SF_NO_OPCODE) == 0)
+	ops.push_back(s);
+
+      return;
+    }
+
+  default:
+    return;
+  }
+}
+
+/* Collect the interfaces of the file, and the operations of those
+   interfaces that have both a stub and a server dispatcher. */
+static void
+collect_bench_ifs(Symbol *scope, std::vector<Symbol *> & ifs,
+		  std::vector<Symbol *> & ops)
+{
+  for (const auto eachChild : scope->children) {
+    if (eachChild->cls == sc_package)
+      collect_bench_ifs(eachChild, ifs, ops);
+    else if (eachChild->isActiveUOC
+	     && (eachChild->cls == sc_interface
+		 || eachChild->cls == sc_absinterface)) {
+      ifs.push_back(eachChild);
+
+      for (const auto eachOp : eachChild->children)
+	if (eachOp->cls == sc_operation
+	    && (eachOp->flags & (SF_NOSTUB | SF_NO_OPCODE)) == 0)
+	  ops.push_back(eachOp);
+    }
+  }
+}
+
+static void
+emit_impl_op(Symbol *s, FILE *outFile)
+{
+  fprintf(outFile, "\nfixreg_t\nimplement_%s(",
+	  symbol_QualifiedName(s, '_'));
+
+  bool first = true;
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+    assert(fsym);
+
+    /* Use the declared type, as the dispatcher does, so that a
+       sequence keeps its typedef name. */
+    Symbol *argType = symbol_ResolveRef(eachChild->type);
+
+    if (!first)
+      fprintf(outFile, ", ");
+    else
+      first = false;
+
+    output_c_type(argType, outFile, 0);
+    fprintf(outFile, fsym->isOutput ? " * %s" : " %s", eachChild->name);
+  }
+  if (first)
+    fprintf(outFile, "void");
+  fprintf(outFile, ")\n{\n");
+
+  /* The client sends every string full. */
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+    Symbol *argBaseType = symbol_ResolveType(fsym->type);
+
+    if (fsym->isOutput || ! symbol_IsVarSequenceType(argBaseType))
+      continue;
+
+    do_indent(outFile, 2);
+    fprintf(outFile, "if (%s.len != %u)\n", eachChild->name,
+	    seq_count(argBaseType));
+    do_indent(outFile, 4);
+    fprintf(outFile, "return RC_capros_key_RequestError;\n");
+  }
+
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+    Symbol *argBaseType = symbol_ResolveType(fsym->type);
+
+    if (! fsym->isOutput)
+      continue;
+
+    do_indent(outFile, 2);
+    if (symbol_IsVarSequenceType(argBaseType)) {
+      fprintf(outFile, "%s->data = (", eachChild->name);
+      output_c_type(argBaseType->type, outFile, 0);
+      fprintf(outFile, " *) bench_serverData;\n");
+      do_indent(outFile, 2);
+      fprintf(outFile, "%s->len = %u;\n", eachChild->name,
+	      seq_count(argBaseType));
+    }
+    else
+      fprintf(outFile, "memset(%s, 0, sizeof(*%s));\n",
+	      eachChild->name, eachChild->name);
+  }
+
+  do_indent(outFile, 2);
+  fprintf(outFile, "return RC_OK;\n");
+  fprintf(outFile, "}\n");
+}
+
+/* Emit a function that calls the stub for operation s n times. */
+static void
+emit_bench_op(Symbol *s, FILE *outFile)
+{
+  fprintf(outFile, "\nstatic void\nbench_%s(cap_t _self, unsigned long n)\n{\n",
+	  symbol_QualifiedName(s, '_'));
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned long i;\n");
+
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+
+    if (symbol_IsInterface(fsym->type))
+      continue;
+
+    do_indent(outFile, 2);
+    output_c_type(fsym->type, outFile, 0);
+    fprintf(outFile, " %s;\n", eachChild->name);
+  }
+
+  fprintf(outFile, "\n");
+
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+    Symbol *argBaseType = symbol_ResolveType(fsym->type);
+
+    if (symbol_IsInterface(fsym->type))
+      continue;
+
+    do_indent(outFile, 2);
+    if (symbol_IsVarSequenceType(argBaseType)) {
+      unsigned count = seq_count(argBaseType);
+
+      fprintf(outFile, "%s.data = (", eachChild->name);
+      output_c_type(argBaseType->type, outFile, 0);
+      fprintf(outFile, " *) bench_clientData;\n");
+      do_indent(outFile, 2);
+      fprintf(outFile, "%s.max = %u;\n", eachChild->name, count);
+      do_indent(outFile, 2);
+      fprintf(outFile, "%s.len = %u;\n", eachChild->name,
+	      fsym->isOutput ? 0 : count);
+    }
+    else
+      fprintf(outFile, "memset(&%s, 0, sizeof(%s));\n",
+	      eachChild->name, eachChild->name);
+  }
+
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "for (i = 0; i < n; i++)\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "if (%s(_self", symbol_QualifiedName(s, '_'));
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+
+    if (symbol_IsInterface(fsym->type))
+      fprintf(outFile, ", KR_VOID");
+    else
+      fprintf(outFile, fsym->isOutput ? ", &%s" : ", %s", eachChild->name);
+  }
+  fprintf(outFile, ") != RC_OK)\n");
+  do_indent(outFile, 6);
+  fprintf(outFile, "bench_fail(\"%s\", \"call failed\");\n",
+	  symbol_QualifiedName(s, '.'));
+
+  /* The server replies with every string full. */
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+    Symbol *argBaseType = symbol_ResolveType(fsym->type);
+
+    if (! fsym->isOutput || ! symbol_IsVarSequenceType(argBaseType))
+      continue;
+
+    do_indent(outFile, 2);
+    fprintf(outFile, "if (%s.len != %u)\n", eachChild->name,
+	    seq_count(argBaseType));
+    do_indent(outFile, 4);
+    fprintf(outFile, "bench_fail(\"%s\", \"short %s\");\n",
+	    symbol_QualifiedName(s, '.'), eachChild->name);
+  }
+  fprintf(outFile, "}\n");
+}
+
+/* Emit a function that invokes the batch companion of operation s
+   (see op_is_batched()) with full batches until it has made n
+   requests. */
+static void
+emit_bench_batch_op(Symbol *s, FILE *outFile)
+{
+  const char *qn = symbol_QualifiedName(s, '_');
+
+  fprintf(outFile, "\nstatic void\nbench_%s_batch(cap_t _self, unsigned long n)\n{\n",
+	  qn);
+  do_indent(outFile, 2);
+  fprintf(outFile, "static %s_batchIn in[%s_batchMax];\n", qn, qn);
+  do_indent(outFile, 2);
+  fprintf(outFile, "static %s_batchOut out[%s_batchMax];\n", qn, qn);
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned long i;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned long done;\n");
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "for (i = 0; i < n; i += %s_batchMax)\n", qn);
+  do_indent(outFile, 4);
+  fprintf(outFile, "if (%s_batch(_self, %s_batchMax, in, out, &done) != RC_OK\n",
+	  qn, qn);
+  do_indent(outFile, 8);
+  fprintf(outFile, "|| done != %s_batchMax)\n", qn);
+  do_indent(outFile, 6);
+  fprintf(outFile, "bench_fail(\"%s\", \"batch failed\");\n",
+	  symbol_QualifiedName(s, '.'));
+  fprintf(outFile, "}\n");
+}
+
+/* Emit a message buffer big enough for sz bytes and for a full
+   batch of each batched operation. */
+static void
+emit_loopback_buffer(const char *name, size_t sz, const char *record,
+		     std::vector<Symbol *> const & ops, FILE *outFile)
+{
+  fprintf(outFile, "static union {\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "uint64_t msg[%u];\n", round_up(max(sz, 1), 8) / 8);
+  for (const auto eachOp : ops) {
+    if (!op_is_batched(eachOp))
+      continue;
+
+    const char *qn = symbol_QualifiedName(eachOp, '_');
+    do_indent(outFile, 2);
+    fprintf(outFile, "%s_%s %s[%s_batchMax];\n", qn, record, qn, qn);
+  }
+  fprintf(outFile, "} %s;\n", name);
+}
+
+static void
+emit_loopback(std::vector<Symbol *> const & ifs,
+	      std::vector<Symbol *> const & ops, size_t rcvSz, size_t sndSz,
+	      FILE *outFile)
+{
+  fprintf(outFile, "\n");
+  emit_loopback_buffer("bench_rcvBuf", rcvSz, "batchIn", ops, outFile);
+  emit_loopback_buffer("bench_sndBuf", sndSz, "batchOut", ops, outFile);
+
+  fprintf(outFile, "\n/* The server dispatcher for each interface, "
+	  "indexed by the invoked key. */\n");
+  fprintf(outFile, "static const OpDispatchFn bench_if[] = {\n");
+  for (const auto eachIf : ifs) {
+    do_indent(outFile, 2);
+    fprintf(outFile, "DISPATCH_IF_%s,\n", symbol_QualifiedName(eachIf, '_'));
+  }
+  fprintf(outFile, "};\n");
+
+  fprintf(outFile, "\n/* Deliver the message to the server and the reply "
+	  "to the client,\n   copying the strings as the kernel would. */\n");
+  fprintf(outFile, "fixreg_t\nCALL(Message *m)\n{\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "Message s;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "IfInfo info;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned long len = m->snd_len;\n");
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "if (len > sizeof(bench_rcvBuf))\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "len = sizeof(bench_rcvBuf);\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "memset(&s, 0, sizeof(s));\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "memset(&info, 0, sizeof(info));\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "memcpy(&bench_rcvBuf, m->snd_data, len);\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "bench_bytes += len;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "s.rcv_code = m->snd_code;\n");
+  for (unsigned w = 1; w < MAX_REGS; w++) {
+    do_indent(outFile, 2);
+    fprintf(outFile, "s.rcv_w%u = m->snd_w%u;\n", w, w);
+  }
+  do_indent(outFile, 2);
+  fprintf(outFile, "s.rcv_data = &bench_rcvBuf;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "s.rcv_limit = sizeof(bench_rcvBuf);\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "s.rcv_sent = len;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "s.snd_data = &bench_sndBuf;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "s.snd_code = RC_capros_key_UnknownRequest;\n");
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "bench_if[m->snd_invKey](&s, &info);\n");
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "len = s.snd_len;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "if (len > m->rcv_limit)\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "len = m->rcv_limit;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "memcpy(m->rcv_data, s.snd_data, len);\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "bench_bytes += len;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "m->rcv_sent = len;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "m->rcv_code = s.snd_code;\n");
+  for (unsigned w = 1; w < MAX_REGS; w++) {
+    do_indent(outFile, 2);
+    fprintf(outFile, "m->rcv_w%u = s.snd_w%u;\n", w, w);
+  }
+  do_indent(outFile, 2);
+  fprintf(outFile, "return s.snd_code;\n");
+  fprintf(outFile, "}\n");
+}
+
+static void
+emit_main(std::vector<Symbol *> const & ifs,
+	  std::vector<Symbol *> const & ops, FILE *outFile)
+{
+  fprintf(outFile, "\nstatic const struct {\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "const char *name;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "void (*fn)(cap_t _self, unsigned long n);\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "cap_t self;\n");
+  fprintf(outFile, "} bench_ops[] = {\n");
+  for (const auto eachOp : ops) {
+    unsigned ifNdx = 0;
+    while (ifs[ifNdx] != eachOp->nameSpace)
+      ifNdx++;
+
+    do_indent(outFile, 2);
+    fprintf(outFile, "{ \"%s\", bench_%s, %u },\n",
+	    symbol_QualifiedName(eachOp, '.'),
+	    symbol_QualifiedName(eachOp, '_'), ifNdx);
+
+    if (op_is_batched(eachOp)) {
+      do_indent(outFile, 2);
+      fprintf(outFile, "{ \"%s (batch)\", bench_%s_batch, %u },\n",
+	      symbol_QualifiedName(eachOp, '.'),
+	      symbol_QualifiedName(eachOp, '_'), ifNdx);
+    }
+  }
+  fprintf(outFile, "};\n");
+
+  fprintf(outFile, "\nint\nmain(int argc, char *argv[])\n{\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned long n = (argc > 1) ? strtoul(argv[1], 0, 0) : 100000;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned i;\n");
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "if (n == 0)\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "n = 1;\n");
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "printf(\"capidl marshalling:%s%s\\n\");\n",
+	  opt_direct_regs ? " -r" : "",
+	  opt_zero_copy ? " -z" : (opt_direct_regs ? "" : " default"));
+  do_indent(outFile, 2);
+  fprintf(outFile, "for (i = 0; i < sizeof(bench_ops) / sizeof(bench_ops[0]); i++) {\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "struct timespec t0, t1;\n");
+  fprintf(outFile, "\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "bench_bytes = 0;\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "clock_gettime(CLOCK_MONOTONIC, &t0);\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "bench_ops[i].fn(bench_ops[i].self, n);\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "clock_gettime(CLOCK_MONOTONIC, &t1);\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "printf(\"%%-48s %%10.1f ns/call %%8lu bytes/call\\n\", bench_ops[i].name,\n");
+  do_indent(outFile, 11);
+  fprintf(outFile, "((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n,\n");
+  do_indent(outFile, 11);
+  fprintf(outFile, "bench_bytes / n);\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "}\n");
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "return 0;\n");
+  fprintf(outFile, "}\n");
+}
+
+void
+output_c_bench(Symbol *universalScope, BackEndFn fn)
+{
+  extern const char *outputFileName;
+  FILE *outFile;
+  unsigned i;
+
+  PtrVec *vec = ptrvec_create();
+  std::vector<Symbol *> implOps;
+  std::vector<Symbol *> benchIfs;
+  std::vector<Symbol *> benchOps;
+
+  if (outputFileName == 0)
+    diag_fatal(1, "Need to provide output file name.\n");
+
+  if (strcmp(outputFileName, "-") == 0 )
+    outFile = stdout;
+  else {
+    outFile = fopen(outputFileName, "w");
+    if (outFile == NULL)
+      diag_fatal(1, "Could not open output file \"%s\" -- %s\n",
+		 outputFileName, strerror(errno));
+  }
+
+  compute_server_dependencies(universalScope, vec);
+
+  collect_bench_ifs(universalScope, benchIfs, benchOps);
+  if (benchOps.empty())
+    diag_warning("c-bench: no operation in \"%s\" has a generated stub "
+		 "and server, so there is nothing to measure\n",
+		 outputFileName);
+
+  symbol_ClearAllMarks(universalScope);
+  for (const auto eachIf : benchIfs)
+    collect_impl_ops(eachIf, implOps);
+
+  /* Both sides point their strings at a buffer big enough for the
+     largest one. */
+  unsigned dataBytes = 0;
+  for (const auto eachOp : implOps)
+    for (const auto eachChild : eachOp->children) {
+      Symbol *argBaseType = symbol_ResolveType(eachChild->type);
+      if (symbol_IsVarSequenceType(argBaseType))
+	dataBytes = max(dataBytes, seq_bytes(argBaseType));
+    }
+
+  fprintf(outFile, "#include <stdio.h>\n");
+  fprintf(outFile, "#include <stdlib.h>\n");
+  fprintf(outFile, "#include <string.h>\n");
+  fprintf(outFile, "#include <time.h>\n");
+  fprintf(outFile, "#include <stdbool.h>\n");
+  fprintf(outFile, "#include <stddef.h>\n");
+  fprintf(outFile, "#include <alloca.h>\n");
+  fprintf(outFile, "#include <eros/target.h>\n");
+  fprintf(outFile, "#include <eros/Invoke.h>\n");
+
+  for (i = 0; i < vec_len(vec); i++)
+    fprintf(outFile, "#include <idl/%s.h>\n",
+	    symbol_QualifiedName(symvec_fetch(vec,i), '/'));
+
+  fprintf(outFile, "\n");
+  if (dataBytes) {
+    fprintf(outFile, "static uint64_t bench_clientData[%u];\n",
+	    round_up(dataBytes, 8) / 8);
+    fprintf(outFile, "static uint64_t bench_serverData[%u];\n",
+	    round_up(dataBytes, 8) / 8);
+  }
+  fprintf(outFile, "static unsigned long bench_bytes;"
+	  "\t/* string bytes copied by CALL */\n");
+  if (! benchOps.empty()) {
+    fprintf(outFile, "\nstatic void\nbench_fail(const char *op, const char *why)\n{\n");
+    do_indent(outFile, 2);
+    fprintf(outFile, "fprintf(stderr, \"%%s: %%s\\n\", op, why);\n");
+    do_indent(outFile, 2);
+    fprintf(outFile, "exit(1);\n");
+    fprintf(outFile, "}\n");
+  }
+
+  for (const auto eachOp : implOps)
+    emit_impl_op(eachOp, outFile);
+
+  emit_server_code(universalScope, outFile);
+
+  emit_loopback(benchIfs, benchOps, size_server_buffer(universalScope, false),
+		size_server_buffer(universalScope, true), outFile);
+
+  fprintf(outFile, "\n");
+  for (const auto eachOp : benchOps)
+    fprintf(outFile, "#include \"%s.c\"\n", symbol_QualifiedName(eachOp, '_'));
+
+  for (const auto eachOp : benchOps) {
+    emit_bench_op(eachOp, outFile);
+    if (op_is_batched(eachOp))
+      emit_bench_batch_op(eachOp, outFile);
+  }
+
+  emit_main(benchIfs, benchOps, outFile);
+
+  if (outFile != stdout)
+    fclose(outFile);
+}
@@ -354,6 +354,65 @@ print_typedef(Symbol *s, FILE *out, int indent)
   print_asmendif(out);
 }
 
+/* Declare the request and result records and the stub of the batch
+   companion of operation s; see op_is_batched().  A request names
+   the key to send for each input key and the key register to receive
+   each output key in; results carry no keys. */
+static void
+print_batch_decls(Symbol *s, FILE *out, int indent)
+{
+  const char *qn = symbol_QualifiedName(s,'_');
+  bool haveInput = false;
+
+  fprintf(out, "\n");
+  do_indent(out, indent);
+  fprintf(out, "#define %s_batchMax %u\n", qn, batch_max(s));
+
+  print_asmifdef(out);
+  do_indent(out, indent);
+  fprintf(out, "typedef struct %s_batchIn {\n", qn);
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+
+    if (fsym->isOutput && !symbol_IsInterface(fsym->type))
+      continue;
+
+    do_indent(out, indent + 2);
+    output_c_type(eachChild->type, out, indent + 2);
+    fprintf(out, " %s;\n", eachChild->name);
+    haveInput = true;
+  }
+  if (!haveInput) {
+    do_indent(out, indent + 2);
+    fprintf(out, "uint32_t unused;\n");
+  }
+  do_indent(out, indent);
+  fprintf(out, "} %s_batchIn;\n", qn);
+
+  do_indent(out, indent);
+  fprintf(out, "typedef struct %s_batchOut {\n", qn);
+  do_indent(out, indent + 2);
+  fprintf(out, "result_t rc;\n");
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+
+    if (! fsym->isOutput || symbol_IsInterface(fsym->type))
+      continue;
+
+    do_indent(out, indent + 2);
+    output_c_type(eachChild->type, out, indent + 2);
+    fprintf(out, " %s;\n", eachChild->name);
+  }
+  do_indent(out, indent);
+  fprintf(out, "} %s_batchOut;\n", qn);
+
+  do_indent(out, indent);
+  fprintf(out, "result_t %s_batch(cap_t _self, unsigned long count, "
+	  "const %s_batchIn *in, %s_batchOut *out, "
+	  "unsigned long *completed);\n", qn, qn, qn);
+  print_asmendif(out);
+}
+
 static void
 symdump(Symbol *s, FILE *out, int indent)
 {
@@ -473,6 +532,12 @@ symdump(Symbol *s, FILE *out, int indent)
   case sc_absinterface:
     {
       unsigned opr_ndx=1;	// opcode 0 is (arbitrarily) reserved
+      unsigned nOpr = 0;
+
+      /* Batch companions are numbered after all the operations. */
+      for (const auto eachChild : s->children)
+	if (eachChild->cls == sc_operation)
+	  nOpr++;
 
       unsigned long sig = symbol_CodedName(s);
 
@@ -511,7 +576,12 @@ symdump(Symbol *s, FILE *out, int indent)
 	  else {
 	    fprintf(out, "\n#define OC_%s 0x%x\n",
 		    symbol_QualifiedName(eachChild,'_'),
-		    ((s->ifDepth << 24) | opr_ndx++));
+		    ((s->ifDepth << 24) | opr_ndx));
+	    if (op_is_batched(eachChild))
+	      fprintf(out, "#define OC_%s_batch 0x%x\n",
+		      symbol_QualifiedName(eachChild,'_'),
+		      ((s->ifDepth << 24) | (nOpr + opr_ndx)));
+	    opr_ndx++;
 	  }
 	}
 
@@ -587,6 +657,9 @@ symdump(Symbol *s, FILE *out, int indent)
       }
 
       print_asmendif(out);
+
+      if (op_is_batched(s))
+	print_batch_decls(s, out, indent);
       break;
     }
 
@@ -44,6 +44,13 @@
 
 #define max(a,b) ((a > b) ? (a) : (b))
 
+/* Opcodes are (interface depth << 24) | index within the interface;
+   see o_c_hdr.cpp. */
+#define OPCODE_DEPTH_SHIFT 24
+#define OPCODE_INDEX_MASK  0xffffffu
+
+extern bool opt_direct_regs;
+
 static Buffer *preamble;
 
 
@@ -92,7 +99,7 @@ emit_pass_from_reg(FILE *outFile, Symbol *arg, unsigned regCount)
 
     fprintf(outFile, "((");
     output_c_type(argType, outFile, 0);
-    fprintf(outFile, ") msg.rcv_w%d)", regCount);
+    fprintf(outFile, ") msg->rcv_w%d)", regCount);
 
     if (bitsInput)
       fprintf(outFile, "<< %d)", bitsInput);
@@ -132,6 +139,40 @@ emit_return_via_reg(FILE *outFile, Symbol *arg, int indent, unsigned regCount)
   }
 }
 
+/* Declare the sequence for a zero-copy string (see zero_copy_string)
+   and point it at the message buffer.  The pointer that the rest of
+   the dispatcher uses has the same name and type as in the general
+   case. */
+static void
+emit_zero_copy_string(FILE *outFile, std::vector<StringArg> const & argVec,
+		      bool output)
+{
+  FormalSym * fsym = argVec[0].fsym;
+  Symbol *argType = symbol_ResolveRef(fsym->type);
+  Symbol *argBaseType = symbol_ResolveType(argType);
+  unsigned bound = zero_copy_bound(argVec);
+
+  do_indent(outFile, 2);
+  output_c_type(argType, outFile, 0);
+  fprintf(outFile, " _CAPIDL_%s;\n", fsym->name);
+  do_indent(outFile, 2);
+  output_c_type(argType, outFile, 0);
+  fprintf(outFile, " *%s = &_CAPIDL_%s;\n", fsym->name, fsym->name);
+
+  do_indent(outFile, 2);
+  fprintf(outFile, "%s->data = (", fsym->name);
+  output_c_type(argBaseType->type, outFile, 0);
+  fprintf(outFile, " *) msg->%s_data;\n", output ? "snd" : "rcv");
+  do_indent(outFile, 2);
+  fprintf(outFile, "%s->max = %u;\n", fsym->name, bound);
+  do_indent(outFile, 2);
+  if (output)
+    fprintf(outFile, "%s->len = 0;\n", fsym->name);
+  else
+    fprintf(outFile, "%s->len = (msg->rcv_sent < %u ? msg->rcv_sent : %u);\n",
+	    fsym->name, bound, bound);
+}
+
 static void
 emit_op_dispatcher(Symbol *s, FILE *outFile)
 {
@@ -153,6 +194,15 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
   unsigned rcvIndirect = compute_indirect_bytes(analArgs.inString);
   unsigned sndIndirect = compute_indirect_bytes(analArgs.outString);
 
+  /* A zero-copy string is the whole message string, so it has no
+     header and no indirect part. */
+  bool zcRcv = zero_copy_string(analArgs.inString);
+  bool zcSnd = zero_copy_string(analArgs.outString);
+  if (zcRcv)
+    rcvIndirect = 0;
+  if (zcSnd)
+    sndIndirect = 0;
+
   rcvDirect = round_up(rcvDirect, 8);
   sndDirect = round_up(sndDirect, 8);
 
@@ -179,27 +229,44 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
   fprintf(outFile, "/* Emit OP %s */\n", symbol_QualifiedName(s, '_'));
 
   /* Pass 1: emit the declarations for the direct variables */
-  if (! analArgs.inDataRegs.empty() || ! analArgs.inString.empty()) {
+  if (! analArgs.inDataRegs.empty() || ! analArgs.inString.empty()
+      || ! analArgs.inKeyRegs.empty()) {
     do_indent(outFile, 2);
     fprintf(outFile, "/* Incoming arguments */\n");
 
+    /* Keys arrive in the receive key registers in argument order. */
+    unsigned rcv_keycount = 0;
+    for (const auto eachKey : analArgs.inKeyRegs) {
+      do_indent(outFile, 2);
+      fprintf(outFile, "cap_t %s = msg->rcv_key%u;\n", eachKey->name,
+	      rcv_keycount++);
+    }
+
     if (! analArgs.inDataRegs.empty()) {
       unsigned rcv_regcount = FIRST_REG;
 
       for (const auto eachRcvReg : analArgs.inDataRegs) {
 	Symbol *argType = symbol_ResolveRef(eachRcvReg->type);
 
-	do_indent(outFile, 2);
-	output_c_type(argType, outFile, 0);
-	fprintf(outFile, " %s = ", eachRcvReg->name);
+	needRegs = can_registerize(argType, rcv_regcount);
+
+	/* With opt_direct_regs, the registers are passed straight to
+	   the implementation in pass 3 instead. */
+	if (! opt_direct_regs) {
+	  do_indent(outFile, 2);
+	  output_c_type(argType, outFile, 0);
+	  fprintf(outFile, " %s = ", eachRcvReg->name);
 
-	emit_pass_from_reg(outFile, eachRcvReg, rcv_regcount);
-	fprintf(outFile, ";\n");
+	  emit_pass_from_reg(outFile, eachRcvReg, rcv_regcount);
+	  fprintf(outFile, ";\n");
+	}
 	rcv_regcount += needRegs;
       }
     }
 
-    for (const auto & eachrcvString : analArgs.inString) {
+    if (zcRcv)
+      emit_zero_copy_string(outFile, analArgs.inString, false);
+    else for (const auto & eachrcvString : analArgs.inString) {
       FormalSym * fsym = eachrcvString.fsym;
       Symbol *argType = symbol_ResolveRef(fsym->type);
       Symbol *argBaseType = symbol_ResolveType(argType);
@@ -218,10 +285,16 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
     fprintf(outFile, "\n");
   }
 
-  if (! analArgs.outString.empty() || ! analArgs.outDataRegs.empty()) {
+  if (! analArgs.outString.empty() || ! analArgs.outDataRegs.empty()
+      || ! analArgs.outKeyRegs.empty()) {
     do_indent(outFile, 2);
     fprintf(outFile, "/* Outgoing arguments */\n");
 
+    for (const auto eachKey : analArgs.outKeyRegs) {
+      do_indent(outFile, 2);
+      fprintf(outFile, "cap_t %s = KR_VOID;\n", eachKey->name);
+    }
+
     /* For the outbound registerizables, we need to declare variables so
        that we can pass pointers of the expected type. Casting the word
        fields as in "(char *) &msg.rcv_w0" could create problems on
@@ -237,7 +310,9 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
       sndOffset += symbol_directSize(argBaseType);
     }
 
-    for (const auto & eachSndString : analArgs.outString) {
+    if (zcSnd)
+      emit_zero_copy_string(outFile, analArgs.outString, true);
+    else for (const auto & eachSndString : analArgs.outString) {
       FormalSym * fsym = eachSndString.fsym;
       Symbol *argType = symbol_ResolveRef(fsym->type);
       Symbol *argBaseType = symbol_ResolveType(argType);
@@ -257,18 +332,22 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
   }
 
   /* Pass 2: patch the indirect arg data pointers */
-  for (const auto & eachrcvString : analArgs.inString) {
+  unsigned rcvAlign = 0xfu;	/* rcvIndir starts 8-aligned */
+  if (! zcRcv) for (const auto & eachrcvString : analArgs.inString) {
     FormalSym * fsym = eachrcvString.fsym;
     Symbol *argType = symbol_ResolveRef(fsym->type);
     Symbol *argBaseType = symbol_ResolveType(argType);
 
     if (symbol_IsVarSequenceType(argBaseType)) {
+      rcvAlign = emit_symbol_align("rcvIndir", outFile, 2,
+				   symbol_alignof(argBaseType->type),
+				   rcvAlign);
       do_indent(outFile, 2);
       fprintf(outFile, "%s->data = (", fsym->name);
 
       output_c_type(argBaseType->type, outFile, 0);
 
-      fprintf(outFile, " *) (msg->rcv_data + rcvIndir)\n");
+      fprintf(outFile, " *) (msg->rcv_data + rcvIndir);\n");
 
       do_indent(outFile, 2);
       fprintf(outFile, "rcvIndir += (%s->len * sizeof(*%s->data));\n",
@@ -296,9 +375,16 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
       else
         first = false;
 
-      if (! fsym->isOutput) {
+      if (symbol_IsInterface(argType))
+	fprintf(outFile, fsym->isOutput ? "/* OUT */ &%s" : "%s",
+		eachChild->name);
+      else if (! fsym->isOutput) {
 	if ((needRegs = can_registerize(argBaseType, rcv_regcount))) {
-	  fprintf(outFile, "%s", eachChild->name);
+	  if (opt_direct_regs)
+	    emit_pass_from_reg(outFile, eachChild, rcv_regcount);
+	  else
+	    fprintf(outFile, "%s", eachChild->name);
+	  rcv_regcount += needRegs;
 	}
 	else {
 	  fprintf(outFile, "*%s", eachChild->name);
@@ -323,8 +409,10 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
   fprintf(outFile, "\n");
 
   /* Pass 4: pack the outgoing return string */
-  if (! analArgs.outDataRegs.empty() || ! analArgs.outString.empty()) {
+  if (! analArgs.outDataRegs.empty() || ! analArgs.outString.empty()
+      || ! analArgs.outKeyRegs.empty()) {
     unsigned snd_regcount = FIRST_REG;
+    unsigned snd_keycount = 0;
     unsigned curAlign = 0xfu;
 
     do_indent(outFile, 2);
@@ -340,18 +428,31 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
       if (! fsym->isOutput)
 	continue;
 
-      if ((needRegs = can_registerize(argBaseType, snd_regcount))) {
+      if (symbol_IsInterface(argType)) {
+	do_indent(outFile, 4);
+	fprintf(outFile, "msg->snd_key%u = %s;\n", snd_keycount++,
+		eachChild->name);
+      }
+      else if ((needRegs = can_registerize(argBaseType, snd_regcount))) {
 	emit_return_via_reg(outFile, eachChild, 4, snd_regcount);
 	snd_regcount += needRegs;
       }
+      else if (zcSnd) {
+	/* The implementation may have pointed data at its own
+	   storage; send from wherever it is. */
+	do_indent(outFile, 4);
+	fprintf(outFile, "msg->snd_data = %s->data;\n", eachChild->name);
+	do_indent(outFile, 4);
+	fprintf(outFile, "msg->snd_len = %s->len;\n", eachChild->name);
+      }
       else if (symbol_IsVarSequenceType(argBaseType)) {
-	unsigned elemAlign = symbol_alignof(argBaseType);
+	unsigned elemAlign = symbol_alignof(argBaseType->type);
 
 	curAlign = emit_symbol_align("sndIndir", outFile, 4,
 				     elemAlign, curAlign);
 	do_indent(outFile, 4);
 	fprintf(outFile, 
-		"__builtin_memcpy(msg.snd_data + sndIndir, "
+		"__builtin_memcpy((uint8_t *) msg->snd_data + sndIndir, "
 		"%s->data, %s->len * sizeof(*%s->data));\n",
 		eachChild->name, eachChild->name, eachChild->name);
 
@@ -362,7 +463,7 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
       }
     }
 
-    if (! analArgs.outString.empty()) {
+    if (! analArgs.outString.empty() && ! zcSnd) {
       do_indent(outFile, 4);
 
       if (sndIndirect)
@@ -378,52 +479,202 @@ emit_op_dispatcher(Symbol *s, FILE *outFile)
   fprintf(outFile, "}\n");
 }
 
+/* Emit the server side of the batch companion of operation s (see
+   op_is_batched()): call the implementation for each request in the
+   receive string, stopping after the first that fails, and return
+   the results in the send string.  snd_w1 is the number of requests
+   that succeeded.  Request i's keys are in key slots i * nKeys
+   onward, for both the keys received and the keys returned. */
 static void
-emit_if_decoder(Symbol *s, FILE *outFile)
+emit_batch_dispatcher(Symbol *s, FILE *outFile)
 {
-  if (!s->isActiveUOC)
-    return;
+  const char *qn = symbol_QualifiedName(s, '_');
+  AnalyzedArgs analArgs;
+  analyze_arguments(s, analArgs);
+  unsigned nInKeys = analArgs.inKeyRegs.size();
+  unsigned nOutKeys = analArgs.outKeyRegs.size();
 
   fprintf(outFile, "\n");
   fprintf(outFile, "static void\n");
-  fprintf(outFile, "DISPATCH_IF_%s(Message *msg, IfInfo *info)\n", 
-	  symbol_QualifiedName(s, '_'));
+  fprintf(outFile, "DISPATCH_BATCH_%s(Message *msg, IfInfo *info)\n", qn);
   fprintf(outFile, "{\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "const %s_batchIn *in = (const %s_batchIn *) msg->rcv_data;\n",
+	  qn, qn);
+  do_indent(outFile, 2);
+  fprintf(outFile, "%s_batchOut *out = (%s_batchOut *) msg->snd_data;\n",
+	  qn, qn);
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned long n = msg->rcv_w1;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned long i;\n");
+  if (nInKeys) {
+    do_indent(outFile, 2);
+    fprintf(outFile, "const cap_t rcvKeys[3] = "
+	    "{ msg->rcv_key0, msg->rcv_key1, msg->rcv_key2 };\n");
+  }
+  if (nOutKeys) {
+    do_indent(outFile, 2);
+    fprintf(outFile, "cap_t sndKeys[3] = { KR_VOID, KR_VOID, KR_VOID };\n");
+  }
+  fprintf(outFile, "\n");
 
   do_indent(outFile, 2);
-  fprintf(outFile, "switch(msg->rcv_code) {\n");
+  fprintf(outFile, "if (n > %s_batchMax || msg->rcv_sent < n * sizeof(*in)) {\n",
+	  qn);
+  do_indent(outFile, 4);
+  fprintf(outFile, "msg->snd_code = RC_capros_key_RequestError;\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "return;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "}\n");
+  fprintf(outFile, "\n");
 
-  while (s) {
-    fprintf(outFile, "\n");
-    do_indent(outFile, 2);
-    fprintf(outFile, "/* IF %s */\n", symbol_QualifiedName(s, '_'));
-    fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "for (i = 0; i < n; i++) {\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "out[i].rc = implement_%s(", qn);
+
+  bool first = true;
+  unsigned inKey = 0;
+  unsigned outKey = 0;
+  for (const auto eachChild : s->children) {
+    FormalSym * fsym = dynamic_cast<FormalSym*>(eachChild);
+    assert(fsym);
+
+    if (! first)
+      fprintf(outFile, ", ");
+    else
+      first = false;
+
+    if (symbol_IsInterface(fsym->type)) {
+      if (fsym->isOutput)
+	fprintf(outFile, "/* OUT */ &sndKeys[i * %u + %u]",
+		nOutKeys, outKey++);
+      else
+	fprintf(outFile, "rcvKeys[i * %u + %u]", nInKeys, inKey++);
+    }
+    else if (fsym->isOutput)
+      fprintf(outFile, "/* OUT */ &out[i].%s", eachChild->name);
+    else
+      fprintf(outFile, "in[i].%s", eachChild->name);
+  }
+  fprintf(outFile, ");\n");
+  do_indent(outFile, 4);
+  fprintf(outFile, "if (out[i].rc != RC_OK)\n");
+  do_indent(outFile, 6);
+  fprintf(outFile, "break;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "}\n");
+  fprintf(outFile, "\n");
 
-    for (const auto eachChild : s->children) {
-      if (eachChild->cls != sc_operation)
-	continue;
+  if (nOutKeys) {
+    for (unsigned k = 0; k < 3; k++) {
+      do_indent(outFile, 2);
+      fprintf(outFile, "msg->snd_key%u = sndKeys[%u];\n", k, k);
+    }
+  }
+  do_indent(outFile, 2);
+  fprintf(outFile, "msg->snd_w1 = i;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "msg->snd_len = ((i < n) ? i + 1 : n) * sizeof(*out);\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "msg->snd_code = RC_OK;\n");
+  fprintf(outFile, "}\n");
+}
 
+/* Emit the dense dispatch table for the operations that interface /s/
+   itself declares, indexed by the low bits of the opcode.  Slot 0 and
+   the slots of client-only methods are null. */
+static void
+emit_if_table(Symbol *s, FILE *outFile)
+{
+  fprintf(outFile, "\n");
+  fprintf(outFile, "static const OpDispatchFn DISPATCH_TABLE_%s[] = {\n",
+	  symbol_QualifiedName(s, '_'));
+  do_indent(outFile, 2);
+  fprintf(outFile, "[0] = 0,\t/* opcode 0 is reserved */\n");
+
+  for (const auto eachChild : s->children) {
+    if (eachChild->cls != sc_operation)
+      continue;
+
+    if (eachChild->flags & SF_NO_OPCODE)
+      continue;
+
+    do_indent(outFile, 2);
+    fprintf(outFile, "[OC_%s & 0x%x] = DISPATCH_OP_%s,\n",
+	    eachChild->QualifiedName('_'), OPCODE_INDEX_MASK,
+	    eachChild->QualifiedName('_'));
+
+    if (op_is_batched(eachChild)) {
       do_indent(outFile, 2);
-      fprintf(outFile, "case OC_%s:\n", eachChild->QualifiedName('_'));
-      do_indent(outFile, 4);
-      fprintf(outFile, "DISPATCH_OP_%s(msg, info);\n", 
-	      symbol_QualifiedName(s, '_'));
+      fprintf(outFile, "[OC_%s_batch & 0x%x] = DISPATCH_BATCH_%s,\n",
+	      eachChild->QualifiedName('_'), OPCODE_INDEX_MASK,
+	      eachChild->QualifiedName('_'));
     }
+  }
+
+  fprintf(outFile, "};\n");
+}
+
+/* The interface decoder indexes a table of the per-interface tables
+   by the depth field of the opcode, then the chosen table by the
+   operation index.  Both tables are built by capidl, so an inherited
+   operation costs no more to reach than one declared by /s/. */
+static void
+emit_if_decoder(Symbol *s, FILE *outFile)
+{
+  if (!s->isActiveUOC)
+    return;
 
-    s = s->baseType ? symbol_ResolveRef(s->baseType) : NULL;
+  fprintf(outFile, "\n");
+  fprintf(outFile, "static void\n");
+  fprintf(outFile, "DISPATCH_IF_%s(Message *msg, IfInfo *info)\n", 
+	  symbol_QualifiedName(s, '_'));
+  fprintf(outFile, "{\n");
+
+  do_indent(outFile, 2);
+  fprintf(outFile, "static const struct OpDispatchTable byDepth[%u] = {\n",
+	  s->ifDepth + 1);
+
+  for (Symbol *ifs = s; ifs;
+       ifs = ifs->baseType ? symbol_ResolveRef(ifs->baseType) : NULL) {
+    const char *qn = symbol_QualifiedName(ifs, '_');
+
+    do_indent(outFile, 4);
+    fprintf(outFile, "[%u] = { DISPATCH_TABLE_%s,\n", ifs->ifDepth, qn);
+    do_indent(outFile, 10);
+    fprintf(outFile, "sizeof(DISPATCH_TABLE_%s) / sizeof(OpDispatchFn) },\n",
+	    qn);
   }
 
+  do_indent(outFile, 2);
+  fprintf(outFile, "};\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned depth = msg->rcv_code >> %u;\n",
+	  OPCODE_DEPTH_SHIFT);
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned ndx = msg->rcv_code & 0x%x;\n",
+	  OPCODE_INDEX_MASK);
   fprintf(outFile, "\n");
+
   do_indent(outFile, 2);
-  fprintf(outFile, "default" ":\n");
+  fprintf(outFile, "if (depth < %u && ndx < byDepth[depth].nOps\n",
+	  s->ifDepth + 1);
+  do_indent(outFile, 6);
+  fprintf(outFile, "&& byDepth[depth].ops[ndx]) {\n");
   do_indent(outFile, 4);
-  fprintf(outFile, "msg->snd_code = RC_capros_key_UnknownRequest;\n");
+  fprintf(outFile, "byDepth[depth].ops[ndx](msg, info);\n");
   do_indent(outFile, 4);
   fprintf(outFile, "return;\n");
-
   do_indent(outFile, 2);
   fprintf(outFile, "}\n");
 
+  fprintf(outFile, "\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "msg->snd_code = RC_capros_key_UnknownRequest;\n");
+
   fprintf(outFile, "}\n");
 }
 
@@ -445,6 +696,7 @@ emit_decoders(Symbol *s, FILE *outFile)
       for (const auto eachChild : s->children)
 	emit_decoders(eachChild, outFile);
 
+      emit_if_table(s, outFile);
       emit_if_decoder(s, outFile);
 
       return;
@@ -452,7 +704,12 @@ emit_decoders(Symbol *s, FILE *outFile)
 
   case sc_operation:
     {
+      if (s->flags & SF_NO_OPCODE)	// client-only
+	return;
+
       emit_op_dispatcher(s, outFile);
+      if (op_is_batched(s))
+	emit_batch_dispatcher(s, outFile);
 
       return;
     }
@@ -517,7 +774,7 @@ msg_size(Symbol *s, bool output)
   return 0;
 }
 
-static size_t
+size_t
 size_server_buffer(Symbol *scope, bool output)
 {
   size_t bufSz = 0;
@@ -569,7 +826,7 @@ calc_sym_depend(Symbol *s, PtrVec *vec)
   return;
 }
 
-static void
+void
 compute_server_dependencies(Symbol *scope, PtrVec *vec)
 {
   /* Export subordinate packages first! */
@@ -599,6 +856,68 @@ emit_server_decoders(Symbol *scope, FILE *outFile)
   return;
 }
 
+/* The message buffers must also hold a full batch for each batched
+   operation the server dispatches.  The record sizes are left to the
+   C compiler. */
+static void
+emit_batch_sizes(Symbol *s, FILE *outFile)
+{
+  if (s->mark)
+    return;
+
+  s->mark = true;
+
+  switch(s->cls) {
+  case sc_absinterface:
+  case sc_interface:
+    {
+      if (s->baseType)
+	emit_batch_sizes(symbol_ResolveRef(s->baseType), outFile);
+
+      for (const auto eachChild : s->children)
+	emit_batch_sizes(eachChild, outFile);
+
+      return;
+    }
+
+  case sc_operation:
+    {
+      if ((s->flags & SF_NO_OPCODE) || !op_is_batched(s))
+	return;
+
+      const char *qn = symbol_QualifiedName(s, '_');
+
+      do_indent(outFile, 2);
+      fprintf(outFile, "if (rcvSz < %s_batchMax * sizeof(%s_batchIn))\n",
+	      qn, qn);
+      do_indent(outFile, 4);
+      fprintf(outFile, "rcvSz = %s_batchMax * sizeof(%s_batchIn);\n", qn, qn);
+      do_indent(outFile, 2);
+      fprintf(outFile, "if (sndSz < %s_batchMax * sizeof(%s_batchOut))\n",
+	      qn, qn);
+      do_indent(outFile, 4);
+      fprintf(outFile, "sndSz = %s_batchMax * sizeof(%s_batchOut);\n", qn, qn);
+
+      return;
+    }
+
+  default:
+    return;
+  }
+}
+
+static void
+emit_server_batch_sizes(Symbol *scope, FILE *outFile)
+{
+  for (const auto eachChild : scope->children) {
+    if (eachChild->cls != sc_package && eachChild->isActiveUOC)
+      emit_batch_sizes(eachChild, outFile);
+
+    if (eachChild->cls == sc_package)
+      emit_server_batch_sizes(eachChild, outFile);
+  }
+}
+
 static void 
 emit_server_dispatcher(Symbol *scope, FILE *outFile)
 {
@@ -612,12 +931,15 @@ emit_server_dispatcher(Symbol *scope, FILE *outFile)
   do_indent(outFile, 2);
   fprintf(outFile, "IfInfo info;\n");
   do_indent(outFile, 2);
-  fprintf(outFile, "extern bool if_demux(Message *pMsg, IfInfo *);\n");
+  fprintf(outFile, "extern bool demux_if(Message *pMsg, IfInfo *);\n");
 
   do_indent(outFile, 2);
   fprintf(outFile, "size_t sndSz = %d;\n", sndSz);
   do_indent(outFile, 2);
   fprintf(outFile, "size_t rcvSz = %d;\n", rcvSz);
+
+  symbol_ClearAllMarks(scope);
+  emit_server_batch_sizes(scope, outFile);
   do_indent(outFile, 2);
   fprintf(outFile, "void *sndBuf = alloca(sndSz);\n");
   do_indent(outFile, 2);
@@ -686,18 +1008,20 @@ emit_server_dispatcher(Symbol *scope, FILE *outFile)
   do_indent(outFile, 4);
   fprintf(outFile, "msg.snd_len = 0;\n");
   do_indent(outFile, 4);
+  fprintf(outFile, "msg.snd_data = sndBuf;\t/* a handler may have redirected it */\n");
+  do_indent(outFile, 4);
   fprintf(outFile, "msg.snd_key0 = 0;\n");
   do_indent(outFile, 4);
   fprintf(outFile, "msg.snd_key1 = 0;\n");
   do_indent(outFile, 4);
   fprintf(outFile, "msg.snd_key2 = 0;\n");
   do_indent(outFile, 4);
-  fprintf(outFile, "msg.snd_w0 = 0;\n");
-  do_indent(outFile, 4);
   fprintf(outFile, "msg.snd_w1 = 0;\n");
   do_indent(outFile, 4);
   fprintf(outFile, "msg.snd_w2 = 0;\n");
   do_indent(outFile, 4);
+  fprintf(outFile, "msg.snd_w3 = 0;\n");
+  do_indent(outFile, 4);
   fprintf(outFile, "msg.snd_code = RC_capros_key_UnknownRequest;\t/* Until otherwise proven */\n");
 
   fprintf(outFile, "\n");
@@ -711,6 +1035,36 @@ emit_server_dispatcher(Symbol *scope, FILE *outFile)
   fprintf(outFile, "}\n");
 }
 
+/* Emit the IfInfo type and the interface and operation dispatchers,
+   but not the main loop.  The c-bench back end uses this to put the
+   server code in its harness. */
+void
+emit_server_code(Symbol *universalScope, FILE *outFile)
+{
+  fprintf(outFile, "\ntypedef struct IfInfo {\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "void (*if_proc)(Message *pMsg, struct IfInfo *ifInfo);\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "void *invState;\t/* passed to handler */\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "void *globalState;\t/* passed to handler */\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "bool done;\t/* set true by handler when exiting */\n");
+  fprintf(outFile, "} IfInfo;\n");
+
+  fprintf(outFile, "\ntypedef void (*OpDispatchFn)(Message *pMsg, IfInfo *ifInfo);\n");
+  fprintf(outFile, "\nstruct OpDispatchTable {\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "const OpDispatchFn *ops;\n");
+  do_indent(outFile, 2);
+  fprintf(outFile, "unsigned nOps;\n");
+  fprintf(outFile, "};\n");
+
+  symbol_ClearAllMarks(universalScope);
+
+  emit_server_decoders(universalScope, outFile);
+}
+
 void 
 output_c_server(Symbol *universalScope, BackEndFn fn)
 {
@@ -768,20 +1122,7 @@ output_c_server(Symbol *universalScope, BackEndFn fn)
     }
   }
 
-  fprintf(outFile, "\ntypedef struct IfInfo {\n");
-  do_indent(outFile, 2);
-  fprintf(outFile, "void (*if_proc)(Message *pMsg, struct IfInfo *ifInfo);\n");
-  do_indent(outFile, 2);
-  fprintf(outFile, "void *invState;\t/* passed to handler */\n");
-  do_indent(outFile, 2);
-  fprintf(outFile, "void *globalState;\t/* passed to handler */\n");
-  do_indent(outFile, 2);
-  fprintf(outFile, "bool done;\t/* set true by handler when exiting */\n");
-  fprintf(outFile, "} IfInfo;\n");
-
-  symbol_ClearAllMarks(universalScope);
-
-  emit_server_decoders(universalScope, outFile);
+  emit_server_code(universalScope, outFile);
 
   emit_server_dispatcher(universalScope, outFile);
 
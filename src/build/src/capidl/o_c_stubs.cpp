@@ -327,7 +327,19 @@ emit_send_string(std::vector<StringArg> const & argVec, FILE *out, int indent)
     return;
 
   /* Choose strategy: */
-  if (argVec.size() == 1 &&
+  if (zero_copy_string(argVec)) {
+    FormalSym * s0 = argVec[0].fsym;
+    const char *acc = c_byreftype(s0->type) ? "->" : ".";
+
+    do_indent(out, indent);
+    fprintf(out, "/* Zero-copy: send %s's bytes in place */\n", s0->name);
+    do_indent(out, indent);
+    fprintf(out, "msg.snd_len = %s%slen;\n", s0->name, acc);
+    do_indent(out, indent);
+    fprintf(out, "msg.snd_data = %s%sdata;\n", s0->name, acc);
+    fputc('\n', out);
+  }
+  else if (argVec.size() == 1 &&
       symbol_IsDirectSerializable(argVec[0].fsym->type)) {
     FormalSym * s0 = argVec[0].fsym;
     Symbol * s0BaseType = symbol_ResolveType(s0->type);
@@ -365,9 +377,7 @@ emit_send_string(std::vector<StringArg> const & argVec, FILE *out, int indent)
   }
   else {
     unsigned align = 0xfu;
-#if 0
     unsigned indirAlign = 0xfu;
-#endif
 
     do_indent(out, indent);
     fprintf(out, "msg.snd_data = sndData;\n");
@@ -414,33 +424,20 @@ emit_send_string(std::vector<StringArg> const & argVec, FILE *out, int indent)
 	fprintf(out, "sndLen += sizeof(%s);\n", fsym->name);
 
 	if (symbol_IsVarSequenceType(argBaseType)) {
-#if 0
-	  do_indent(out, indent+2);
-
+	  /* The content follows the direct bytes, in argument order.
+	     The server finds it by the lengths; the data pointer
+	     in the header is meaningless to it. */
 	  indirAlign = emit_symbol_align("sndIndir", out, indent+2,
-				    symbol_alignof(argBaseType), indirAlign);
-
-	  fprintf(out, "_CAPIDL_arg->data = (");
-	  output_c_type(argBaseType->type, out, 0);
-	  fprintf(out, " *) (sndData + sndIndir);\n", fsym->name);
-#endif
+					 symbol_alignof(argBaseType->type),
+					 indirAlign);
 
 	  do_indent(out, indent+2);
-	  fprintf(out, "__builtin_memcpy(_CAPIDL_arg->data, %s.data, "
+	  fprintf(out, "__builtin_memcpy(sndData + sndIndir, %s.data, "
 		  "sizeof(*%s.data) * %s.len);\n",
 		  fsym->name, fsym->name, fsym->name);
-
-	  fprintf(out, "\n");
-	  do_indent(out, indent+2);
-#if 0
-	  fprintf(out, "/* Encode the vector offset for transmission */\n");
-	  do_indent(out, indent+2);
-	  fprintf(out, "((unsigned long) _CAPIDL_arg->data) = sndIndir;\n\n");
-
 	  do_indent(out, indent+2);
-	  fprintf(out, "sndIndir += sizeof(%s.data) * %s.len;\n",
+	  fprintf(out, "sndIndir += sizeof(*%s.data) * %s.len;\n",
 		  fsym->name, fsym->name);
-#endif
 	}
 	  
       }
@@ -458,7 +455,21 @@ emit_receive_string(std::vector<StringArg> const & argVec, FILE *out, int indent
     return;
   
   /* Choose strategy: */
-  if (argVec.size() == 1 &&
+  if (zero_copy_string(argVec)) {
+    FormalSym * s0 = argVec[0].fsym;
+
+    do_indent(out, indent);
+    unsigned bound = zero_copy_bound(argVec);
+
+    fprintf(out, "/* Zero-copy: receive into %s's buffer */\n", s0->name);
+    do_indent(out, indent);
+    fprintf(out, "msg.rcv_limit = (%s->max < %u ? %s->max : %u);\n",
+	    s0->name, bound, s0->name, bound);
+    do_indent(out, indent);
+    fprintf(out, "msg.rcv_data = %s->data;\n", s0->name);
+    fputc('\n', out);
+  }
+  else if (argVec.size() == 1 &&
       symbol_IsDirectSerializable(argVec[0].fsym->type) ) {
     FormalSym * s0 = argVec[0].fsym;
 
@@ -510,6 +521,23 @@ emit_unpack_return_string(std::vector<StringArg> const & argVec, FILE *out, int
   unsigned indirAlign = 0xfu;
 
   /* Choose strategy: */
+  if (zero_copy_string(argVec)) {
+    FormalSym * s0 = argVec[0].fsym;
+    unsigned bound = zero_copy_bound(argVec);
+
+    /* rcv_sent is what the server sent, which may exceed what we
+       accepted: no more than the caller's buffer or the bound. */
+    do_indent(out, indent);
+    fprintf(out, "%s->len = msg.rcv_sent;\n", s0->name);
+    do_indent(out, indent);
+    fprintf(out, "if (%s->len > %s->max) %s->len = %s->max;\n",
+	    s0->name, s0->name, s0->name, s0->name);
+    do_indent(out, indent);
+    fprintf(out, "if (%s->len > %u) %s->len = %u;\n",
+	    s0->name, bound, s0->name, bound);
+    return;
+  }
+
   isDirect = (argVec.size() == 1 && argVec[0].direct);
 
   if (isDirect)
@@ -552,39 +580,42 @@ emit_unpack_return_string(std::vector<StringArg> const & argVec, FILE *out, int
       fprintf(out, "rcvLen += (%d * sizeof(*%s));\n",
 	      mpz_get_ui(&bound), fsym->name);
     }
-    else {
-      do_indent(out, indent+2);
-      fprintf(out, "*%s = *_CAPIDL_arg;\n", fsym->name);
+    else if (symbol_IsVarSequenceType(argBaseType)) {
+      MP_INT bound = compute_value(argBaseType->value);
+      unsigned int ubound = mpz_get_ui(&bound);
+
+      /* Keep the caller's data and max; copy no more than both
+	 they and the bound allow. */
       do_indent(out, indent+2);
       fprintf(out, "rcvLen += sizeof(*%s);\n", fsym->name);
 
-      if (symbol_IsVarSequenceType(argBaseType)) {
-	MP_INT bound = compute_value(argBaseType->value);
-	unsigned int ubound = mpz_get_ui(&bound);
-	
-	do_indent(out, indent+2);
-
-	indirAlign = emit_symbol_align("rcvIndir", out, indent+2,
-				       symbol_alignof(argBaseType), indirAlign);
-
-	fprintf(out, "_CAPIDL_arg->data = (");
-	output_c_type(argBaseType->type, out, 0);
-	fprintf(out, " *) (rcvData + rcvIndir);\n", fsym->name);
+      indirAlign = emit_symbol_align("rcvIndir", out, indent+2,
+				     symbol_alignof(argBaseType->type),
+				     indirAlign);
 
-	do_indent(out, indent+2);
-	fprintf(out, "__builtin_memcpy(%s->data, _CAPIDL_arg->data, "
-		"sizeof(%s->data) * "
-		"(_CAPIDL_arg->len < %d ? _CAPIDL_arg->len : %d));\n",
-		fsym->name, fsym->name, ubound, ubound);
+      do_indent(out, indent+2);
+      fprintf(out, "%s->len = (_CAPIDL_arg->len < %d ? _CAPIDL_arg->len : %d);\n",
+	      fsym->name, ubound, ubound);
+      do_indent(out, indent+2);
+      fprintf(out, "if (%s->len > %s->max) %s->len = %s->max;\n",
+	      fsym->name, fsym->name, fsym->name, fsym->name);
+      do_indent(out, indent+2);
+      fprintf(out, "__builtin_memcpy(%s->data, rcvData + rcvIndir, "
+	      "sizeof(*%s->data) * %s->len);\n",
+	      fsym->name, fsym->name, fsym->name);
 
-	fprintf(out, "\n");
+      fprintf(out, "\n");
 
-	do_indent(out, indent+2);
-	fprintf(out, "rcvIndir += sizeof(%s->data) * "
-		"(_CAPIDL_arg->len < %d ? _CAPIDL_arg->len : %d);\n",
-		fsym->name, ubound, ubound);
-      }
-	  
+      do_indent(out, indent+2);
+      fprintf(out, "rcvIndir += sizeof(*%s->data) * "
+	      "(_CAPIDL_arg->len < %d ? _CAPIDL_arg->len : %d);\n",
+	      fsym->name, ubound, ubound);
+    }
+    else {
+      do_indent(out, indent+2);
+      fprintf(out, "*%s = *_CAPIDL_arg;\n", fsym->name);
+      do_indent(out, indent+2);
+      fprintf(out, "rcvLen += sizeof(*%s);\n", fsym->name);
     }
     do_indent(out, indent);
     fprintf(out, "}\n");
@@ -681,6 +712,19 @@ c_op_needs_message_string(std::vector<StringArg> & stringArgs)
     return 1;
 }
 
+/* has_indirect_string(): returns true if any of the string arguments
+   has content past the direct bytes, which is to say it is a
+   variable length sequence. */
+static bool
+has_indirect_string(std::vector<StringArg> const & stringArgs)
+{
+  for (const auto & eachSA : stringArgs)
+    if (symbol_IsVarSequenceType(symbol_ResolveType(eachSA.fsym->type)))
+      return true;
+
+  return false;
+}
+
 #if 0
 bool
 c_if_needs_message_string(Symbol *s, SymClass sc)
@@ -720,8 +764,14 @@ output_client_stub(FILE *out, Symbol *s, int indent)
   unsigned snd_regcount = FIRST_REG;
   unsigned rcv_regcount = FIRST_REG;
 
-  unsigned needSendString = c_op_needs_message_string(analArgs.inString);
-  unsigned needRcvString = c_op_needs_message_string(analArgs.outString);
+  /* A zero-copy string needs no staging buffer, as in the direct
+     case (2). */
+  unsigned needSendString = zero_copy_string(analArgs.inString)
+    ? 2 : c_op_needs_message_string(analArgs.inString);
+  unsigned needRcvString = zero_copy_string(analArgs.outString)
+    ? 2 : c_op_needs_message_string(analArgs.outString);
+  bool sndIndirect = has_indirect_string(analArgs.inString);
+  bool rcvIndirect = has_indirect_string(analArgs.outString);
 
   {
     BufferChunk bc;
@@ -781,18 +831,20 @@ output_client_stub(FILE *out, Symbol *s, int indent)
     fprintf(out, "unsigned char *sndData;\n");
     do_indent(out, indent + 2);
     fprintf(out, "unsigned sndLen = 0;\n");
-#if 0
-    do_indent(out, indent + 2);
-    fprintf(out, "unsigned sndIndir = 0;\n");
-#endif
+    if (sndIndirect) {
+      do_indent(out, indent + 2);
+      fprintf(out, "unsigned sndIndir = 0;\n");
+    }
   }
   if (needRcvString == 1) {
     do_indent(out, indent + 2);
     fprintf(out, "unsigned char *rcvData;\n");
     do_indent(out, indent + 2);
     fprintf(out, "unsigned rcvLen = 0;\n");
-    do_indent(out, indent + 2);
-    fprintf(out, "unsigned rcvIndir = 0;\n");
+    if (rcvIndirect) {
+      do_indent(out, indent + 2);
+      fprintf(out, "unsigned rcvIndir = 0;\n");
+    }
   }
 
   if (needSendString == 1) {
@@ -805,10 +857,10 @@ output_client_stub(FILE *out, Symbol *s, int indent)
     /* Align up to an 8 byte boundary to begin the indirect bytes */
     align = emit_symbol_align("sndLen", out, indent+2, 8, align);
 
-#if 0
-    do_indent(out, indent + 2);
-    fprintf(out, "sndIndir = sndLen;\n");
-#endif
+    if (sndIndirect) {
+      do_indent(out, indent + 2);
+      fprintf(out, "sndIndir = sndLen;\n");
+    }
     align = emit_indirect_byte_computation(analArgs.inString, out, indent+2,
 					   false, align);
     do_indent(out, indent + 2);
@@ -825,8 +877,10 @@ output_client_stub(FILE *out, Symbol *s, int indent)
     /* Align up to an 8 byte boundary to begin the indirect bytes */
     align = emit_symbol_align("rcvLen", out, indent+2, 8, align);
 
-    do_indent(out, indent + 2);
-    fprintf(out, "rcvIndir = rcvLen;\n");
+    if (rcvIndirect) {
+      do_indent(out, indent + 2);
+      fprintf(out, "rcvIndir = rcvLen;\n");
+    }
 
     emit_indirect_byte_computation(analArgs.outString, out, indent+2,
 				   true, align);
@@ -939,6 +993,113 @@ output_client_stub(FILE *out, Symbol *s, int indent)
   fprintf(out, "}\n");
 }
 
+/* Emit the assignment of the first three of /slotNames/ for one
+   invocation of the batch companion of operation s: request r's keys,
+   taken from /keyArgs/, fill slots r * keyArgs.size() onward, and
+   slots past the n requests being sent are KR_VOID. */
+static void
+emit_batch_keys(FILE *out, Symbol *s, std::vector<FormalSym*> const & keyArgs,
+		const char * const *slotNames, int indent)
+{
+  unsigned nKeys = keyArgs.size();
+
+  if (nKeys == 0)
+    return;
+
+  for (unsigned k = 0; k < 3; k++) {
+    do_indent(out, indent);
+    if (k / nKeys < batch_max(s))
+      fprintf(out, "msg.%s = (%u < n) ? in[%u].%s : KR_VOID;\n",
+	      slotNames[k], k / nKeys, k / nKeys, keyArgs[k % nKeys]->name);
+    else
+      fprintf(out, "msg.%s = KR_VOID;\n", slotNames[k]);
+  }
+}
+
+/* Emit the stub of the batch companion of operation s (see
+   op_is_batched()).  The request and result arrays are sent and
+   received in place, _batchMax requests per invocation, and the keys
+   of the requests occupy the key slots in request order.  The server
+   stops at the first request that fails; the stub then returns that
+   request's result, and *completed counts the requests that
+   succeeded. */
+static void
+output_batch_stub(FILE *out, Symbol *s, int indent)
+{
+  const char *qn = symbol_QualifiedName(s,'_');
+  AnalyzedArgs analArgs;
+  analyze_arguments(s, analArgs);
+
+  fprintf(out, "\nresult_t\n%s_batch(cap_t _self, unsigned long count, "
+	  "const %s_batchIn *in, %s_batchOut *out, "
+	  "unsigned long *completed)\n", qn, qn, qn);
+  fprintf(out, "{\n");
+  do_indent(out, indent + 2);
+  fprintf(out, "Message msg;\n");
+  fputc('\n', out);
+
+  do_indent(out, indent + 2);
+  fprintf(out, "msg.snd_invKey = _self;\n");
+  do_indent(out, indent + 2);
+  fprintf(out, "msg.snd_code = OC_%s_batch;\n", qn);
+  do_indent(out, indent + 2);
+  fprintf(out, "msg.snd_w2 = 0;\n");
+  do_indent(out, indent + 2);
+  fprintf(out, "msg.snd_w3 = 0;\n");
+  for (unsigned i = 0; i < 4; i++) {
+    do_indent(out, indent + 2);
+    fprintf(out, "msg.%s = KR_VOID;\n", sndKeyNames[i]);
+  }
+  for (unsigned i = 0; i < 4; i++) {
+    do_indent(out, indent + 2);
+    fprintf(out, "msg.%s = KR_VOID;\n", rcvKeyNames[i]);
+  }
+  fputc('\n', out);
+
+  do_indent(out, indent + 2);
+  fprintf(out, "*completed = 0;\n");
+  do_indent(out, indent + 2);
+  fprintf(out, "while (count) {\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "unsigned long n = (count < %s_batchMax) ? count : %s_batchMax;\n",
+	  qn, qn);
+  fputc('\n', out);
+  do_indent(out, indent + 4);
+  fprintf(out, "msg.snd_w1 = n;\n");
+  emit_batch_keys(out, s, analArgs.inKeyRegs, sndKeyNames, indent + 4);
+  emit_batch_keys(out, s, analArgs.outKeyRegs, rcvKeyNames, indent + 4);
+  do_indent(out, indent + 4);
+  fprintf(out, "msg.snd_data = in;\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "msg.snd_len = n * sizeof(*in);\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "msg.rcv_data = out;\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "msg.rcv_limit = n * sizeof(*out);\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "CALL(&msg);\n");
+  fputc('\n', out);
+  do_indent(out, indent + 4);
+  fprintf(out, "if (msg.rcv_code != RC_OK) return msg.rcv_code;\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "*completed += msg.rcv_w1;\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "if (msg.rcv_w1 < n) return out[msg.rcv_w1].rc;\n");
+  fputc('\n', out);
+  do_indent(out, indent + 4);
+  fprintf(out, "in += n;\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "out += n;\n");
+  do_indent(out, indent + 4);
+  fprintf(out, "count -= n;\n");
+  do_indent(out, indent + 2);
+  fprintf(out, "}\n");
+  fputc('\n', out);
+  do_indent(out, indent + 2);
+  fprintf(out, "return RC_OK;\n");
+  fprintf(out, "}\n");
+}
+
 #if 0
 static bool
 output_server_message_strings(FILE *out, Symbol *s, SymClass sc, int indent)
@@ -1431,6 +1592,8 @@ symdump(Symbol *s, FILE *out, int indent)
 		     fileName);
 
 	output_client_stub(out, s, indent);
+	if (op_is_batched(s))
+	  output_batch_stub(out, s, indent);
       }
 
       break;
@@ -25,9 +25,13 @@ Research Projects Agency under Contract No. W31P4Q-07-C-0070.
 Approved for public release, distribution unlimited. */
 
 #include <assert.h>
+#include <string.h>
+#include <applib/Diag.h>
 #include <o_c_util.h>
 #include "util.h"
 
+extern MP_INT compute_value(Symbol *s);
+
 /* Size of largest integral type that we will attempt to registerize: */
 #define MAX_REGISTERIZABLE 64
 
@@ -320,6 +324,93 @@ makeStringArg(FormalSym * fsym)
   return sa;
 }
 
+/* zero_copy_string(): with -z, returns true if /argVec/, the string
+   arguments of one direction of an operation, is a single bounded
+   sequence or buffer of bytes.  Such a string is sent or received in
+   place in the caller's storage: the message string is the bytes
+   themselves, with no sequence header, and the length travels as the
+   string length.  Clients and servers of an interface must agree, so
+   both must be generated with -z. */
+bool
+zero_copy_string(std::vector<StringArg> const & argVec)
+{
+  extern bool opt_zero_copy;
+
+  if (!opt_zero_copy || argVec.size() != 1)
+    return false;
+
+  Symbol *seqType = symbol_ResolveType(argVec[0].fsym->type);
+  if (! symbol_IsVarSequenceType(seqType) || seqType->value == 0)
+    return false;
+
+  return symbol_directSize(seqType->type) == 1;
+}
+
+/* The maximum number of elements in a zero-copy string. */
+unsigned
+zero_copy_bound(std::vector<StringArg> const & argVec)
+{
+  Symbol *seqType = symbol_ResolveType(argVec[0].fsym->type);
+  MP_INT bound = compute_value(seqType->value);
+
+  return mpz_get_ui(&bound);
+}
+
+/* op_is_batched(): returns true if operation /s/ was named with -b.
+   Such an operation gets a companion, OC_x_batch, that carries an
+   array of requests in the send string and returns an array of
+   results in the receive string, so that one invocation does the
+   work of many.  A request is the operation's input registers and a
+   result is its return code and output registers.  The keys of the
+   requests travel in the message's three key slots, in request
+   order, which limits the batch size (see batch_max()).  Strings
+   cannot be carried in an array, so operations that pass them cannot
+   be batched; nor can client-only operations, which have no opcode. */
+bool
+op_is_batched(Symbol *s)
+{
+  extern std::vector<const char *> batchOps;
+  const char *qn = symbol_QualifiedName(s, '.');
+  bool named = false;
+
+  for (const auto eachName : batchOps)
+    if (strcmp(eachName, qn) == 0)
+      named = true;
+
+  if (!named)
+    return false;
+
+  if (s->flags & SF_NO_OPCODE)
+    diag_fatal(1, "Operation \"%s\" is client-only and cannot be batched\n",
+	       qn);
+
+  AnalyzedArgs analArgs;
+  analyze_arguments(s, analArgs);
+
+  if (! analArgs.inString.empty() || ! analArgs.outString.empty())
+    diag_fatal(1, "Operation \"%s\" cannot be batched: "
+	       "it passes strings\n", qn);
+
+  return true;
+}
+
+/* batch_max(): the number of requests one invocation of the batch
+   companion of /s/ carries: BATCH_MAX, or as many requests as fit
+   their keys in the three key slots of a message. */
+unsigned
+batch_max(Symbol *s)
+{
+  AnalyzedArgs analArgs;
+  analyze_arguments(s, analArgs);
+
+  unsigned nKeys = max(analArgs.inKeyRegs.size(),
+		       analArgs.outKeyRegs.size());
+
+  if (nKeys == 0)
+    return BATCH_MAX;
+  return min(BATCH_MAX, 3 / nKeys);
+}
+
 void analyze_arguments(Symbol * s, AnalyzedArgs & analArgs)
 {
   unsigned  inNReg = FIRST_REG;  // first available  IN data register
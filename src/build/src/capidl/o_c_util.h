@@ -54,3 +54,11 @@ struct AnalyzedArgs {
   std::vector<StringArg> outString;
 };
 void analyze_arguments(Symbol * s, AnalyzedArgs & analArgs);
+bool zero_copy_string(std::vector<StringArg> const & argVec);
+unsigned zero_copy_bound(std::vector<StringArg> const & argVec);
+
+/* Number of requests carried by one invocation of a batch companion. */
+#define BATCH_MAX 64
+
+bool op_is_batched(Symbol * s);
+unsigned batch_max(Symbol * s);
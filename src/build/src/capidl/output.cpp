@@ -39,6 +39,7 @@ extern void output_capidl(Symbol *);
 extern void output_depend(Symbol *);
 extern void output_c_server(Symbol *, BackEndFn);
 extern void output_c_server_hdr(Symbol *, BackEndFn);
+extern void output_c_bench(Symbol *, BackEndFn);
 
 extern void rewrite_for_c(Symbol *);
 extern bool c_typecheck(Symbol *);
@@ -55,6 +56,7 @@ backend back_ends[] = {
   { "c-server",  c_typecheck, rewrite_for_c, 0,       output_c_server  },
   { "c-server-header",
                  c_typecheck, rewrite_for_c, 0,       output_c_server_hdr },
+  { "c-bench",   c_typecheck, rewrite_for_c, 0,       output_c_bench   },
   { "capidl",    0,           0,             output_capidl,        0  },
   { "depend",    0,           0,             output_depend,        0  }
 };
@@ -244,6 +244,13 @@ cmme_main(void)
              capros_HTTP_KC_Directory, KR_HTTPDirectory);
   ckOK
 
+  // The handlers share TLS sessions in a file.
+  result = capros_FileServer_createFile(KR_FileServer, KR_TEMP0);
+  ckOK
+  result = capros_Constructor_insertConstituent(KR_HTTPBuilder,
+             capros_HTTP_KC_SessionCache, KR_TEMP0);
+  ckOK
+
   result = capros_Constructor_seal(KR_HTTPBuilder, KR_TEMP2);
   ckOK
 